@@ -0,0 +1,280 @@
+// Loaded latency per LLC bank, in the style of Intel MLC's loaded latency
+// test, but resolved by bank through the per-bank eviction sets.
+//
+// For every probe bank B, a latency probe on this core chases B's eviction set
+// (an LLC hit in B per access) while load generator threads on other cores
+// chase eviction sets of the same group:
+// - "same":  all generators load bank B,
+// - "other": generators load the other banks, round-robin.
+// Sets of different constructions cannot be matched by bank, so the "same"
+// generators share the probe's lines. With exactly waysPerBank lines the set
+// still fits in the bank, and every core's chase misses its private caches.
+// The load rises from one paced generator to all of them unpaced. Each level
+// reports the generators' achieved request rate and the probe's average
+// latency, which gives one latency-versus-bandwidth curve per bank and target.
+//
+// The peak rate is the highest achieved rate into the bank. The sustainable
+// rate is the highest one at which the probe latency stays within
+// SUSTAINABLE_LATENCY_FACTOR of the unloaded latency.
+//
+// Writes all points to ../results/bank_loaded_latency.txt, after a line with
+// the prefetcher state (see prefetcherControl.h):
+//   PROBE_BANK TARGET THREADS DELAY_CYCLES RATE_MREQ_PER_S LATENCY_CYCLES
+//
+// To run (with huge pages):
+// $ make runBankLoadedLatency
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <x86intrin.h>
+
+#include "constants.h"
+#include "evictionSetBuilder.h"
+#include "geometryProfile.h"
+#include "measurementKernels.h"
+#include "prefetcherControl.h"
+#include "toolUtils.h"
+
+const uint64_t SET_INDEX = 27;
+
+const uint64_t DEFAULT_MAX_LOAD_THREADS = 8;
+const uint64_t DEFAULT_LEVEL_MS = 200;
+
+// Pacing of each generator: TSC cycles between two accesses (0: unpaced).
+// Every thread count is run with each of these, from lightest to heaviest.
+const uint64_t LOAD_DELAYS[] = {2000, 500, 150, 0};
+
+// Where the load generators chase: the probed bank itself, or the others.
+const char* const LOAD_TARGETS[] = {"same", "other"};
+
+// Accesses per timed probe sample, and per generator burst between checks of
+// the stop flag.
+const uint64_t PROBE_ACCESSES = 100;
+const uint64_t UNPACED_BURST = 1000;
+
+const double SUSTAINABLE_LATENCY_FACTOR = 2.0;
+
+const char* const RESULTS_PATH = "../results/bank_loaded_latency.txt";
+
+struct LoadGenerator {
+    std::thread thread;
+    uint64_t accesses = 0;
+    uint64_t garbage = 0;
+};
+
+// One point of a curve.
+struct LoadLevel {
+    uint64_t threads;
+    uint64_t delay;
+    double rate;
+    double latency;
+};
+
+void RunLoadGenerator(Node* node, uint64_t delay, int coreID,
+                      const std::atomic<bool>* stop,
+                      LoadGenerator* generator) {
+    PinToCore(coreID);
+
+    uint64_t accesses = 0;
+    while (!stop->load(std::memory_order_relaxed)) {
+        if (delay == 0) {
+            node = ChaseNodes(node, UNPACED_BURST);
+            accesses += UNPACED_BURST;
+            continue;
+        }
+
+        node = ChaseNodes(node, 1);
+        ++accesses;
+        const uint64_t next = __rdtsc() + delay;
+        while (__rdtsc() < next) {
+            _mm_pause();
+        }
+    }
+
+    generator->accesses = accesses;
+    generator->garbage = node->padding[0];
+}
+
+// Runs one load level and returns the generators' achieved rate (million
+// requests per second) and the probe's average latency (cycles per access).
+LoadLevel MeasureLevel(Node* probeHead, const std::vector<Node*>& loadHeads,
+                       const std::vector<int>& loadCores, uint64_t delay,
+                       uint64_t levelMs, uint64_t& garbage) {
+    std::atomic<bool> stop{false};
+    const auto launch = std::chrono::steady_clock::now();
+    std::vector<LoadGenerator> generators(loadHeads.size());
+    for (uint64_t i = 0; i < loadHeads.size(); ++i) {
+        generators[i].thread = std::thread(RunLoadGenerator, loadHeads[i],
+                                           delay, loadCores[i], &stop,
+                                           &generators[i]);
+    }
+
+    // Let the generators reach their rate before probing.
+    std::this_thread::sleep_for(std::chrono::milliseconds(levelMs / 10));
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::milliseconds(levelMs);
+    Node* node = probeHead;
+    uint64_t cycles = 0;
+    uint64_t samples = 0;
+    while (std::chrono::steady_clock::now() < end) {
+        cycles += MeasureChase(&node, PROBE_ACCESSES);
+        ++samples;
+    }
+    garbage += node->padding[0];
+
+    stop = true;
+    uint64_t accesses = 0;
+    for (LoadGenerator& generator : generators) {
+        generator.thread.join();
+        accesses += generator.accesses;
+        garbage += generator.garbage;
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - launch).count();
+
+    LoadLevel level;
+    level.threads = loadHeads.size();
+    level.delay = delay;
+    level.rate = accesses / seconds / 1e6;
+    level.latency = static_cast<double>(cycles) / (samples * PROBE_ACCESSES);
+    return level;
+}
+
+// Latency of the probe bank with no load.
+double UnloadedLatency(Node* probeHead, uint64_t levelMs, uint64_t& garbage) {
+    return MeasureLevel(probeHead, {}, {}, 0, levelMs, garbage).latency;
+}
+
+void PrintUsage(const char* program) {
+    std::cerr << "Usage: " << program
+              << " [--load-threads N] [--level-ms MS] [--bank B]"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t maxLoadThreads = DEFAULT_MAX_LOAD_THREADS;
+    uint64_t levelMs = DEFAULT_LEVEL_MS;
+    int64_t onlyBank = -1;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        if (arg == "--load-threads") {
+            maxLoadThreads = std::stoull(argv[++i]);
+        } else if (arg == "--level-ms") {
+            levelMs = std::stoull(argv[++i]);
+        } else if (arg == "--bank") {
+            onlyBank = std::stoll(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    SanityCheckMeasurementKernels();
+
+    const GeometryProfile& geometry = Geometry();
+    if (onlyBank >= static_cast<int64_t>(geometry.llcBanks) ||
+        geometry.llcBanks < 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    // The probe stays on the first allowed core; every generator gets a core
+    // of its own among the others.
+    const std::vector<int> allowedCores = AllowedCores();
+    if (allowedCores.size() < 2 || maxLoadThreads == 0) {
+        std::cerr << "Needs a core for the probe and at least one for load"
+                  << std::endl;
+        return 1;
+    }
+    const int probeCore = allowedCores[0];
+    const std::vector<int> loadCores(
+        allowedCores.begin() + 1,
+        allowedCores.begin() + std::min<uint64_t>(allowedCores.size(),
+                                               1 + maxLoadThreads));
+    PinToCore(probeCore);
+
+    EvictionSetBuilder builder;
+    const EvictionSetGroup group = builder.Build(SET_INDEX);
+
+    std::cout << "Load generators on " << loadCores.size() << " cores"
+              << std::endl;
+    ApplyPrefetcherMode(
+        std::vector<int>(allowedCores.begin(),
+                         allowedCores.begin() + 1 + loadCores.size()));
+
+    std::ofstream results(RESULTS_PATH);
+    assert(results.is_open());
+    results << "# prefetchers: " << PrefetcherStateDescription() << std::endl;
+
+    uint64_t garbage = 0;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "bank target   idle lat  peak Mreq/s  sustainable Mreq/s"
+              << std::endl;
+
+    for (uint64_t bank = 0; bank < geometry.llcBanks; ++bank) {
+        if (onlyBank >= 0 && bank != static_cast<uint64_t>(onlyBank)) {
+            continue;
+        }
+        Node* probeHead = group.Head(bank);
+        const double idle = UnloadedLatency(probeHead, levelMs, garbage);
+
+        for (const std::string target : LOAD_TARGETS) {
+            std::vector<LoadLevel> curve;
+            for (uint64_t threads = 1; threads <= loadCores.size();
+                 ++threads) {
+                std::vector<Node*> loadHeads;
+                for (uint64_t i = 0; i < threads; ++i) {
+                    uint64_t loadBank = bank;
+                    if (target == "other") {
+                        loadBank = (bank + 1 + i % (geometry.llcBanks - 1)) %
+                            geometry.llcBanks;
+                    }
+                    loadHeads.push_back(group.Head(loadBank));
+                }
+                std::vector<int> cores(loadCores.begin(),
+                                       loadCores.begin() + threads);
+
+                for (uint64_t delay : LOAD_DELAYS) {
+                    const LoadLevel level = MeasureLevel(
+                        probeHead, loadHeads, cores, delay, levelMs, garbage);
+                    curve.push_back(level);
+                    results << bank << " " << target << " " << level.threads
+                            << " " << level.delay << " " << level.rate << " "
+                            << level.latency << std::endl;
+                }
+            }
+
+            double peak = 0;
+            double sustainable = 0;
+            for (const LoadLevel& level : curve) {
+                peak = std::max(peak, level.rate);
+                if (level.latency <= SUSTAINABLE_LATENCY_FACTOR * idle) {
+                    sustainable = std::max(sustainable, level.rate);
+                }
+            }
+            std::cout << std::setw(4) << bank << " " << std::setw(6)
+                      << target << std::setw(11) << idle << std::setw(13)
+                      << peak << std::setw(20) << sustainable << std::endl;
+        }
+    }
+
+    std::cout << "Wrote " << RESULTS_PATH << " (Garbage: " << garbage << ")"
+              << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,618 @@
+// Long-running daemon which turns LLC bank contention into a continuous
+// signal. For every socket, one probing thread builds an eviction set per LLC
+// bank (using EvictionSetBuilder, at the same time as the other sockets, each
+// with its own probe configuration) and then periodically runs a short timed
+// chase through each bank's set. A bank whose set is being contended by other
+// cores shows a higher average access time than its quiet baseline. On
+// non-inclusive LLCs, where a set fits in the probing core's L2, the accesses
+// are instead timed one at a time, each after evicting the set from the
+// private caches.
+//
+// Estimates are served over a Unix domain socket. Connect and send one line:
+//   "metrics" (or nothing) -> Prometheus-style text export
+//   "stats"                -> human-readable table
+//
+// e.g.
+// $ socat - UNIX-CONNECT:/tmp/bankTelemetry.sock
+//
+// To run (with huge pages):
+// $ make runBankTelemetry
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <x86intrin.h>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "evictionSetBuilder.h"
+#include "evictionSetHealth.h"
+#include "geometryProfile.h"
+#include "hugePages.h"
+#include "measurementKernels.h"
+#include "setIndexSelection.h"
+#include "toolUtils.h"
+
+const char* const DEFAULT_SOCKET_PATH = "/tmp/bankTelemetry.sock";
+
+// Time between the starts of two consecutive probe rounds.
+const uint64_t DEFAULT_PERIOD_MS = 1000;
+
+// Upper bound on the fraction of one core each probing thread may use. If a
+// probe round takes longer than this fraction of the period, the thread sleeps
+// longer than the period to stay under budget.
+const double DEFAULT_DUTY_CYCLE = 0.01;
+
+// Timed accesses per bank per probe round. At ~40 cycles per access this is a
+// few tens of microseconds per bank.
+const uint64_t PROBE_ACCESSES_PER_BANK = 2000;
+
+// Untimed passes over a bank's set to pull it back into the LLC after sleeping.
+const uint64_t PROBE_WARMUP_PASSES = 4;
+
+// On non-inclusive profiles, timed single accesses per bank per probe round,
+// each after evicting the set from the private caches (see ProbeBankEvicted()).
+const uint64_t PROBE_EVICTED_LOADS_PER_BANK = 200;
+
+// Weight of the newest round in the smoothed latency.
+const double LATENCY_SMOOTHING = 0.25;
+
+// An eviction set whose average access time stays above the profile's
+// llcCycleThreshold for this many consecutive rounds no longer hits in the LLC
+// and is repaired (or rebuilt, if repairing fails).
+const uint64_t MAX_FAILED_ROUNDS = 5;
+
+// Attempts per (re)build of the probe sets, each with another candidate order,
+// and the wait before the first retry, doubled after every failed attempt.
+// If all fail, the thread tries again every period.
+const uint64_t MAX_BUILD_ATTEMPTS = 4;
+const uint64_t BUILD_RETRY_BACKOFF_MS = 500;
+
+// Cache set used for the probe sets. Arbitrary. With --select-set, one
+// candidate of SET_INDEX_SAMPLES for each socket (see setIndexSelection.h).
+const uint64_t CACHE_SET_PROBE = 27;
+const uint64_t SET_INDEX_SAMPLES = 8;
+
+struct BankEstimate {
+    // Smoothed average access time of the bank's probe set.
+    double latency = 0;
+    // Lowest per-round average seen since the set was built.
+    double baseline = 0;
+    // Most recent per-round average.
+    double lastLatency = 0;
+    uint64_t failedRounds = 0;
+};
+
+struct SocketState {
+    int coreID;
+    uint64_t setIndex = CACHE_SET_PROBE;
+    EvictionSetGroup group;
+    std::vector<Node*> evictionSets;
+    EvictionSetHealth health;
+    // On non-inclusive profiles, lines which evict the set index from the
+    // probing core's L1 and L2, linked into one list. Null otherwise.
+    Node* privateEvictionList = nullptr;
+    uint64_t privateEvictionSize = 0;
+
+    // Everything below is shared with the server thread.
+    std::mutex mutex;
+    std::vector<BankEstimate> banks;
+    uint64_t rounds = 0;
+    uint64_t repairs = 0;
+    uint64_t rebuilds = 0;
+    uint64_t busyCycles = 0;
+    // False while the probe sets are (re)built. The last estimates are still
+    // served meanwhile.
+    bool ready = false;
+};
+
+std::atomic<bool> running(true);
+
+void HandleSignal(int) {
+    running = false;
+}
+
+// One probing core per LLC (i.e., per socket on Intel): the lowest-numbered
+// core of each which the process may run on, from the sysfs cache topology.
+std::vector<int> ProbeCores() {
+    std::vector<int> probeCores;
+    std::vector<int> llcs;
+    for (int core : AllowedCores()) {
+        const int llc = LlcSharingCores(core).front();
+        if (std::find(llcs.begin(), llcs.end(), llc) == llcs.end()) {
+            llcs.push_back(llc);
+            probeCores.push_back(core);
+        }
+    }
+    return probeCores;
+}
+
+// Relative increase of the smoothed latency over the quiet baseline.
+double Pressure(const BankEstimate& bank) {
+    if (bank.baseline <= 0 || bank.latency <= bank.baseline) {
+        return 0;
+    }
+    return (bank.latency - bank.baseline) / bank.baseline;
+}
+
+// Sleeps in short slices so that shutdown is prompt.
+void SleepWhileRunning(std::chrono::steady_clock::duration duration) {
+    const std::chrono::steady_clock::duration slice =
+        std::chrono::milliseconds(100);
+    const auto wakeup = std::chrono::steady_clock::now() + duration;
+    while (running && std::chrono::steady_clock::now() < wakeup) {
+        std::this_thread::sleep_for(
+            std::min(wakeup - std::chrono::steady_clock::now(), slice));
+    }
+}
+
+// Builds the probe sets and checks them with EvictionSetGroup::Validate(),
+// retrying up to MAX_BUILD_ATTEMPTS times with backoff. Returns false if no
+// attempt passed (or shutdown was requested).
+bool BuildProbeSets(SocketState* state, uint64_t* garbage) {
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->ready = false;
+    }
+
+    EvictionSetBuilder builder;
+    auto backoff = std::chrono::milliseconds(BUILD_RETRY_BACKOFF_MS);
+    for (uint64_t attempt = 0; attempt < MAX_BUILD_ATTEMPTS && running;
+         ++attempt) {
+        if (attempt > 0) {
+            std::cout << "Eviction sets on core " << state->coreID
+                      << " failed validation, retrying in "
+                      << backoff.count() << " ms" << std::endl;
+            SleepWhileRunning(backoff);
+            backoff *= 2;
+        }
+
+        // Free the previous arena before allocating the next one.
+        state->group = EvictionSetGroup();
+        builder.seed = attempt;
+        state->group = builder.Build(state->setIndex);
+        if (state->group.Validate(*garbage)) {
+            state->evictionSets = state->group.Heads();
+            state->privateEvictionList = nullptr;
+            if (!Geometry().inclusive) {
+                std::vector<Node*> lines =
+                    state->group.PrivateMembers(PrivateCache::L1);
+                const std::vector<Node*> l2 =
+                    state->group.PrivateMembers(PrivateCache::L2);
+                lines.insert(lines.end(), l2.begin(), l2.end());
+                state->privateEvictionList = LinkCandidates(lines);
+                state->privateEvictionSize = lines.size();
+            }
+            InitEvictionSetHealth(&state->health, state->group.Arena().Data(),
+                                  state->setIndex, &state->evictionSets,
+                                  *garbage);
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->banks.assign(Geometry().llcBanks, BankEstimate());
+            state->ready = true;
+            return true;
+        }
+    }
+
+    std::cout << "No valid eviction sets on core " << state->coreID
+              << " after " << MAX_BUILD_ATTEMPTS << " attempts" << std::endl;
+    return false;
+}
+
+// Returns the average access time of one short timed chase through the set.
+double ProbeBank(Node* node, uint64_t* garbage) {
+    node = ChaseNodes(node, PROBE_WARMUP_PASSES * Geometry().waysPerBank);
+    const uint64_t time = MeasureChase(&node, PROBE_ACCESSES_PER_BANK);
+
+    *garbage += node->padding[0];
+
+    return static_cast<double>(time) / PROBE_ACCESSES_PER_BANK;
+}
+
+// ProbeBank() for non-inclusive profiles, where the set fits in the probing
+// core's L2 and a chase would time L2 hits: returns the average time of
+// single accesses to the set, each after chasing "*evictionList" once.
+double ProbeBankEvicted(Node* node, Node** evictionList,
+                        uint64_t evictionSize, uint64_t* garbage) {
+    node = ChaseNodes(node, PROBE_WARMUP_PASSES * Geometry().waysPerBank);
+
+    uint64_t times[PROBE_EVICTED_LOADS_PER_BANK];
+    uint64_t latencies[PROBE_EVICTED_LOADS_PER_BANK];
+    StampedEvictedLoads(&node, evictionList, evictionSize,
+                        PROBE_EVICTED_LOADS_PER_BANK, times, latencies);
+
+    *garbage += node->padding[0] + (*evictionList)->padding[0];
+
+    uint64_t total = 0;
+    for (uint64_t latency : latencies) {
+        total += latency;
+    }
+    return static_cast<double>(total) / PROBE_EVICTED_LOADS_PER_BANK;
+}
+
+void ProbeSocket(SocketState* state, uint64_t periodMs, double dutyCycle,
+                 bool selectSet, uint64_t* garbage) {
+    const GeometryProfile& geometry = Geometry();
+
+    // Eviction sets are constructed on this core too, so that the array is
+    // allocated on this socket's memory node.
+    PinToCore(state->coreID);
+
+    // Configure probing for this socket before anything probes: probing state
+    // is per thread, so each socket gets a helper core on its own LLC (and its
+    // own counting timer), and both sockets can build at the same time.
+    GetProbeConfig();
+
+    // A core sharing the LLC provides the reference load. Keeps the default
+    // set index if none of the sampled ones got eviction sets.
+    if (selectSet) {
+        const std::vector<uint64_t> selected = SelectSetIndices(
+            1, SET_INDEX_SAMPLES, {CACHE_SET_PROBE}, state->coreID,
+            LlcSharingCore(state->coreID), *garbage);
+        if (!selected.empty()) {
+            state->setIndex = selected[0];
+        }
+    }
+
+    bool built = BuildProbeSets(state, garbage);
+
+    std::vector<double> latencies(geometry.llcBanks);
+
+    while (running) {
+        if (!built) {
+            SleepWhileRunning(std::chrono::milliseconds(periodMs));
+            built = BuildProbeSets(state, garbage);
+            continue;
+        }
+
+        const auto roundStart = std::chrono::steady_clock::now();
+        const uint64_t startCycles = __rdtsc();
+
+        for (uint64_t bank = 0; bank < geometry.llcBanks; ++bank) {
+            latencies[bank] = state->privateEvictionList != nullptr ?
+                ProbeBankEvicted(state->evictionSets[bank],
+                                 &state->privateEvictionList,
+                                 state->privateEvictionSize, garbage) :
+                ProbeBank(state->evictionSets[bank], garbage);
+        }
+
+        const uint64_t roundCycles = __rdtsc() - startCycles;
+
+        // Between rounds, check one set for moved members or lost eviction.
+        // This takes a few microseconds.
+        const uint64_t unhealthyBank =
+            CheckNextEvictionSet(&state->health, *garbage);
+
+        std::vector<uint64_t> failedBanks;
+        if (unhealthyBank < geometry.llcBanks) {
+            failedBanks.push_back(unhealthyBank);
+        }
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            for (uint64_t bank = 0; bank < geometry.llcBanks; ++bank) {
+                BankEstimate& estimate = state->banks[bank];
+                const double latency = latencies[bank];
+
+                estimate.lastLatency = latency;
+                if (estimate.baseline == 0 || latency < estimate.baseline) {
+                    estimate.baseline = latency;
+                }
+                if (estimate.latency == 0) {
+                    estimate.latency = latency;
+                } else {
+                    estimate.latency += LATENCY_SMOOTHING *
+                        (latency - estimate.latency);
+                }
+
+                if (latency > geometry.llcCycleThreshold) {
+                    ++estimate.failedRounds;
+                } else {
+                    estimate.failedRounds = 0;
+                }
+                if (estimate.failedRounds >= MAX_FAILED_ROUNDS &&
+                    bank != unhealthyBank) {
+                    failedBanks.push_back(bank);
+                }
+            }
+            ++state->rounds;
+            state->busyCycles += roundCycles;
+        }
+
+        if (!failedBanks.empty()) {
+            // Try repairing only the failed sets before rebuilding everything.
+            bool repaired = true;
+            for (uint64_t bank : failedBanks) {
+                std::cout << "Eviction set " << bank << " on core "
+                          << state->coreID << " failed validation, repairing"
+                          << std::endl;
+                repaired = repaired &&
+                    RepairEvictionSet(&state->health, bank, *garbage);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (repaired) {
+                    for (uint64_t bank : failedBanks) {
+                        state->banks[bank] = BankEstimate();
+                    }
+                    state->repairs += failedBanks.size();
+                } else {
+                    ++state->rebuilds;
+                }
+            }
+
+            if (!repaired) {
+                std::cout << "Rebuilding eviction sets on core "
+                          << state->coreID << std::endl;
+                built = BuildProbeSets(state, garbage);
+            }
+        }
+
+        // Repairs and rebuilds count towards the duty cycle as well.
+
+        // Sleep for the rest of the period, or longer if the round took more
+        // than the allowed duty cycle.
+        const auto busy = std::chrono::steady_clock::now() - roundStart;
+        auto sleep = std::chrono::milliseconds(periodMs) - busy;
+        const auto budgetSleep = std::chrono::duration_cast<
+            std::chrono::steady_clock::duration>(busy * (1 / dutyCycle - 1));
+        if (sleep < budgetSleep) {
+            sleep = budgetSleep;
+        }
+
+        SleepWhileRunning(sleep);
+    }
+}
+
+std::string FormatMetrics(std::vector<SocketState>& states) {
+    std::stringstream latency, pressure, ready, rounds, repairs, rebuilds,
+        busy;
+
+    latency << "# HELP llc_bank_latency_cycles Smoothed probe access time."
+            << std::endl << "# TYPE llc_bank_latency_cycles gauge" << std::endl;
+    pressure << "# HELP llc_bank_pressure Relative latency increase over the "
+             << "quiet baseline." << std::endl
+             << "# TYPE llc_bank_pressure gauge" << std::endl;
+    ready << "# HELP llc_probe_ready Whether the probe sets are built. If "
+          << "not, the bank metrics are the last estimates." << std::endl
+          << "# TYPE llc_probe_ready gauge" << std::endl;
+    rounds << "# HELP llc_probe_rounds_total Completed probe rounds."
+           << std::endl << "# TYPE llc_probe_rounds_total counter" << std::endl;
+    repairs << "# HELP llc_eviction_set_repairs_total Probe sets repaired "
+            << "after failed validation." << std::endl
+            << "# TYPE llc_eviction_set_repairs_total counter" << std::endl;
+    rebuilds << "# HELP llc_eviction_set_rebuilds_total Probe set rebuilds "
+             << "after failed validation." << std::endl
+             << "# TYPE llc_eviction_set_rebuilds_total counter" << std::endl;
+    busy << "# HELP llc_probe_busy_cycles_total Cycles spent probing."
+         << std::endl << "# TYPE llc_probe_busy_cycles_total counter"
+         << std::endl;
+
+    for (uint64_t socket = 0; socket < states.size(); ++socket) {
+        SocketState& state = states[socket];
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        const std::string socketLabel =
+            "socket=\"" + std::to_string(socket) + "\"";
+
+        for (uint64_t bank = 0; bank < state.banks.size(); ++bank) {
+            const std::string labels = "{" + socketLabel + ",bank=\"" +
+                std::to_string(bank) + "\"}";
+            latency << "llc_bank_latency_cycles" << labels << " "
+                    << state.banks[bank].latency << std::endl;
+            pressure << "llc_bank_pressure" << labels << " "
+                     << Pressure(state.banks[bank]) << std::endl;
+        }
+
+        ready << "llc_probe_ready{" << socketLabel << "} "
+              << (state.ready ? 1 : 0) << std::endl;
+        rounds << "llc_probe_rounds_total{" << socketLabel << "} "
+               << state.rounds << std::endl;
+        repairs << "llc_eviction_set_repairs_total{" << socketLabel << "} "
+                << state.repairs << std::endl;
+        rebuilds << "llc_eviction_set_rebuilds_total{" << socketLabel << "} "
+                 << state.rebuilds << std::endl;
+        busy << "llc_probe_busy_cycles_total{" << socketLabel << "} "
+             << state.busyCycles << std::endl;
+    }
+
+    return latency.str() + pressure.str() + ready.str() + rounds.str() +
+        repairs.str() + rebuilds.str() + busy.str();
+}
+
+std::string FormatStats(std::vector<SocketState>& states) {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+
+    for (uint64_t socket = 0; socket < states.size(); ++socket) {
+        SocketState& state = states[socket];
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        ss << "Socket " << socket << " (core " << state.coreID << "), rounds: "
+           << state.rounds << ", repairs: " << state.repairs << ", rebuilds: "
+           << state.rebuilds << std::endl;
+
+        if (!state.ready) {
+            ss << "  Building eviction sets" << std::endl;
+            if (state.banks.empty()) {
+                continue;
+            }
+            ss << "  Last estimates:" << std::endl;
+        }
+
+        ss << "  bank  latency  baseline  last  pressure" << std::endl;
+        for (uint64_t bank = 0; bank < state.banks.size(); ++bank) {
+            const BankEstimate& estimate = state.banks[bank];
+            ss << std::setw(6) << bank << std::setw(9) << estimate.latency
+               << std::setw(10) << estimate.baseline << std::setw(6)
+               << estimate.lastLatency << std::setw(10)
+               << std::setprecision(3) << Pressure(estimate)
+               << std::setprecision(1) << std::endl;
+        }
+    }
+
+    return ss.str();
+}
+
+void Serve(const std::string& socketPath, std::vector<SocketState>* states) {
+    const int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(listenFd >= 0);
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    assert(socketPath.size() < sizeof(address.sun_path));
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    unlink(socketPath.c_str());
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address),
+             sizeof(address)) != 0 || listen(listenFd, 16) != 0) {
+        std::cerr << "Could not listen on " << socketPath << ": "
+                  << strerror(errno) << std::endl;
+        running = false;
+        close(listenFd);
+        return;
+    }
+
+    std::cout << "Serving bank telemetry on " << socketPath << std::endl;
+
+    while (running) {
+        pollfd pfd = {listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+
+        const int clientFd = accept(listenFd, nullptr, nullptr);
+        if (clientFd < 0) {
+            continue;
+        }
+
+        // Give the client a moment to send a command. Clients which send
+        // nothing get the metrics export.
+        char request[64] = {0};
+        pollfd clientPfd = {clientFd, POLLIN, 0};
+        if (poll(&clientPfd, 1, 100) > 0) {
+            const ssize_t unused = read(clientFd, request, sizeof(request) - 1);
+            (void)unused;
+        }
+
+        const std::string response = strncmp(request, "stats", 5) == 0 ?
+            FormatStats(*states) : FormatMetrics(*states);
+
+        const char* data = response.c_str();
+        size_t remaining = response.size();
+        while (remaining > 0) {
+            const ssize_t written = write(clientFd, data, remaining);
+            if (written <= 0) {
+                break;
+            }
+            data += written;
+            remaining -= written;
+        }
+
+        close(clientFd);
+    }
+
+    close(listenFd);
+    unlink(socketPath.c_str());
+}
+
+void PrintUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--socket PATH] [--period-ms N]"
+              << " [--duty-cycle FRACTION] [--select-set]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string socketPath = DEFAULT_SOCKET_PATH;
+    uint64_t periodMs = DEFAULT_PERIOD_MS;
+    double dutyCycle = DEFAULT_DUTY_CYCLE;
+    bool selectSet = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--select-set") {
+            selectSet = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        if (arg == "--socket") {
+            socketPath = argv[++i];
+        } else if (arg == "--period-ms") {
+            periodMs = std::stoull(argv[++i]);
+        } else if (arg == "--duty-cycle") {
+            dutyCycle = std::stod(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (periodMs == 0 || dutyCycle <= 0 || dutyCycle > 1) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+
+    const std::vector<int> probeCores = ProbeCores();
+    const uint64_t numSockets = probeCores.size();
+    std::vector<SocketState> states(numSockets);
+    for (uint64_t socket = 0; socket < numSockets; ++socket) {
+        states[socket].coreID = probeCores[socket];
+    }
+    std::cout << "Probing " << numSockets << " LLCs from cores";
+    for (int core : probeCores) {
+        std::cout << " " << core;
+    }
+    std::cout << std::endl;
+
+    // Needed to prevent compiler optimizations.
+    std::vector<uint64_t> garbage(numSockets);
+
+    // Select the geometry profile before the probing threads share it.
+    Geometry();
+
+    // The sockets have separate LLCs, so their probing threads do not disturb
+    // each other's measurements.
+    std::vector<std::thread> threadProbers;
+    for (uint64_t socket = 0; socket < numSockets; ++socket) {
+        threadProbers.push_back(std::thread(ProbeSocket, &states[socket],
+                                            periodMs, dutyCycle, selectSet,
+                                            &garbage[socket]));
+    }
+
+    Serve(socketPath, &states);
+
+    // Serve() only returns once shutdown was requested (or it failed).
+    running = false;
+    for (uint64_t socket = 0; socket < numSockets; ++socket) {
+        threadProbers[socket].join();
+    }
+
+    uint64_t finalGarbage = 0;
+    for (uint64_t i = 0; i < garbage.size(); ++i) {
+        finalGarbage += garbage[i];
+    }
+    std::cout << "Shut down. (Garbage: " << finalGarbage << ")" << std::endl;
+
+    return 0;
+}
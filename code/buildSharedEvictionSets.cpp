@@ -0,0 +1,64 @@
+// Builds eviction sets once inside a hugetlbfs file, so that attacker and
+// victim processes can map them without constructing their own.
+//
+// The file is created on a hugetlbfs mount (see docs/hugepages.txt), so no
+// LD_PRELOAD is needed. Remove the file to release its huge pages.
+//
+// To run:
+// $ make runBuildSharedEvictionSets
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "sharedEvictionSet.h"
+
+// Same as CACHE_SET_ATTACKER and CACHE_SET_VICTIM in portAttack.cpp.
+const uint64_t DEFAULT_SET_INDICES[] = {27, 1898};
+
+int main(int argc, char* argv[]) {
+    std::string path = DEFAULT_SHARED_EVICTION_SET_PATH;
+    std::vector<uint64_t> setIndices;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--path" && i + 1 < argc) {
+            path = argv[++i];
+        } else if (arg[0] != '-') {
+            setIndices.push_back(std::stoull(arg));
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--path PATH] [SET_INDEX...]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    if (setIndices.empty()) {
+        setIndices.assign(std::begin(DEFAULT_SET_INDICES),
+                          std::end(DEFAULT_SET_INDICES));
+    }
+
+    SharedEvictionSets shared;
+    if (!CreateSharedEvictionSets(path, setIndices, &shared)) {
+        return 1;
+    }
+
+    // Make sure another process would accept what we published.
+    SharedEvictionSets attached;
+    if (!AttachSharedEvictionSets(path, &attached)) {
+        std::cerr << "Published eviction sets failed validation" << std::endl;
+        return 1;
+    }
+
+    for (uint64_t g = 0; g < attached.descriptor->numGroups; ++g) {
+        std::cout << "Set index " << attached.descriptor->groups[g].setIndex
+                  << ": array at offset "
+                  << attached.descriptor->groups[g].arrayOffset << std::endl;
+    }
+
+    DetachSharedEvictionSets(&attached);
+    DetachSharedEvictionSets(&shared);
+
+    return 0;
+}
@@ -5,7 +5,8 @@
 //   pp. 605-622, doi: 10.1109/SP.2015.43.
 // section IV.A
 
-// To run (with huge pages):
+// Candidate arrays are on transparent huge pages (hugePages.h). To use
+// libhugetlbfs instead:
 // $ LD_PRELOAD=libhugetlbfs.so HUGETLB_MORECORE=yes "binary"
 //
 // Very rarely the probe function may not terminate due to never recording a
@@ -13,16 +14,171 @@
 // (e.g., frequent thread context switching). Just rerun the program.
 
 #include <algorithm>
+#include <atomic>
 #include <bitset>
 #include <cassert>
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
-#include <map>
-#include <set>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
 #include <vector>
-#include <x86intrin.h> // For rdtsc()
+#include <x86intrin.h> // For clflush
 
 #include "constants.h" // Contains CPU-specific properties and "Node" definition
+#include "constructingEvictionSet.h"
+#include "geometryProfile.h"
+#include "hugePages.h"
+#include "measurementKernels.h"
+#include "prefetcherControl.h"
+#include "victimFootprint.h"
+
+// Group testing (ProbeConfig::smallPages): probes per eviction test, of which
+// the majority decides, and passes over the tested lines per probe, so that
+// large pools evict reliably.
+const uint64_t GROUP_TEST_PROBES = 3;
+const uint64_t GROUP_TEST_PASSES = 4;
+
+// Group testing: timed accesses per entry of the latency signatures which
+// tell the banks of the sets apart (see BankLatencySignature()). A new set
+// whose signature is closer to an earlier set's than this many times its own
+// re-measurement is in the same bank.
+const uint64_t GROUP_TEST_SIGNATURE_ACCESSES = 100000;
+const double GROUP_TEST_SAME_BANK_NOISE = 2;
+
+// Lines per way of a private eviction set, so that it evicts under replacement
+// policies other than LRU too.
+const uint64_t PRIVATE_EVICTION_SLACK = 2;
+
+// Thread on the helper core for ProbeStrategy::CROSS_CORE. It loads whatever
+// candidate the prober publishes and acknowledges with the same generation.
+struct ProbeHelper {
+    std::thread thread;
+    std::atomic<const Node*> candidate{nullptr};
+    std::atomic<uint64_t> generation{0};
+    std::atomic<uint64_t> doneGeneration{0};
+    std::atomic<bool> stop{false};
+
+    ~ProbeHelper() {
+        stop = true;
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+};
+
+// Probing state of one thread (see SetProbeConfig()). Each thread has its own
+// configuration, helper and counting timer, so that constructions on different
+// LLCs (e.g., one thread per socket) can run at the same time.
+struct ThreadProbeState {
+    ProbeConfig config;
+    bool configSet = false;
+    // Started by the first cross-core probe.
+    std::unique_ptr<ProbeHelper> helper;
+    // Cores this thread holds in "claimedCores".
+    std::vector<int> claimedCores;
+
+    ~ThreadProbeState();
+};
+
+thread_local ThreadProbeState probeState;
+
+// Cores of configured threads and their counting timers, so that threads
+// configured at the same time do not pick the same timer core.
+std::mutex claimedCoresMutex;
+std::vector<int> claimedCores;
+
+std::vector<int> ClaimedCores() {
+    std::lock_guard<std::mutex> lock(claimedCoresMutex);
+    return claimedCores;
+}
+
+void ClaimCore(int coreID) {
+    std::lock_guard<std::mutex> lock(claimedCoresMutex);
+    claimedCores.push_back(coreID);
+    probeState.claimedCores.push_back(coreID);
+}
+
+// Claims and returns an unclaimed core the process may run on, other than the
+// calling thread's, or -1 if there is none.
+int ClaimUnusedCore() {
+    std::lock_guard<std::mutex> lock(claimedCoresMutex);
+    std::vector<int> exclude = claimedCores;
+    exclude.push_back(sched_getcpu());
+    const int coreID = UnusedCore(exclude);
+    if (coreID >= 0) {
+        claimedCores.push_back(coreID);
+        probeState.claimedCores.push_back(coreID);
+    }
+    return coreID;
+}
+
+// Releases the calling thread's claims.
+void ReleaseCores() {
+    std::lock_guard<std::mutex> lock(claimedCoresMutex);
+    for (int coreID : probeState.claimedCores) {
+        claimedCores.erase(
+            std::find(claimedCores.begin(), claimedCores.end(), coreID));
+    }
+    probeState.claimedCores.clear();
+}
+
+ThreadProbeState::~ThreadProbeState() {
+    helper.reset();
+    ReleaseCores();
+}
+
+// True if rdtsc cannot time cache accesses here (see
+// TscResolvesCacheLevels()). Checked once per process.
+bool NeedsCountingTimer() {
+    static const bool needed =
+        RunningUnderHypervisor() && !TscResolvesCacheLevels();
+    return needed;
+}
+
+// Converts a counting timer result to TSC cycles, so that every threshold
+// stays in cycles.
+uint64_t TicksToCycles(uint64_t ticks) {
+    return static_cast<uint64_t>(ticks / CountingTimerTicksPerCycle());
+}
+
+// The calling thread's timer: that of its configuration, or for threads which
+// only measure, a counting timer wherever DetectProbeConfig() would use one.
+TimerSource ThreadTimer() {
+    if (probeState.configSet) {
+        return probeState.config.timer;
+    }
+    return NeedsCountingTimer() ? TimerSource::COUNTING_THREAD :
+        TimerSource::TSC;
+}
+
+// Starts the calling thread's counting timer on first use.
+const volatile uint64_t* TimerCounter() {
+    if (!CountingTimerRunning()) {
+        const int coreID = probeState.configSet ?
+            probeState.config.timerCoreID : ClaimUnusedCore();
+        assert(coreID >= 0);
+        StartCountingTimer(coreID);
+    }
+    return CountingTimerCounter();
+}
+
+uint64_t MeasureChase(Node** node, uint64_t accesses) {
+    if (ThreadTimer() == TimerSource::COUNTING_THREAD) {
+        return TicksToCycles(CountedChase(node, accesses, TimerCounter()));
+    }
+    return TimedChase(node, accesses);
+}
+
+uint64_t MeasureLoad(const void* line) {
+    if (ThreadTimer() == TimerSource::COUNTING_THREAD) {
+        return TicksToCycles(CountedLoad(line, TimerCounter()));
+    }
+    return TimedLoad(line);
+}
 
 // Returns the number of entries in the linked list.
 // Assumes the linked list is closed (wraps around).
@@ -46,32 +202,21 @@ uint64_t SizeOfLinkedList(const Node* node) {
 // Determine the average access latency for all the elements in the provided
 // linked list. Sanity check that the accesses are missing to DRAM.
 void SanityCheckCandidates(Node* candidateSetNode, uint64_t& garbage) {
-    const uint64_t iterations = 100000 * LLC_BANKS * WAYS_PER_BANK;
+    const GeometryProfile& geometry = Geometry();
 
-    register Node* currentNode = candidateSetNode;
-    register uint64_t i = 0;
-    uint64_t time;
+    const uint64_t iterations =
+        100000 * geometry.llcBanks * geometry.waysPerBank;
 
-    unsigned int unused;
-
-    _mm_lfence();
-    time = __rdtsc();
-
-    while (i++ < iterations) {
-        currentNode = currentNode->next;
-    }
-
-    _mm_lfence();
-    time = __rdtsc() - time;
+    Node* currentNode = candidateSetNode;
+    uint64_t time = MeasureChase(&currentNode, iterations);
 
     time /= iterations;
 
     std::cout << "Average candidate access time: " << time << std::endl;
 
-    // DRAM access time usually ~175-180 for Intel Xeon E5-2650 v4.
-    // May need to adjust for other processors.
-    assert(time >= 165);
-    assert(time <= 190);
+    // DRAM access time, from the geometry profile.
+    assert(time >= geometry.candidateCyclesMin);
+    assert(time <= geometry.candidateCyclesMax);
 
     std::cout << "Validated candidates miss to DRAM" << std::endl;
 
@@ -81,29 +226,21 @@ void SanityCheckCandidates(Node* candidateSetNode, uint64_t& garbage) {
 // Determine the average access latency for all the elements in the provided
 // linked list. Sanity check that the accesses are all hitting in the LLC.
 void SanityCheckConflictSet(Node* conflictSet, uint64_t& garbage) {
-    const uint64_t iterations = 10000 * LLC_BANKS * WAYS_PER_BANK;
-
-    register Node* currentNode = conflictSet;
-    register uint64_t i = 0;
-    uint64_t time;
+    const GeometryProfile& geometry = Geometry();
 
-    _mm_lfence();
-    time = __rdtsc();
+    const uint64_t iterations =
+        10000 * geometry.llcBanks * geometry.waysPerBank;
 
-    for (uint64_t i = 0; i < iterations; ++i) {
-        currentNode = currentNode->next;
-    }
-
-    _mm_lfence();
-    time = __rdtsc() - time;
+    Node* currentNode = conflictSet;
+    uint64_t time = MeasureChase(&currentNode, iterations);
 
     time /= iterations;
 
     std::cout << "Average access time for conflict set: " << time << std::endl;
 
-    // Average LLC access time is ~40 cycles for Intel Xeon E5-2650 v4.
-    // May need to adjust for other processors.
-    assert(time > 30 && time < 50);
+    // Average LLC access time, from the geometry profile.
+    assert(time > geometry.conflictSetCyclesMin &&
+           time < geometry.conflictSetCyclesMax);
 
     std::cout << "Validated conflict set access time" << std::endl;
 
@@ -116,47 +253,43 @@ void SanityCheckConflictSet(Node* conflictSet, uint64_t& garbage) {
 // - All sets' accesses hit in the LLC.
 void SanityCheckEvictionSets(std::vector<Node*> evictionSetHeads,
                              uint64_t& garbage) {
+    const GeometryProfile& geometry = Geometry();
+
     // Check that all sets are disjoint and the correct size.
-    std::set<Node*> allNodes;
+    std::vector<Node*> allNodes;
+    allNodes.reserve(geometry.ConflictSetSize());
     for (uint64_t i = 0; i < evictionSetHeads.size(); ++i) {
         Node* node = evictionSetHeads[i];
-        allNodes.insert(node);
+        allNodes.push_back(node);
         uint64_t evictionSetSize = 1;
 
         node = node->next;
         while (node != evictionSetHeads[i]) {
-            allNodes.insert(node);
+            allNodes.push_back(node);
             ++evictionSetSize;
             node = node->next;
         }
 
         // std::cout << "Eviction set " << i << " size: " << evictionSetSize
         //           << std::endl;
-        assert(evictionSetSize == WAYS_PER_BANK);
+        assert(evictionSetSize == geometry.waysPerBank);
     }
 
-    assert(allNodes.size() == CONFLICT_SET_SIZE);
+    std::sort(allNodes.begin(), allNodes.end());
+    assert(std::adjacent_find(allNodes.begin(), allNodes.end()) ==
+           allNodes.end());
+    assert(allNodes.size() == geometry.ConflictSetSize());
 
     std::cout << "Validated size of each eviction set" << std::endl;
     std::cout << "Validated eviction sets are disjoint" << std::endl;
 
     // Now check access time for each full eviction set.
-    const uint64_t iterations = 10000 * LLC_BANKS * WAYS_PER_BANK;
+    const uint64_t iterations =
+        10000 * geometry.llcBanks * geometry.waysPerBank;
 
     for (uint64_t j = 0; j < evictionSetHeads.size(); ++j) {
-        register Node* currentNode = evictionSetHeads[j];
-        register uint64_t i = 0;
-        uint64_t time;
-
-        _mm_lfence();
-        time = __rdtsc();
-
-        for (uint64_t i = 0; i < iterations; ++i) {
-            currentNode = currentNode->next;
-        }
-
-        _mm_lfence();
-        time = __rdtsc() - time;
+        Node* currentNode = evictionSetHeads[j];
+        uint64_t time = MeasureChase(&currentNode, iterations);
 
         time /= iterations;
 
@@ -166,8 +299,10 @@ void SanityCheckEvictionSets(std::vector<Node*> evictionSetHeads,
         // LLC access time averages about 40 cycles, but it strongly depends on
         // bank location. Now that each eviction set contains nodes in a
         // specific bank, the range in access times across eviction sets will
-        // vary noticably. I generally see times ranging from ~28-48.
-        assert(time > 25 && time < 55);
+        // vary noticably. I generally see times ranging from ~28-48 on
+        // Broadwell.
+        assert(time > geometry.evictionSetCyclesMin &&
+               time < geometry.evictionSetCyclesMax);
 
         garbage += currentNode->padding[0];
     }
@@ -176,129 +311,358 @@ void SanityCheckEvictionSets(std::vector<Node*> evictionSetHeads,
               << std::endl;
 }
 
+// Address bits which candidates of one set index share.
+uint64_t CandidateMask() {
+    // With small pages, only the set index bits inside the page offset are
+    // known from the virtual address.
+    uint64_t mask = Geometry().SetIndexMask();
+    if (GetProbeConfig().smallPages) {
+        mask &= SMALL_PAGE_SIZE - 1;
+    }
+    return mask;
+}
+
+uint64_t CandidateStride() {
+    return (CandidateMask() >> NUM_CACHE_LINE_BITS) + 1;
+}
+
 // Determine the indexes into the array (on a cache line boundary) whose
 // addresses indicate they map into the given cache set.
-void FindCandidates(Node* array, std::set<Node*>& candidates,
-                    uint64_t setIndex) {
-    for (uint64_t i = 0; i < ARRAY_ENTRIES; ++i) {
-        Node* nodeAddress = &(array[i]);
-        // std::cout << nodeAddress << std::endl;
+std::vector<Node*> FindCandidates(Node* array, uint64_t setIndex) {
+    const GeometryProfile& geometry = Geometry();
+    const uint64_t mask = CandidateMask();
+    const uint64_t stride = CandidateStride();
+
+    // Otherwise, lines on small pages do not map to the set index their
+    // address suggests, so skip the regions that did not get a huge page.
+    std::vector<bool> hugeRegions =
+        HugePageRegions(array, geometry.arraySize);
+    if (GetProbeConfig().smallPages) {
+        hugeRegions.assign(hugeRegions.size(), true);
+    }
+
+    // Sanity check that nodes are cache-line aligned.
+    const uintptr_t base = reinterpret_cast<uintptr_t>(array);
+    assert((base & CACHE_LINE_BITS) == 0);
+
+    // Step through the lines which map to the set index, starting from the
+    // first, instead of testing every line of the array.
+    const uint64_t target = (setIndex << NUM_CACHE_LINE_BITS) & mask;
+    const uint64_t first = ((target - base) & mask) / CACHE_LINE_SIZE;
+    assert(((base + first * CACHE_LINE_SIZE) & mask) == target);
+
+    std::vector<Node*> candidates;
+    candidates.reserve(geometry.ArrayEntries() / stride + 1);
+    for (uint64_t i = first; i < geometry.ArrayEntries(); i += stride) {
+        if (hugeRegions[i * sizeof(Node) / HUGE_PAGE_SIZE]) {
+            candidates.push_back(&array[i]);
+        }
+    }
+    return candidates;
+}
+
+std::vector<Node*> FindPrivateEvictionSet(Node* array, uint64_t setIndex,
+                                          PrivateCache level,
+                                          const std::vector<Node*>& exclude) {
+    const GeometryProfile& geometry = Geometry();
+    const bool l1 = level == PrivateCache::L1;
+    const uint64_t sets = l1 ? geometry.l1Sets : geometry.l2Sets;
+    const uint64_t ways = l1 ? geometry.l1Ways : geometry.l2Ways;
+
+    // Flipping the set index bit right above the level's index keeps the
+    // level's set, and changes the LLC set (and for the L1, the L2 set).
+    const uint64_t otherSetIndex = (setIndex ^ sets) % geometry.setsPerBank;
+
+    // Candidates tell apart CandidateStride() set indices (fewer with small
+    // pages), so cover each of the level's sets the lines could be in.
+    const uint64_t unknownSets =
+        sets / std::min<uint64_t>(sets, CandidateStride());
+    const uint64_t count = PRIVATE_EVICTION_SLACK * ways * unknownSets;
+
+    std::vector<Node*> excluded = exclude;
+    std::sort(excluded.begin(), excluded.end());
+
+    std::vector<Node*> candidates = FindCandidates(array, otherSetIndex);
+    ShuffleNodes(candidates, ConstructionSeed());
+
+    std::vector<Node*> lines;
+    for (Node* candidate : candidates) {
+        if (lines.size() == count) {
+            break;
+        }
+        if (!std::binary_search(excluded.begin(), excluded.end(),
+                                candidate)) {
+            lines.push_back(candidate);
+        }
+    }
+    assert(lines.size() == count);
+    return lines;
+}
+
+CandidateBitmap::CandidateBitmap(const std::vector<Node*>& candidates)
+    : stride(CandidateStride()) {
+    const auto range =
+        std::minmax_element(candidates.begin(), candidates.end());
+    first = *range.first;
+    const uint64_t slots = (*range.second - first) / stride + 1;
+    words.assign((slots + 63) / 64, 0);
+}
+
+bool CandidateBitmap::Contains(const Node* node) const {
+    const uint64_t slot = (node - first) / stride;
+    return (words[slot / 64] >> (slot % 64)) & 1;
+}
+
+void CandidateBitmap::Insert(const Node* node) {
+    assert(node >= first && (node - first) % stride == 0);
+    const uint64_t slot = (node - first) / stride;
+    assert(slot / 64 < words.size());
+    words[slot / 64] |= 1ULL << (slot % 64);
+}
+
+void CandidateBitmap::Clear() {
+    std::fill(words.begin(), words.end(), 0);
+}
+
+uint64_t SplitMix64::Next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t SplitMix64::Below(uint64_t bound) {
+    // Multiply-shift instead of a modulo (Lemire).
+    return static_cast<uint64_t>(
+        (static_cast<unsigned __int128>(Next()) * bound) >> 64);
+}
+
+void ShuffleNodes(std::vector<Node*>& nodes, uint64_t seed) {
+    SplitMix64 random(seed);
+    for (uint64_t i = nodes.size(); i > 1; --i) {
+        std::swap(nodes[i - 1], nodes[random.Below(i)]);
+    }
+}
+
+// Shared by every thread, so atomic.
+std::atomic<uint64_t> constructionSeed{0};
+std::atomic<uint64_t> probeCount{0};
+
+void SetConstructionSeed(uint64_t seed) {
+    constructionSeed = seed;
+}
+
+uint64_t ConstructionSeed() {
+    return constructionSeed;
+}
+
+uint64_t ProbeCount() {
+    return probeCount;
+}
 
-        const uintptr_t address = reinterpret_cast<uintptr_t>(nodeAddress);
+Node* LinkCandidates(const std::vector<Node*>& nodes) {
+    for (uint64_t i = 0; i < nodes.size(); ++i) {
+        nodes[i]->next = nodes[(i + 1) % nodes.size()];
+        nodes[(i + 1) % nodes.size()]->prev = nodes[i];
+    }
+    return nodes.front();
+}
 
-        // Sanity check that nodes are cache-line aligned.
-        assert((address & CACHE_LINE_BITS) == 0);
+// Shuffles "candidates" and links them into a closed list in that order, so
+// that accessing nodes in order does not trigger prefetching.
+void RandomizeLinkedList(std::vector<Node*>& candidates) {
+    ShuffleNodes(candidates, constructionSeed);
+    LinkCandidates(candidates);
+}
 
-        // Add the node as a candidate if it maps to the provided cache set.
-        if ((address & SET_INDEX_BITS) == (setIndex << NUM_CACHE_LINE_BITS)) {
-            candidates.insert(nodeAddress);
+// Spins this long without requests before the helper starts sleeping, so an
+// idle helper does not hold its core between constructions.
+const uint64_t PROBE_HELPER_IDLE_SPINS = 1000000;
+
+void RunProbeHelper(ProbeHelper* helper, int coreID) {
+    // Set core affinity.
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(coreID, &cpuset);
+    pthread_t currentThread = pthread_self();
+    pthread_setaffinity_np(currentThread, sizeof(cpu_set_t), &cpuset);
+
+    uint64_t idleSpins = 0;
+    while (!helper->stop.load(std::memory_order_acquire)) {
+        const uint64_t generation =
+            helper->generation.load(std::memory_order_acquire);
+        if (generation == helper->doneGeneration.load()) {
+            if (++idleSpins < PROBE_HELPER_IDLE_SPINS) {
+                _mm_pause();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            continue;
         }
+        idleSpins = 0;
+
+        // The timed load is only used because it cannot be optimized out.
+        TimedLoad(helper->candidate.load(std::memory_order_relaxed));
+        helper->doneGeneration.store(generation, std::memory_order_release);
     }
 }
 
-void RandomizeLinkedList(const std::set<Node*>& candidates) {
-    // Put the candidates into a list.
-    std::vector<Node*> candidateList;
-    for (auto it = candidates.begin(); it != candidates.end(); ++it) {
-        candidateList.push_back(*it);
+void StopProbeHelper() {
+    probeState.helper.reset();
+}
+
+void SetProbeConfig(const ProbeConfig& config) {
+    assert(config.strategy != ProbeStrategy::CROSS_CORE ||
+           config.helperCoreID >= 0);
+    assert(config.timer != TimerSource::COUNTING_THREAD ||
+           config.timerCoreID >= 0);
+    StopProbeHelper();
+    StopCountingTimer();
+    ReleaseCores();
+
+    probeState.config = config;
+    probeState.configSet = true;
+    ClaimCore(sched_getcpu());
+    if (config.timer == TimerSource::COUNTING_THREAD) {
+        ClaimCore(config.timerCoreID);
     }
-    //std::cout << "List size: " << candidateList.size() << std::endl;
+}
+
+ProbeConfig DetectProbeConfig() {
+    ProbeConfig config;
+    const int coreID = sched_getcpu();
 
-    // Create a list from 0 -> candidates.size() - 1. Randomly permute the list.
-    std::vector<uint64_t> permutation(candidateList.size());
-    for (uint64_t i = 0; i < permutation.size(); ++i) {
-        permutation[i] = i;
+    // Non-inclusive LLCs need a helper core to hold the candidate (see
+    // ProbeStrategy::CROSS_CORE).
+    if (!Geometry().inclusive) {
+        config.strategy = ProbeStrategy::CROSS_CORE;
+        config.helperCoreID = LlcSharingCore(coreID);
+        assert(config.helperCoreID >= 0);
     }
-    std::random_shuffle(permutation.begin(), permutation.end());
 
-    // Use the permutation to create the permuted linked list which loops among
-    // all the "candidates".
-    //
-    // We achieve this by taking the path of values in numerical order of the
-    // shuffled permutation.
-    //
-    // We start by creating a dictionary from value -> index in the shuffled
-    // permutation where it occurs.
-    std::map<uint64_t, uint64_t> dictionary;
-    for (uint64_t i = 0; i < permutation.size(); ++i) {
-        dictionary[permutation[i]] = i;
+    // Guest "physical" pages need not be contiguous on the host, so only
+    // page offsets can be trusted.
+    if (RunningUnderHypervisor()) {
+        std::cout << "Running under a hypervisor, building eviction sets "
+                  << "from 4 KiB page offsets" << std::endl;
+        config.smallPages = true;
+
+        if (NeedsCountingTimer()) {
+            std::vector<int> exclude = ClaimedCores();
+            exclude.push_back(coreID);
+            exclude.push_back(config.helperCoreID);
+            config.timer = TimerSource::COUNTING_THREAD;
+            config.timerCoreID = UnusedCore(exclude);
+            assert(config.timerCoreID >= 0);
+        }
+    }
+
+    return config;
+}
+
+// Serializes detecting and claiming cores across threads.
+std::mutex configureMutex;
+
+const ProbeConfig& GetProbeConfig() {
+    if (!probeState.configSet) {
+        std::lock_guard<std::mutex> lock(configureMutex);
+        SetProbeConfig(DetectProbeConfig());
     }
+    return probeState.config;
+}
 
-    // Now apply this permutation to create a linked list through all of the
-    // "candidates".
-    for (uint64_t i = 0; i < permutation.size(); ++i) {
-        // Get the position in permutation of the values "i" and "i+1".
-        const uint64_t startIndex = dictionary[i];
-        const uint64_t endIndex = dictionary[(i + 1) % permutation.size()];
+// Has the helper core load "candidate" and waits until it did.
+void LoadOnHelperCore(const Node* candidate) {
+    if (probeState.helper == nullptr) {
+        probeState.helper = std::make_unique<ProbeHelper>();
+        probeState.helper->thread =
+            std::thread(RunProbeHelper, probeState.helper.get(),
+                        probeState.config.helperCoreID);
+    }
 
-        // Use the permutation indices to extract their respective candidate
-        // nodes.
-        Node* startNode = candidateList[startIndex];
-        Node* endNode = candidateList[endIndex];
+    ProbeHelper* probeHelper = probeState.helper.get();
+    probeHelper->candidate.store(candidate, std::memory_order_relaxed);
+    const uint64_t generation = probeHelper->generation.load() + 1;
+    probeHelper->generation.store(generation, std::memory_order_release);
 
-        // "startNode" needs to point to "endNode".
-        startNode->next = endNode;
-        endNode->prev = startNode;
+    while (probeHelper->doneGeneration.load(std::memory_order_acquire) !=
+           generation) {
+        _mm_pause();
     }
 }
 
+// The cross-core variant of the probe sequence. The candidate is flushed
+// first so that no copy from an earlier probe is left in the attacker's
+// private caches; the only copy is then the helper's.
+uint64_t CrossCoreProbe(Node** setNode, const Node* candidate,
+                        uint64_t iterations) {
+    _mm_clflush(candidate);
+    _mm_mfence();
+
+    *setNode = ChaseNodes(*setNode, iterations);
+    LoadOnHelperCore(candidate);
+    *setNode = ChaseNodes(*setNode, iterations);
+
+    return MeasureLoad(candidate);
+}
+
 // This function is heavily based on Algorithm 1 in the paper mentioned at the
 // top.
 //
 // This version of "Probe()" iterates over the set many times because iterating
 // over the set only once often does not cause the candidate to be evicted by
-// the replacement policy, even if the set contains WAYS_PER_BANK nodes in the
+// the replacement policy, even if the set contains waysPerBank nodes in the
 // candidate's bank. This would be because the replacement policy evicts a
 // member of the set, whereas we want all set nodes to reside in the LLC when we
 // re-probe the candidate.
 //
-// "garbage" is solely for preventing the compiler from optimizing out parts of
-// this function.
-bool Probe(register Node* setStartNode, const Node* candidate,
-           uint64_t& garbage, const bool printOutput) {
-    register Node dummy1, dummy2;
-    register Node* currentNode = setStartNode;
+// The probe sequence itself is ProbeKernel() (see measurementKernels.S), so
+// the compiler cannot reorder or drop any of its accesses. With
+// ProbeStrategy::CROSS_CORE it is CrossCoreProbe() instead.
+//
+// "iterations" is the number of accesses to the list before and after loading
+// the candidate.
+bool ProbeWithIterations(Node* setStartNode, const Node* candidate,
+                         uint64_t iterations, uint64_t& garbage,
+                         const bool printOutput) {
+    const GeometryProfile& geometry = Geometry();
+    const ProbeConfig& config = GetProbeConfig();
+
+    Node* currentNode = setStartNode;
     uint64_t time = 0;
 
     // To deal with weird occasional timing results, repeat until we get a
     // number in a believable range.
     uint64_t attempt = 0;
 
-    while (time < 20 || time > 200) {
+    while (time < geometry.probeCyclesMin || time > geometry.probeCyclesMax) {
         // First iterate over the linked list many times to make sure any old
         // values not in the linked list are evicted from the LLC banks.
-        const uint64_t iterations = 100 * WAYS_PER_BANK * LLC_BANKS;
-        for (uint64_t i = 0; i < iterations; ++i) {
-            currentNode = currentNode->next;
-        }
-        _mm_lfence();
-
+        //
         // Then read the candidate to insert it into the LLC.
-        dummy1 = *candidate;
-        _mm_lfence();
-
+        //
         // Once again iterate over the linked list many times to make sure that
         // the linked list's nodes evict the candidate (if there are
-        // WAYS_PER_BANK nodes in the bank which contains the candidate).
+        // waysPerBank nodes in the bank which contains the candidate).
         //
         // Note: I tried iterating over the list forwards and backwards, but it
         // did not provide any better results and actually greatly increased
         // total runtime (maybe due to context switching between the separate
         // iterations? I'm not sure).
-        for (uint64_t i = 0; i < iterations; ++i) {
-            currentNode = currentNode->next;
+        //
+        // Finally measure the time to reread the candidate to determine
+        // whether it is still cached (in the LLC or lower, or in the helper
+        // core's L2 for a cross-core probe).
+        ++probeCount;
+        if (config.strategy == ProbeStrategy::CROSS_CORE) {
+            time = CrossCoreProbe(&currentNode, candidate, iterations);
+        } else if (config.timer == TimerSource::COUNTING_THREAD) {
+            time = TicksToCycles(CountedProbeKernel(
+                &currentNode, candidate, iterations, TimerCounter()));
+        } else {
+            time = ProbeKernel(&currentNode, candidate, iterations);
         }
 
-        // Measure the time to reread the candidate to determine whether it is
-        // still cached (in the LLC or lower).
-        _mm_lfence();
-        time = __rdtsc();
-
-        dummy2 = *candidate;
-
-        _mm_lfence();
-        time = __rdtsc() - time;
-
         if (printOutput) {
             if (attempt > 0) {
                 std::cout << std::endl;
@@ -306,44 +670,260 @@ bool Probe(register Node* setStartNode, const Node* candidate,
             std::cout << "Attempt: " << attempt++ << ", time: " << time;
         }
 
-        // Need to use the dummy and index variables in order to not be
-        // optimized out by the compiler.
-        garbage += dummy1.padding[0] + dummy2.padding[0] +
-            currentNode->padding[0];
+        garbage += currentNode->padding[0];
+    }
+
+    return time > geometry.llcCycleThreshold;
+}
+
+bool Probe(Node* setStartNode, const Node* candidate, uint64_t& garbage,
+           const bool printOutput) {
+    const uint64_t iterations =
+        100 * Geometry().waysPerBank * Geometry().llcBanks;
+    return ProbeWithIterations(setStartNode, candidate, iterations, garbage,
+                               printOutput);
+}
+
+// Returns true if the majority of GROUP_TEST_PROBES probes finds that the
+// "size" nodes of the list at "head" evict "victim".
+bool Evicts(Node* head, uint64_t size, const Node* victim, uint64_t& garbage) {
+    const uint64_t iterations = std::max(
+        100 * Geometry().waysPerBank * Geometry().llcBanks,
+        GROUP_TEST_PASSES * size);
+
+    uint64_t misses = 0;
+    for (uint64_t i = 0; i < GROUP_TEST_PROBES; ++i) {
+        misses += ProbeWithIterations(head, victim, iterations, garbage,
+                                      /*printOutput=*/false);
+    }
+    return 2 * misses > GROUP_TEST_PROBES;
+}
+
+// Reduces "lines", which evict "victim", to waysPerBank lines which still do,
+// by group testing:
+//   P. Vila, B. Kopf and J. F. Morales,
+//   "Theory and Practice of Finding Eviction Sets,"
+//   2019 IEEE Symposium on Security and Privacy, pp. 39-54.
+// Split the lines into waysPerBank + 1 groups. At least one group holds no
+// line of the victim's minimal eviction set, so dropping it keeps the rest
+// evicting. Returns an empty vector if no group can be dropped (e.g., after a
+// noisy probe).
+std::vector<Node*> ReduceByGroupTesting(std::vector<Node*> lines,
+                                        const Node* victim,
+                                        uint64_t& garbage) {
+    const uint64_t ways = Geometry().waysPerBank;
+    const uint64_t groups = ways + 1;
+
+    std::vector<Node*> rest;
+    rest.reserve(lines.size());
+    while (lines.size() > ways) {
+        bool reduced = false;
+        for (uint64_t g = 0; g < groups && !reduced; ++g) {
+            const uint64_t begin = lines.size() * g / groups;
+            const uint64_t end = lines.size() * (g + 1) / groups;
+
+            rest.assign(lines.begin(), lines.begin() + begin);
+            rest.insert(rest.end(), lines.begin() + end, lines.end());
+
+            if (Evicts(LinkCandidates(rest), rest.size(), victim, garbage)) {
+                lines.swap(rest);
+                reduced = true;
+            }
+        }
+        if (!reduced) {
+            return {};
+        }
+    }
+    return lines;
+}
+
+// Eviction set construction from candidates which only share the page offset
+// bits of the set index (ProbeConfig::smallPages). The candidates then spread
+// over every set index with those bits, so there is no single conflict set to
+// split. Instead, each eviction set is reduced by group testing from all
+// unused candidates, for a victim which no earlier set evicts.
+//
+// Each set covers a distinct (bank, set index) pair. Which bank a set is in
+// cannot be told from virtual addresses, so a set is only kept if its latency
+// signature from the cores sharing the LLC differs from every earlier set's.
+// With fewer than two such cores free of probing, banks cannot be told apart
+// and sets may share a bank.
+//
+// Returns fewer than llcBanks sets (and reports it) if the candidates run out
+// first.
+std::vector<Node*> GetEvictionSetsByGroupTesting(
+    const std::vector<Node*>& candidates, uint64_t& garbage) {
+    const GeometryProfile& geometry = Geometry();
+    const ProbeConfig& config = GetProbeConfig();
+
+    // The helper and the counting timers keep their cores busy.
+    std::vector<int> signatureCores;
+    const std::vector<int> claimed = ClaimedCores();
+    for (int core : LlcSharingCores(sched_getcpu())) {
+        if (core == sched_getcpu() ||
+            (core != config.helperCoreID &&
+             std::find(claimed.begin(), claimed.end(), core) ==
+             claimed.end())) {
+            signatureCores.push_back(core);
+        }
+    }
+    const bool distinctBanks = signatureCores.size() >= 2;
+    if (!distinctBanks) {
+        std::cout << "Warning: no second core to tell banks apart, eviction "
+                  << "sets may share a bank" << std::endl;
+    }
+    std::vector<std::vector<double>> signatures;
+    // Sets in a bank already covered. Their lines are not reused, so the lists
+    // stay intact for skipping the victims they evict.
+    std::vector<Node*> rejectedHeads;
+
+    // Visit victims in a random order which does not follow the address.
+    std::vector<Node*> pool(candidates);
+    ShuffleNodes(pool, constructionSeed);
+
+    std::vector<Node*> evictionSetHeads;
+    CandidateBitmap used(candidates);
+    std::vector<Node*> lines;
+    lines.reserve(pool.size());
+
+    for (Node* victim : pool) {
+        if (evictionSetHeads.size() == geometry.llcBanks) {
+            break;
+        }
+        if (used.Contains(victim)) {
+            continue;
+        }
+
+        // Skip victims in a (bank, set index) pair we already have.
+        bool covered = false;
+        for (const std::vector<Node*>* heads :
+             {&evictionSetHeads, &rejectedHeads}) {
+            for (Node* head : *heads) {
+                covered = covered ||
+                    Evicts(head, geometry.waysPerBank, victim, garbage);
+            }
+        }
+        if (covered) {
+            continue;
+        }
+
+        lines.clear();
+        for (Node* node : pool) {
+            if (node != victim && !used.Contains(node)) {
+                lines.push_back(node);
+            }
+        }
+        if (!Evicts(LinkCandidates(lines), lines.size(), victim, garbage)) {
+            continue;
+        }
+
+        const std::vector<Node*> evictionSet =
+            ReduceByGroupTesting(lines, victim, garbage);
+        if (evictionSet.empty()) {
+            continue;
+        }
+
+        for (Node* node : evictionSet) {
+            used.Insert(node);
+        }
+        used.Insert(victim);
+
+        Node* head = LinkCandidates(evictionSet);
+        if (distinctBanks) {
+            const std::vector<double> signature = BankLatencySignature(
+                head, signatureCores, garbage, GROUP_TEST_SIGNATURE_ACCESSES);
+            const double noise = SignatureDistance(
+                signature,
+                BankLatencySignature(head, signatureCores, garbage,
+                                     GROUP_TEST_SIGNATURE_ACCESSES));
+            bool sameBank = false;
+            for (const std::vector<double>& other : signatures) {
+                sameBank = sameBank || SignatureDistance(signature, other) <=
+                    GROUP_TEST_SAME_BANK_NOISE * noise;
+            }
+            if (sameBank) {
+                std::cout << "Skipping eviction set in a bank already covered"
+                          << std::endl;
+                rejectedHeads.push_back(head);
+                continue;
+            }
+            signatures.push_back(signature);
+        }
+        evictionSetHeads.push_back(head);
+
+        std::cout << "Found eviction set: " << evictionSetHeads.size()
+                  << std::endl;
+    }
+
+    if (evictionSetHeads.size() < geometry.llcBanks) {
+        std::cout << "Candidates ran out after " << evictionSetHeads.size()
+                  << " of " << geometry.llcBanks << " eviction sets"
+                  << std::endl;
     }
 
-    return time > LLC_CYCLE_THRESHOLD;
+    return evictionSetHeads;
 }
 
 std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
-    srand(0);
+    const GeometryProfile& geometry = Geometry();
+
+    // Allocate our full buffer which is at least twice the size of the LLC,
+    // on huge pages. It is aligned on a huge page, so each node occupies a
+    // distinct and full cache line.
     assert(*array == nullptr);
+    *array = AllocateCandidateArray(geometry.arraySize);
+
+    const std::vector<Node*> evictionSetHeads =
+        GetEvictionSetInArray(*array, setIndex);
+    assert(!evictionSetHeads.empty());
+    return evictionSetHeads;
+}
+
+std::vector<Node*> GetEvictionSetInArray(Node* array, const uint64_t setIndex) {
+    const GeometryProfile& geometry = Geometry();
 
     // Ensure that each node occupies exactly one cache line.
     assert(sizeof(Node) == CACHE_LINE_SIZE);
 
     // Ensure that a valid set index is provided.
-    assert(setIndex < SETS_PER_BANK);
+    assert(setIndex < geometry.setsPerBank);
+
+    // Configure probing for this machine, unless the caller did.
+    const ProbeConfig& config = GetProbeConfig();
+
+    // Disable the prefetchers of the probing cores, if requested.
+    ApplyPrefetcherMode({sched_getcpu(), config.helperCoreID});
 
     // Only needed to prevent compiler optimizations.
     uint64_t garbage = 0;
 
-    // Allocate our full buffer which is at least twice the size of the LLC.
-    // Need to use the heap to be mapped into huge pages.
-    // Array needs to be aligned on a cache line so that each node occupies a
-    // distinct and full cache line.
-    assert(*array == nullptr);
-    *array = static_cast<Node*>(aligned_alloc(CACHE_LINE_SIZE, ARRAY_SIZE));
-
     // Determine the nodes in the array (on a cache line boundary) whose
     // addresses indicate they map into a given set of an LLC bank.
     // This set is called "lines" in Algorithm 1 in the paper mentioned above.
-    std::set<Node*> candidates;
-    FindCandidates(*array, candidates, setIndex);
-    std::cout << "Number of candidates: " << candidates.size() << std::endl;
+    const std::vector<Node*> candidates = FindCandidates(array, setIndex);
+    std::cout << "Number of candidates: " << candidates.size()
+              << ", construction seed: " << constructionSeed.load()
+              << std::endl;
+    std::cout << "Prefetchers: " << PrefetcherStateDescription() << std::endl;
 
     // Make sure we have enough candidates.
-    assert(candidates.size() >= 2 * LLC_BANKS * WAYS_PER_BANK);
+    assert(candidates.size() >= 2 * geometry.ConflictSetSize());
+
+    if (config.smallPages) {
+        const std::vector<Node*> evictionSetHeads =
+            GetEvictionSetsByGroupTesting(candidates, garbage);
+        StopProbeHelper();
+        if (evictionSetHeads.size() < geometry.llcBanks) {
+            return {};
+        }
+
+        // The candidates span many set indices, so only the final sets can be
+        // sanity checked.
+        SanityCheckEvictionSets(evictionSetHeads, garbage);
+        std::cout << "(Garbage: " << garbage << ")" << std::endl;
+
+        return evictionSetHeads;
+    }
 
     // for (auto it = candidates.begin(); it != candidates.end(); ++it) {
     //     std::cout << *it << " " << std::bitset<8*sizeof(int*)>
@@ -352,21 +932,19 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
 
     // Need to create a randomized linked list among the "candidates" in "array"
     // so that accessing nodes in order does not trigger prefetching.
-    RandomizeLinkedList(candidates);
-
-    // Verify there is a linked list through all of the "candidates" in "array".
-    uint64_t count = SizeOfLinkedList(*candidates.begin());
-    assert(count == candidates.size());
-    std::cout << "Entries in linked list: " << count << std::endl;
+    std::vector<Node*> candidateOrder(candidates);
+    RandomizeLinkedList(candidateOrder);
+    std::cout << "Entries in linked list: " << candidateOrder.size()
+              << std::endl;
 
     // Sanity check that the candidates are all in the same cache set. An
     // empirical method is iterating through all candidates and ensuring that
     // they do miss in the LLC.
-    SanityCheckCandidates(*candidates.begin(), garbage);
+    SanityCheckCandidates(candidateOrder.front(), garbage);
 
     // Determine a conflict set from the candidates in "array". A conflict set
-    // contains LLC_BANKS * WAYS_PER_BANK nodes which consists of LLC_BANKS
-    // groups of nodes (each of size WAYS_PER_BANK), each of which maps to a
+    // contains llcBanks * waysPerBank nodes which consists of llcBanks
+    // groups of nodes (each of size waysPerBank), each of which maps to a
     // distinct LLC bank.
     //
     // We will later separate the conflict set into disjoint eviction sets which
@@ -381,13 +959,13 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
     // any node in each of the disjoint lists.)
     Node *candidateSetHead, *conflictSetHead;
 
-    // Arbitrarily pick the first WAYS_PER_BANK candidates to move to the
-    // conflict set because you need at least WAYS_PER_BANK + 1 nodes in order
+    // Arbitrarily pick the first waysPerBank candidates to move to the
+    // conflict set because you need at least waysPerBank + 1 nodes in order
     // to overfill a set in a single LLC bank.
-    conflictSetHead = *candidates.begin();
+    conflictSetHead = candidateOrder.front();
 
     candidateSetHead = conflictSetHead;
-    for (uint64_t i = 0; i < WAYS_PER_BANK; ++i) {
+    for (uint64_t i = 0; i < geometry.waysPerBank; ++i) {
         candidateSetHead = candidateSetHead->next;
     }
 
@@ -399,17 +977,13 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
     conflictSetHead->prev = conflictSetTail;
     conflictSetTail->next = conflictSetHead;
 
-    // Verification that the conflict set is the correct size.
-    count = SizeOfLinkedList(conflictSetHead);
-    assert(count == WAYS_PER_BANK);
-
-    // Verification that the candidate set is the correct size.
-    count = SizeOfLinkedList(candidateSetHead);
-    assert(count == candidates.size() - WAYS_PER_BANK);
+    // Sizes of the two lists, kept up to date as nodes move instead of
+    // walking the lists.
+    uint64_t count = geometry.waysPerBank;
+    uint64_t candidateCount = candidates.size() - geometry.waysPerBank;
 
     // Probe every candidate to determine whether to add them to the conflict
     // set.
-    count = WAYS_PER_BANK;
     Node* candidate = candidateSetHead;
 
     // Call Probe() a few times to warmup the caches.
@@ -419,11 +993,12 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
     }
 
     // Now perform the true probes until we fill the conflict set.
-    while (count < CONFLICT_SET_SIZE) {
+    while (count < geometry.ConflictSetSize()) {
         const bool missToDRAM =
             Probe(conflictSetHead, candidate, garbage, /*printOutput=*/false);
         if (!missToDRAM) {
             ++count;
+            --candidateCount;
             // std::cout << ", Added to set: " << candidate << ", size: "
             //           << count << std::endl;
 
@@ -453,20 +1028,16 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
         }
     }
 
-    // Verify the size of the conflict set.
-    count = SizeOfLinkedList(conflictSetHead);
     std::cout << "Conflict set size: " << count << ", should be "
-              << CONFLICT_SET_SIZE << std::endl;
-    assert(count == CONFLICT_SET_SIZE);
+              << geometry.ConflictSetSize() << std::endl;
+    assert(count == geometry.ConflictSetSize());
 
     // Verify that accessing nodes in the conflict set always hits in the LLC.
     SanityCheckConflictSet(conflictSetHead, garbage);
 
-    // Verify the size of the candidate set.
-    count = SizeOfLinkedList(candidateSetHead);
-    std::cout << "Remaining candidate set size: " << count << ", should be "
-              << candidates.size() - CONFLICT_SET_SIZE << std::endl;
-    assert(count == candidates.size() - CONFLICT_SET_SIZE);
+    std::cout << "Remaining candidate set size: " << candidateCount
+              << std::endl;
+    assert(candidateCount == candidates.size() - geometry.ConflictSetSize());
 
 
     // Now we need to separate the conflict set into separate eviction sets for
@@ -476,6 +1047,11 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
     // This will contain a node pointer into each of the final eviction sets.
     std::vector<Node*> evictionSetHeads;
 
+    // Members of the eviction set being split off, reused for every bank.
+    std::vector<Node*> evictionSet;
+    evictionSet.reserve(geometry.waysPerBank);
+    CandidateBitmap inEvictionSet(candidates);
+
     // Pick an arbitrary candidate.
     candidate = candidateSetHead;
 
@@ -495,7 +1071,7 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
     // Once we have determined all the eviction sets except the last one, all
     // the remaining nodes in the conflict set are implicitly the final eviction
     // set.
-    while(evictionSetHeads.size() < LLC_BANKS - 1) {
+    while(evictionSetHeads.size() < geometry.llcBanks - 1) {
         // First find a node which was not inserted into the conflict set
         // (i.e., still in the candidate set) which maps to the same cache set
         // as nodes still in the conflict set. We do this by probing candidate
@@ -558,20 +1134,21 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
         // nodes one at a time from the conflict set and retry the probe. If the
         // probe does not miss to DRAM, then we know that the test node maps to
         // the same set as the candidate. Keep probing test nodes from the
-        // conflict set until we find all WAYS_PER_BANK conflict set nodes which
+        // conflict set until we find all waysPerBank conflict set nodes which
         // map to the same set as the candidate node. This forms an eviction
         // set. Although we cannot tell which specific bank this eviction set
         // maps to, we do know all the nodes in the set do map to the same bank.
-        std::set<Node*> evictionSet;
+        evictionSet.clear();
+        inEvictionSet.Clear();
 
         // Start by testing the conflict set head.
         Node* testNode = conflictSetHead;
 
-        while (evictionSet.size() < WAYS_PER_BANK) {
+        while (evictionSet.size() < geometry.waysPerBank) {
             // Go to the next node if the test node has already been added to
             // the eviction set (this can happen if we loop around the entire
             // conflict set without finding the full eviction set yet).
-            if (evictionSet.find(testNode) != evictionSet.end()) {
+            if (inEvictionSet.Contains(testNode)) {
                 // Test the next conflict set node.
                 testNode = testNode->next;
                 continue;
@@ -594,7 +1171,8 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
 
             if (!missToDRAM) {
                 // Add the node to the eviction set.
-                evictionSet.insert(testNode);
+                evictionSet.push_back(testNode);
+                inEvictionSet.Insert(testNode);
                 // std::cout << "Eviction set " << evictionSetHeads.size() + 1
                 //           << " size: " << evictionSet.size() << std::endl;
             }
@@ -605,7 +1183,7 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
 
         // We have found an entire eviction set. Move the nodes out of the
         // conflict set and connect them into their own linked list.
-        Node* evictionSetHead = *evictionSet.begin();
+        Node* evictionSetHead = evictionSet.front();
         if (evictionSetHead == conflictSetHead) {
             conflictSetHead = conflictSetHead->next;
         }
@@ -615,10 +1193,10 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
         evictionSetHead->next = evictionSetHead;
         evictionSetHead->prev = evictionSetHead;
 
-        for (auto it = ++evictionSet.begin(); it != evictionSet.end(); ++it) {
+        for (uint64_t i = 1; i < evictionSet.size(); ++i) {
             // Remove the node from the conflict set and add it to the back of
             // the eviction set.
-            Node* node = *it;
+            Node* node = evictionSet[i];
 
             if (node == conflictSetHead) {
                 conflictSetHead = conflictSetHead->next;
@@ -651,6 +1229,9 @@ std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex) {
     std::cout << "Remaining nodes form eviction set: "
               << evictionSetHeads.size() << std::endl;
 
+    // Release the helper core, if probing used one.
+    StopProbeHelper();
+
     // Perform sanity checks on the eviction sets.
     SanityCheckEvictionSets(evictionSetHeads, garbage);
 
@@ -4,4 +4,156 @@
 
 #include "constants.h"
 
+uint64_t SizeOfLinkedList(const Node* node);
+
+// Returns the lines of "array" (Geometry().arraySize bytes) whose addresses
+// map to "setIndex", in address order. They are CandidateStride() lines apart,
+// except across regions skipped for lack of a huge page.
+std::vector<Node*> FindCandidates(Node* array, uint64_t setIndex);
+uint64_t CandidateStride();
+
+// Caches private to each core, which the LLC eviction sets do not control.
+enum class PrivateCache { L1, L2 };
+
+// Returns lines of "array" which evict the lines of LLC set index "setIndex"
+// from the "level" cache of the core which loads them, in random order: twice
+// as many lines as the level has ways, in the level's set of "setIndex" but at
+// another LLC set index, so that they take no ways of "setIndex" in the LLC.
+// The L1 lines are also in another L2 set. Skips the lines in "exclude" (e.g.,
+// the eviction sets in "array").
+//
+// With small pages, the level's set index bits above the page offset are
+// unknown, so the lines cover every set they could select, and may be at any
+// LLC set index of their page offset.
+std::vector<Node*> FindPrivateEvictionSet(Node* array, uint64_t setIndex,
+                                          PrivateCache level,
+                                          const std::vector<Node*>& exclude);
+
+// Membership of candidates of one set index, one bit per CandidateStride()
+// slot from the first candidate. Avoids the allocations (and the cache lines)
+// of a tree set between timed probes.
+struct CandidateBitmap {
+    const Node* first;
+    uint64_t stride;
+    std::vector<uint64_t> words;
+
+    explicit CandidateBitmap(const std::vector<Node*>& candidates);
+    bool Contains(const Node* node) const;
+    void Insert(const Node* node);
+    void Clear();
+};
+
+// Small, fast generator (SplitMix64) with a fixed definition, so that a seed
+// gives the same candidate order with any standard library.
+struct SplitMix64 {
+    uint64_t state;
+
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+    uint64_t Next();
+    // Uniform in [0, bound).
+    uint64_t Below(uint64_t bound);
+};
+
+// Fisher-Yates shuffle of "nodes" with SplitMix64(seed).
+void ShuffleNodes(std::vector<Node*>& nodes, uint64_t seed);
+
+// Links "nodes" into a closed list in the given order and returns its head.
+Node* LinkCandidates(const std::vector<Node*>& nodes);
+
+// Seed of the candidate orders of every later construction (default 0). Each
+// construction prints it, so that a run can be replayed.
+void SetConstructionSeed(uint64_t seed);
+uint64_t ConstructionSeed();
+
+// Probe sequences timed so far in this process, including retries of
+// implausible times. For benchmarking construction.
+uint64_t ProbeCount();
+
+// How Probe() places the candidate in the cache hierarchy.
+enum class ProbeStrategy {
+    // The attacker core loads the candidate itself. Only valid on an inclusive
+    // LLC, where evicting the candidate from its LLC set also evicts it from
+    // the attacker's L1 and L2.
+    INCLUSIVE,
+    // A helper core loads the candidate, which then sits in the helper's L2
+    // and is tracked by the snoop filter. The attacker's traversal conflicts
+    // with it in the LLC and snoop filter set of its slice, and the snoop
+    // filter eviction back-invalidates the helper's copy. Works on
+    // non-inclusive LLCs (Skylake-SP and later), where the attacker's own
+    // copy would survive in its L2.
+    CROSS_CORE,
+};
+
+// Timer for every timed access of the construction (see MeasureChase()).
+enum class TimerSource {
+    TSC,
+    // A thread on another core counts in a loop (see StartCountingTimer()).
+    // For VMs where rdtsc is virtualized or too noisy.
+    COUNTING_THREAD,
+};
+
+struct ProbeConfig {
+    ProbeStrategy strategy = ProbeStrategy::INCLUSIVE;
+    // Core which loads candidates for ProbeStrategy::CROSS_CORE. Must share
+    // the LLC with the core calling Probe().
+    int helperCoreID = -1;
+
+    TimerSource timer = TimerSource::TSC;
+    // Core which runs the counting thread for TimerSource::COUNTING_THREAD.
+    int timerCoreID = -1;
+
+    // Candidates are only known to share the set index bits inside a 4 KiB
+    // page offset (e.g., guest memory, which is not contiguous on the host
+    // even in huge pages). Eviction sets are then reduced from all candidates
+    // by group testing instead of split from a conflict set.
+    bool smallPages = false;
+};
+
+// Probing is configured per thread: each thread has its own configuration,
+// helper thread and counting timer, which stop when it exits. Constructions on
+// different LLCs (e.g., one thread per socket) may run at the same time; ones
+// on the same LLC would disturb each other's timing and must not.
+
+// Selects the probing configuration used by every later Probe() of the calling
+// thread. Stops the helper thread and counting timer of its previous
+// configuration.
+void SetProbeConfig(const ProbeConfig& config);
+// The calling thread's configuration. A thread which did not call
+// SetProbeConfig() gets DetectProbeConfig() for the core it runs on at first
+// use, so pin threads before they probe.
+const ProbeConfig& GetProbeConfig();
+
+// The configuration for the calling thread's core, which construction uses
+// unless SetProbeConfig() was called: ProbeStrategy::CROSS_CORE with a helper
+// core on the same LLC on non-inclusive geometry profiles, and under a
+// hypervisor (CPUID) small pages, plus the counting timer if rdtsc cannot tell
+// an L1 hit from a DRAM access. The timer core is one no other configured
+// thread uses.
+ProbeConfig DetectProbeConfig();
+
+// Timed chase and load with the calling thread's timer, in TSC cycles. Threads
+// which only measure, without a configuration, get a counting timer of their
+// own wherever DetectProbeConfig() would choose one.
+uint64_t MeasureChase(Node** node, uint64_t accesses);
+uint64_t MeasureLoad(const void* line);
+
+// Stops the calling thread's cross-core helper thread, if running. Probe()
+// restarts it on demand.
+void StopProbeHelper();
+
+// Returns true if iterating over the linked list starting at "setStartNode"
+// evicts "candidate" from the LLC.
+bool Probe(Node* setStartNode, const Node* candidate, uint64_t& garbage,
+           const bool printOutput);
+
+// Allocates "*array" (Geometry().arraySize bytes on huge pages, free with
+// FreeCandidateArray()) and returns one eviction set per LLC bank for the given
+// set index. All sizes and timing bounds come from the active geometry profile.
 std::vector<Node*> GetEvictionSet(Node** array, const uint64_t setIndex);
+
+// Same as GetEvictionSet(), but builds the sets inside a caller-provided array
+// of Geometry().arraySize bytes. The array must be backed by huge pages, or
+// come from AllocateCandidateArray(). Returns no sets if group testing
+// (ProbeConfig::smallPages) runs out of candidates; GetEvictionSet() asserts
+// instead.
+std::vector<Node*> GetEvictionSetInArray(Node* array, const uint64_t setIndex);
@@ -0,0 +1,397 @@
+// Benchmark of eviction set construction. Builds the sets for every
+// combination of probe strategy, set index and seed, optionally while noise
+// threads thrash the LLC, and reports per strategy:
+// - the fraction of builds which completed and passed revalidation,
+// - the fraction which matched the ground-truth oracle, where there is one
+//   (small-page builds only, see CheckAgainstOracle()),
+// - the distribution of construction time and of probe counts.
+//
+// Every build runs in a forked child, so a failed assertion inside the
+// construction counts as a failed build instead of ending the benchmark.
+//
+// With --min-pass-rate and --max-median-ms the exit status fails if a strategy
+// falls below the pass rate or takes longer, for use as a regression gate.
+//
+// $ taskset -c 0,1,2,3 ./constructionBenchmark --seeds 10
+//       --set-indices 0,1000,2047 --strategies inclusive,small-pages
+//       --noise-threads 2
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "evictionSetBuilder.h"
+#include "geometryProfile.h"
+#include "hugePages.h"
+#include "measurementKernels.h"
+#include "prefetcherControl.h"
+#include "toolUtils.h"
+
+const uint64_t DEFAULT_SEEDS = 5;
+
+// Written by the child of one build through a pipe.
+struct TrialResult {
+    bool built;
+    bool valid;
+    // 1 if the sets match the oracle, 0 if not, -1 if there is no oracle.
+    int oracle;
+    double milliseconds;
+    uint64_t probes;
+};
+
+// Probe strategies by name (--strategies). Each is a variation of the
+// detected configuration.
+struct Strategy {
+    std::string name;
+    ProbeConfig config;
+};
+
+struct BenchmarkOptions {
+    uint64_t seeds = DEFAULT_SEEDS;
+    std::vector<uint64_t> setIndices = {0};
+    std::vector<std::string> strategies = {"detected"};
+    uint64_t noiseThreads = 0;
+    // Per noise thread. 0: the LLC size.
+    uint64_t noiseBytes = 0;
+    double minPassRate = 0;
+    double maxMedianMs = 0;
+    bool verbose = false;
+};
+
+// Returns false if "name" is unknown or cannot run on this machine.
+bool MakeStrategy(const std::string& name, const ProbeConfig& detected,
+                  Strategy* strategy) {
+    strategy->name = name;
+    strategy->config = detected;
+
+    if (name == "detected") {
+        return true;
+    }
+    if (name == "inclusive") {
+        strategy->config.strategy = ProbeStrategy::INCLUSIVE;
+        strategy->config.smallPages = false;
+        return true;
+    }
+    if (name == "cross-core") {
+        strategy->config.strategy = ProbeStrategy::CROSS_CORE;
+        strategy->config.smallPages = false;
+        if (strategy->config.helperCoreID < 0) {
+            strategy->config.helperCoreID = LlcSharingCore(sched_getcpu());
+        }
+        return strategy->config.helperCoreID >= 0;
+    }
+    if (name == "small-pages") {
+        strategy->config.smallPages = true;
+        return true;
+    }
+    return false;
+}
+
+// Streams over its own buffer (read and write, one access per line) until
+// stopped, to keep the LLC busy during construction.
+void RunNoiseThread(int coreID, uint64_t bytes, const std::atomic<bool>* stop) {
+    PinToCore(coreID);
+
+    std::vector<Node> buffer(bytes / sizeof(Node));
+    while (!stop->load(std::memory_order_relaxed)) {
+        for (Node& node : buffer) {
+            ++node.padding[0];
+        }
+    }
+}
+
+// Ground truth from physical addresses: every member of a set built from small
+// pages must have the same physical set index. The slice itself cannot be
+// checked this way, since Intel's slice hash is undocumented. Huge-page builds
+// have no oracle: their candidates all sit at the requested set index by
+// construction, so the check could not fail. Neither is there one without
+// readable frame numbers (CAP_SYS_ADMIN), or under a hypervisor, whose guest
+// frames are not host frames.
+int CheckAgainstOracle(const EvictionSetGroup& group, bool smallPages) {
+    if (!smallPages || RunningUnderHypervisor()) {
+        return -1;
+    }
+
+    const GeometryProfile& geometry = group.Profile();
+    for (uint64_t bank = 0; bank < group.Banks(); ++bank) {
+        const std::vector<Node*> members = group.Members(bank);
+        const std::vector<uint64_t> frames = ReadFrames(members);
+
+        uint64_t setIndex = geometry.setsPerBank;
+        for (uint64_t i = 0; i < members.size(); ++i) {
+            if (frames[i] == 0) {
+                return -1;
+            }
+            const uint64_t physical = frames[i] * SMALL_PAGE_SIZE +
+                reinterpret_cast<uintptr_t>(members[i]) % SMALL_PAGE_SIZE;
+            const uint64_t memberSetIndex =
+                (physical & geometry.SetIndexMask()) >> NUM_CACHE_LINE_BITS;
+            if (setIndex == geometry.setsPerBank) {
+                setIndex = memberSetIndex;
+            }
+            if (memberSetIndex != setIndex) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Runs in the child: builds, revalidates and checks the sets, and writes the
+// result to "fd".
+void RunTrial(const Strategy& strategy, uint64_t setIndex, uint64_t seed,
+              int fd) {
+    EvictionSetBuilder builder;
+    builder.probeConfig = strategy.config;
+    builder.seed = seed;
+
+    TrialResult result = {};
+    const uint64_t startProbes = ProbeCount();
+    const auto start = std::chrono::steady_clock::now();
+    const EvictionSetGroup group = builder.Build(setIndex);
+    const auto end = std::chrono::steady_clock::now();
+
+    result.built = true;
+    result.milliseconds =
+        std::chrono::duration<double, std::milli>(end - start).count();
+    result.probes = ProbeCount() - startProbes;
+
+    uint64_t garbage = 0;
+    result.valid = group.Validate(garbage);
+    result.oracle = CheckAgainstOracle(group, strategy.config.smallPages);
+    std::cout << "(Garbage: " << garbage << ")" << std::endl;
+
+    const ssize_t written = write(fd, &result, sizeof(result));
+    // _exit() skips the exit handlers. This only restores prefetchers which
+    // the trial itself disabled; those of the parent are left alone.
+    RestorePrefetchers();
+    _exit(written == sizeof(result) ? 0 : 1);
+}
+
+TrialResult ForkTrial(const Strategy& strategy, uint64_t setIndex,
+                      uint64_t seed, bool verbose) {
+    int fds[2];
+    int result = pipe(fds);
+    assert(result == 0);
+
+    const pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        close(fds[0]);
+        if (!verbose) {
+            const int devNull = open("/dev/null", O_WRONLY);
+            dup2(devNull, STDOUT_FILENO);
+        }
+        RunTrial(strategy, setIndex, seed, fds[1]);
+    }
+
+    close(fds[1]);
+    TrialResult trial = {};
+    if (read(fds[0], &trial, sizeof(trial)) != sizeof(trial)) {
+        trial = {};
+    }
+    close(fds[0]);
+    waitpid(pid, nullptr, 0);
+
+    return trial;
+}
+
+// Returns the "percentile" (0-100) of "samples".
+double Percentile(std::vector<double> samples, uint64_t percentile) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[(samples.size() - 1) * percentile / 100];
+}
+
+// Prints one line for the strategy. Returns false if it misses the gates.
+bool Report(const std::string& name, const std::vector<TrialResult>& trials,
+            const BenchmarkOptions& options) {
+    uint64_t passed = 0;
+    uint64_t checked = 0;
+    uint64_t correct = 0;
+    std::vector<double> times;
+    std::vector<double> probes;
+    for (const TrialResult& trial : trials) {
+        if (!trial.built) {
+            continue;
+        }
+        passed += trial.valid;
+        checked += trial.oracle >= 0;
+        correct += trial.oracle == 1;
+        times.push_back(trial.milliseconds);
+        probes.push_back(trial.probes);
+    }
+
+    const double passRate = static_cast<double>(passed) / trials.size();
+    const double medianMs = Percentile(times, 50);
+
+    std::stringstream oracle;
+    if (checked == 0) {
+        oracle << "n/a";
+    } else {
+        oracle << correct << "/" << checked;
+    }
+
+    std::cout << std::left << std::setw(13) << name << std::right
+              << std::setw(6) << trials.size() << std::setw(7) << times.size()
+              << std::setw(7) << passed << std::setw(9) << oracle.str()
+              << std::fixed << std::setprecision(1) << std::setw(10)
+              << Percentile(times, 0) << std::setw(10) << medianMs
+              << std::setw(10) << Percentile(times, 90) << std::setw(10)
+              << Percentile(times, 100) << std::setprecision(0)
+              << std::setw(10) << Percentile(probes, 50) << std::setw(10)
+              << Percentile(probes, 90) << std::endl;
+
+    bool ok = passRate >= options.minPassRate;
+    if (options.maxMedianMs > 0 && medianMs > options.maxMedianMs) {
+        ok = false;
+    }
+    return ok;
+}
+
+void PrintUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--seeds N]"
+              << " [--set-indices I,J,...]"
+              << " [--strategies detected,inclusive,cross-core,small-pages]"
+              << " [--noise-threads N] [--noise-bytes BYTES]"
+              << " [--min-pass-rate FRACTION] [--max-median-ms MS]"
+              << " [--verbose]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--verbose") {
+            options.verbose = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        if (arg == "--seeds") {
+            options.seeds = std::stoull(argv[++i]);
+        } else if (arg == "--set-indices") {
+            options.setIndices = ParseList(argv[++i]);
+        } else if (arg == "--strategies") {
+            options.strategies = SplitList(argv[++i]);
+        } else if (arg == "--noise-threads") {
+            options.noiseThreads = std::stoull(argv[++i]);
+        } else if (arg == "--noise-bytes") {
+            options.noiseBytes = std::stoull(argv[++i]);
+        } else if (arg == "--min-pass-rate") {
+            options.minPassRate = std::stod(argv[++i]);
+        } else if (arg == "--max-median-ms") {
+            options.maxMedianMs = std::stod(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    const GeometryProfile& geometry = Geometry();
+    for (uint64_t setIndex : options.setIndices) {
+        if (setIndex >= geometry.setsPerBank) {
+            std::cerr << "Set index " << setIndex << " out of range"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    SanityCheckMeasurementKernels();
+
+    // Keep construction on the core it started on, and the noise on allowed
+    // cores used by no strategy. Read the allowed cores before pinning.
+    const std::vector<int> allowedCores = AllowedCores();
+    const int coreID = sched_getcpu();
+    PinToCore(coreID);
+
+    const ProbeConfig detected = DetectProbeConfig();
+    std::vector<Strategy> strategies;
+    std::vector<int> reservedCores = {coreID};
+    for (const std::string& name : options.strategies) {
+        Strategy strategy;
+        if (!MakeStrategy(name, detected, &strategy)) {
+            std::cerr << "Unknown or unavailable strategy: " << name
+                      << std::endl;
+            return 1;
+        }
+        strategies.push_back(strategy);
+        reservedCores.push_back(strategy.config.helperCoreID);
+        reservedCores.push_back(strategy.config.timerCoreID);
+
+        // Disable the prefetchers here rather than in the trials: the
+        // children inherit the saved MSR values, and only this process
+        // restores them at exit.
+        ApplyPrefetcherMode({coreID, strategy.config.helperCoreID});
+    }
+
+    const uint64_t noiseBytes = options.noiseBytes != 0 ? options.noiseBytes :
+        geometry.ConflictSetSize() * geometry.setsPerBank * CACHE_LINE_SIZE;
+    std::atomic<bool> stopNoise{false};
+    std::vector<std::thread> noiseThreads;
+    std::vector<int> noiseCores;
+    for (int core : allowedCores) {
+        if (noiseCores.size() < options.noiseThreads &&
+            std::find(reservedCores.begin(), reservedCores.end(), core) ==
+            reservedCores.end()) {
+            noiseCores.push_back(core);
+        }
+    }
+    if (noiseCores.size() < options.noiseThreads) {
+        std::cerr << "No core left for noise thread " << noiseCores.size()
+                  << std::endl;
+        return 1;
+    }
+    for (int noiseCore : noiseCores) {
+        noiseThreads.push_back(std::thread(RunNoiseThread, noiseCore,
+                                           noiseBytes, &stopNoise));
+    }
+
+    std::cout << "Builds per strategy: "
+              << options.setIndices.size() * options.seeds << " ("
+              << options.setIndices.size() << " set indices x "
+              << options.seeds << " seeds), " << options.noiseThreads
+              << " noise threads of " << noiseBytes / KiB << " KiB"
+              << std::endl;
+    std::cout << "strategy     builds   done  valid   oracle"
+              << "    min ms    p50 ms    p90 ms    max ms"
+              << "  p50 prob  p90 prob" << std::endl;
+
+    bool ok = true;
+    for (const Strategy& strategy : strategies) {
+        std::vector<TrialResult> trials;
+        for (uint64_t setIndex : options.setIndices) {
+            for (uint64_t seed = 0; seed < options.seeds; ++seed) {
+                trials.push_back(ForkTrial(strategy, setIndex, seed,
+                                           options.verbose));
+            }
+        }
+        ok = Report(strategy.name, trials, options) && ok;
+    }
+
+    stopNoise = true;
+    for (std::thread& thread : noiseThreads) {
+        thread.join();
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "evictionSetBuilder.h"
+#include "geometryProfile.h"
+
+// First word of a serialized group, and its format version.
+const char* const SERIALIZED_GROUP_TAG = "evictionSetGroup";
+const uint64_t SERIALIZED_GROUP_VERSION = 1;
+
+// Accesses per validation traversal, as in the construction sanity checks.
+const uint64_t VALIDATION_ACCESSES_PER_LINE = 10000;
+
+CandidateArena::CandidateArena(const CandidateAllocator& allocator,
+                               uint64_t size)
+    : array(allocator.allocate(size)), size(size),
+      release(allocator.release) {
+    assert(array != nullptr);
+}
+
+CandidateArena CandidateArena::Borrow(Node* array, uint64_t size) {
+    CandidateArena arena;
+    arena.array = array;
+    arena.size = size;
+    return arena;
+}
+
+CandidateArena::CandidateArena(CandidateArena&& other) noexcept {
+    *this = std::move(other);
+}
+
+CandidateArena& CandidateArena::operator=(CandidateArena&& other) noexcept {
+    if (this != &other) {
+        if (release != nullptr) {
+            release(array);
+        }
+        array = std::exchange(other.array, nullptr);
+        size = std::exchange(other.size, 0);
+        release = std::exchange(other.release, nullptr);
+    }
+    return *this;
+}
+
+CandidateArena::~CandidateArena() {
+    if (release != nullptr) {
+        release(array);
+    }
+}
+
+EvictionSetGroup::EvictionSetGroup(CandidateArena arena,
+                                   const GeometryProfile& geometry,
+                                   uint64_t setIndex, std::vector<Node*> heads)
+    : arena(std::move(arena)), geometry(geometry), setIndex(setIndex),
+      heads(std::move(heads)) {}
+
+Node* EvictionSetGroup::Head(uint64_t bank) const {
+    assert(bank < heads.size());
+    return heads[bank];
+}
+
+std::vector<Node*> EvictionSetGroup::Members(uint64_t bank) const {
+    // Bounded by the arena, in case a list was corrupted and no longer closes.
+    const uint64_t maxMembers = arena.Size() / sizeof(Node);
+
+    std::vector<Node*> members;
+    members.reserve(geometry.waysPerBank);
+    Node* node = Head(bank);
+    do {
+        members.push_back(node);
+        node = node->next;
+    } while (node != heads[bank] && members.size() < maxMembers);
+    return members;
+}
+
+std::vector<Node*> EvictionSetGroup::PrivateMembers(PrivateCache level) const {
+    std::vector<Node*> exclude;
+    for (uint64_t bank = 0; bank < heads.size(); ++bank) {
+        const std::vector<Node*> members = Members(bank);
+        exclude.insert(exclude.end(), members.begin(), members.end());
+    }
+    if (level == PrivateCache::L2) {
+        const std::vector<Node*> l1 = PrivateMembers(PrivateCache::L1);
+        exclude.insert(exclude.end(), l1.begin(), l1.end());
+    }
+    return FindPrivateEvictionSet(arena.Data(), setIndex, level, exclude);
+}
+
+bool EvictionSetGroup::Validate(uint64_t& garbage) const {
+    if (heads.size() != geometry.llcBanks) {
+        std::cout << "Eviction set group has " << heads.size()
+                  << " sets, should be " << geometry.llcBanks << std::endl;
+        return false;
+    }
+
+    std::vector<Node*> allNodes;
+    allNodes.reserve(geometry.ConflictSetSize());
+    for (uint64_t bank = 0; bank < heads.size(); ++bank) {
+        const std::vector<Node*> members = Members(bank);
+        if (members.size() != geometry.waysPerBank) {
+            std::cout << "Eviction set " << bank << " has " << members.size()
+                      << " members, should be " << geometry.waysPerBank
+                      << std::endl;
+            return false;
+        }
+        allNodes.insert(allNodes.end(), members.begin(), members.end());
+    }
+
+    std::sort(allNodes.begin(), allNodes.end());
+    if (std::adjacent_find(allNodes.begin(), allNodes.end()) !=
+        allNodes.end()) {
+        std::cout << "Eviction sets are not disjoint" << std::endl;
+        return false;
+    }
+
+    const uint64_t iterations =
+        VALIDATION_ACCESSES_PER_LINE * geometry.ConflictSetSize();
+    for (uint64_t bank = 0; bank < heads.size(); ++bank) {
+        Node* node = heads[bank];
+        const uint64_t time = MeasureChase(&node, iterations) / iterations;
+        garbage += node->padding[0];
+
+        if (time <= geometry.evictionSetCyclesMin ||
+            time >= geometry.evictionSetCyclesMax) {
+            std::cout << "Eviction set " << bank << ": average access time "
+                      << time << " outside (" << geometry.evictionSetCyclesMin
+                      << ", " << geometry.evictionSetCyclesMax << ")"
+                      << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Format:
+//   evictionSetGroup VERSION PROFILE SET_INDEX BANKS WAYS
+//   OFFSET ... (WAYS byte offsets into the arena, one line per bank)
+void EvictionSetGroup::Serialize(std::ostream& out) const {
+    const char* base = reinterpret_cast<const char*>(arena.Data());
+
+    out << SERIALIZED_GROUP_TAG << " " << SERIALIZED_GROUP_VERSION << " "
+        << geometry.name << " " << setIndex << " " << heads.size() << " "
+        << geometry.waysPerBank << "\n";
+    for (uint64_t bank = 0; bank < heads.size(); ++bank) {
+        const std::vector<Node*> members = Members(bank);
+        for (uint64_t i = 0; i < members.size(); ++i) {
+            out << (i == 0 ? "" : " ")
+                << reinterpret_cast<const char*>(members[i]) - base;
+        }
+        out << "\n";
+    }
+}
+
+bool EvictionSetGroup::Deserialize(std::istream& in, CandidateArena arena,
+                                   EvictionSetGroup* group) {
+    const GeometryProfile& geometry = Geometry();
+
+    std::string tag;
+    uint64_t version = 0;
+    std::string profile;
+    uint64_t setIndex = 0;
+    uint64_t banks = 0;
+    uint64_t ways = 0;
+    if (!(in >> tag >> version >> profile >> setIndex >> banks >> ways) ||
+        tag != SERIALIZED_GROUP_TAG || version != SERIALIZED_GROUP_VERSION) {
+        std::cerr << "Not a serialized eviction set group" << std::endl;
+        return false;
+    }
+    if (profile != geometry.name || banks != geometry.llcBanks ||
+        ways != geometry.waysPerBank || setIndex >= geometry.setsPerBank) {
+        std::cerr << "Eviction set group of profile " << profile
+                  << " does not match profile " << geometry.name
+                  << std::endl;
+        return false;
+    }
+
+    // Read every offset before relinking, so that bad input leaves the arena
+    // untouched.
+    char* base = reinterpret_cast<char*>(arena.Data());
+    std::set<uint64_t> offsets;
+    std::vector<std::vector<Node*>> sets(banks, std::vector<Node*>(ways));
+    for (uint64_t bank = 0; bank < banks; ++bank) {
+        for (uint64_t i = 0; i < ways; ++i) {
+            uint64_t offset = 0;
+            if (!(in >> offset) || offset % CACHE_LINE_SIZE != 0 ||
+                offset + sizeof(Node) > arena.Size()) {
+                std::cerr << "Bad member offset in eviction set " << bank
+                          << std::endl;
+                return false;
+            }
+            if (!offsets.insert(offset).second) {
+                std::cerr << "Duplicate member offset " << offset
+                          << " in eviction set " << bank << std::endl;
+                return false;
+            }
+            sets[bank][i] = reinterpret_cast<Node*>(base + offset);
+        }
+    }
+
+    std::vector<Node*> heads;
+    for (const std::vector<Node*>& members : sets) {
+        for (uint64_t i = 0; i < ways; ++i) {
+            members[i]->next = members[(i + 1) % ways];
+            members[(i + 1) % ways]->prev = members[i];
+        }
+        heads.push_back(members[0]);
+    }
+
+    *group = EvictionSetGroup(std::move(arena), geometry, setIndex,
+                              std::move(heads));
+    return true;
+}
+
+// Applies the builder's options and constructs the sets in "array".
+std::vector<Node*> Construct(const EvictionSetBuilder& builder, Node* array,
+                             uint64_t setIndex) {
+    if (!SameGeometryProfile(builder.geometry, Geometry())) {
+        SetGeometryProfile(builder.geometry);
+    }
+    if (builder.probeConfig) {
+        SetProbeConfig(*builder.probeConfig);
+    }
+    SetConstructionSeed(builder.seed);
+
+    return GetEvictionSetInArray(array, setIndex);
+}
+
+EvictionSetGroup EvictionSetBuilder::Build(uint64_t setIndex) const {
+    CandidateArena arena(allocator, geometry.arraySize);
+    std::vector<Node*> heads = Construct(*this, arena.Data(), setIndex);
+
+    return EvictionSetGroup(std::move(arena), geometry, setIndex,
+                            std::move(heads));
+}
+
+EvictionSetGroup EvictionSetBuilder::BuildInArray(Node* array,
+                                                  uint64_t setIndex) const {
+    std::vector<Node*> heads = Construct(*this, array, setIndex);
+
+    return EvictionSetGroup(CandidateArena::Borrow(array, geometry.arraySize),
+                            geometry, setIndex, std::move(heads));
+}
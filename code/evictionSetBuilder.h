@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "geometryProfile.h"
+#include "hugePages.h"
+
+// Eviction set construction as a library (libEvictionSet.a), for tools which
+// embed it. A builder holds the options of a construction, and each build
+// returns an EvictionSetGroup which owns the memory its sets live in:
+//
+//   EvictionSetBuilder builder;
+//   builder.seed = 1;
+//   EvictionSetGroup group = builder.Build(/*setIndex=*/0);
+//   Node* head = group.Head(bank);
+//
+// Construction itself is GetEvictionSetInArray(). Its probe configuration is
+// per thread (see SetProbeConfig()), so builds on different LLCs may run
+// concurrently from different threads, as long as they use the active
+// geometry profile: a build with another profile replaces it for the process.
+
+// Allocates and frees candidate arenas. The default puts them on huge pages.
+struct CandidateAllocator {
+    Node* (*allocate)(uint64_t size) = AllocateCandidateArray;
+    void (*release)(Node* array) = FreeCandidateArray;
+};
+
+// Memory holding the candidates of one construction. Frees it on destruction,
+// unless it was borrowed from the caller (e.g., a hugetlbfs file).
+class CandidateArena {
+  public:
+    CandidateArena() = default;
+    CandidateArena(const CandidateAllocator& allocator, uint64_t size);
+    static CandidateArena Borrow(Node* array, uint64_t size);
+
+    CandidateArena(CandidateArena&& other) noexcept;
+    CandidateArena& operator=(CandidateArena&& other) noexcept;
+    CandidateArena(const CandidateArena&) = delete;
+    CandidateArena& operator=(const CandidateArena&) = delete;
+    ~CandidateArena();
+
+    Node* Data() const { return array; }
+    uint64_t Size() const { return size; }
+
+  private:
+    Node* array = nullptr;
+    uint64_t size = 0;
+    // Null if borrowed.
+    void (*release)(Node* array) = nullptr;
+};
+
+// One eviction set per LLC bank for one set index, and the arena they are in.
+class EvictionSetGroup {
+  public:
+    EvictionSetGroup() = default;
+    EvictionSetGroup(CandidateArena arena, const GeometryProfile& geometry,
+                     uint64_t setIndex, std::vector<Node*> heads);
+
+    uint64_t SetIndex() const { return setIndex; }
+    uint64_t Banks() const { return heads.size(); }
+    const GeometryProfile& Profile() const { return geometry; }
+    const CandidateArena& Arena() const { return arena; }
+
+    // Any node of the bank's closed list.
+    Node* Head(uint64_t bank) const;
+    const std::vector<Node*>& Heads() const { return heads; }
+    // The bank's nodes in list order.
+    std::vector<Node*> Members(uint64_t bank) const;
+
+    // Lines of the arena which evict the set index from the "level" cache of
+    // the core that loads them (see FindPrivateEvictionSet()), unlinked. The
+    // L1 and L2 lines are disjoint from each other and from the sets, so both
+    // can be linked into one list, e.g., to make every access to a set member
+    // an LLC access.
+    std::vector<Node*> PrivateMembers(PrivateCache level) const;
+
+    // Checks that the sets are disjoint, have waysPerBank members each, and
+    // hit in the LLC when traversed. Reports and returns false instead of
+    // asserting, so callers can retry.
+    bool Validate(uint64_t& garbage) const;
+
+    // Writes the members as byte offsets into the arena, one line per bank.
+    // The offsets are only meaningful for the same arena (or a copy of its
+    // physical layout, such as a hugetlbfs file).
+    void Serialize(std::ostream& out) const;
+    // Relinks the sets written by Serialize() inside "arena". Returns false
+    // (and reports why) on malformed input, a line listed twice, or a profile
+    // other than the active one.
+    static bool Deserialize(std::istream& in, CandidateArena arena,
+                            EvictionSetGroup* group);
+
+  private:
+    CandidateArena arena;
+    GeometryProfile geometry;
+    uint64_t setIndex = 0;
+    std::vector<Node*> heads;
+};
+
+struct EvictionSetBuilder {
+    // Sizes, and the thresholds and timing bounds of probing and validation.
+    // Becomes the active profile on Build().
+    GeometryProfile geometry = Geometry();
+
+    // Probe strategy and timer. If unset, the active configuration is kept
+    // (DetectProbeConfig() unless SetProbeConfig() was called).
+    std::optional<ProbeConfig> probeConfig;
+
+    CandidateAllocator allocator;
+
+    // Seed of the candidate orders (see SetConstructionSeed()).
+    uint64_t seed = 0;
+
+    // Allocates an arena of geometry.arraySize bytes and builds in it.
+    EvictionSetGroup Build(uint64_t setIndex) const;
+
+    // Builds in the caller's array (geometry.arraySize bytes on huge pages),
+    // which the group does not free.
+    EvictionSetGroup BuildInArray(Node* array, uint64_t setIndex) const;
+};
@@ -0,0 +1,375 @@
+// Health monitoring and incremental repair of the eviction sets built by
+// GetEvictionSet().
+//
+// SanityCheckEvictionSets() validates the sets only once, right after
+// construction. During long runs the kernel may migrate or compact hugepages,
+// which moves members to different physical frames. Since the LLC bank is
+// selected by a hash of the physical address, a moved member usually ends up in
+// a different bank and its eviction set no longer evicts.
+//
+// Checks are short bursts meant to run between measurement windows. A repair
+// re-probes only the affected members and replaces the ones which left the
+// bank with lines from the remaining candidates, instead of rebuilding all
+// sets from scratch.
+
+#include <cassert>
+#include <iostream>
+#include <set>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "evictionSetHealth.h"
+#include "geometryProfile.h"
+#include "hugePages.h"
+#include "measurementKernels.h"
+
+// Number of timed witness reloads per health check.
+const uint64_t HEALTH_BURSTS_PER_CHECK = 8;
+
+// Passes over the eviction set between loading and reloading the witness. Far
+// fewer than Probe() uses so that a check stays within a few microseconds.
+const uint64_t HEALTH_EVICTION_PASSES = 8;
+
+// A set is repaired after this many consecutive failed checks (or immediately
+// if one of its members moved to a different frame).
+const uint64_t MAX_FAILED_CHECKS = 3;
+
+// Probes per membership decision during repair. The majority wins.
+const uint64_t REPAIR_PROBES = 5;
+
+std::vector<Node*> SetMembers(Node* head) {
+    std::vector<Node*> members;
+    Node* node = head;
+    do {
+        members.push_back(node);
+        node = node->next;
+    } while (node != head);
+    return members;
+}
+
+// Links "nodes" into a closed linked list in vector order and returns its head.
+Node* LinkNodes(const std::vector<Node*>& nodes) {
+    assert(!nodes.empty());
+    for (uint64_t i = 0; i < nodes.size(); ++i) {
+        Node* next = nodes[(i + 1) % nodes.size()];
+        nodes[i]->next = next;
+        next->prev = nodes[i];
+    }
+    return nodes[0];
+}
+
+void UnlinkNode(Node* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+}
+
+void RelinkNode(Node* node) {
+    node->prev->next = node;
+    node->next->prev = node;
+}
+
+// Majority vote over several probes, since single probes occasionally report
+// a miss for other reasons (e.g., a context switch).
+bool ProbeMajority(Node* setStartNode, const Node* candidate,
+                   uint64_t& garbage) {
+    uint64_t misses = 0;
+    for (uint64_t i = 0; i < REPAIR_PROBES; ++i) {
+        misses += Probe(setStartNode, candidate, garbage,
+                        /*printOutput=*/false);
+    }
+    return misses * 2 > REPAIR_PROBES;
+}
+
+// Every member of every eviction set, plus the witnesses.
+std::set<Node*> UsedNodes(const EvictionSetHealth* health) {
+    std::set<Node*> used;
+    for (uint64_t bank = 0; bank < health->evictionSets->size(); ++bank) {
+        for (Node* node : SetMembers((*health->evictionSets)[bank])) {
+            used.insert(node);
+        }
+    }
+    for (Node* witness : health->witnesses) {
+        used.insert(witness);
+    }
+    return used;
+}
+
+// Lines mapping to the tracked cache set which are not in "used".
+std::vector<Node*> UnusedCandidates(const EvictionSetHealth* health,
+                                    const std::set<Node*>& used) {
+    std::vector<Node*> unused;
+    for (Node* candidate : FindCandidates(health->array, health->setIndex)) {
+        if (used.find(candidate) == used.end()) {
+            unused.push_back(candidate);
+        }
+    }
+    return unused;
+}
+
+// Finds an unused line which the bank's (full) eviction set evicts, i.e. one
+// which maps to the same bank.
+Node* FindWitness(const EvictionSetHealth* health, uint64_t bank,
+                  const std::set<Node*>& used, uint64_t& garbage) {
+    for (Node* candidate : UnusedCandidates(health, used)) {
+        if (ProbeMajority((*health->evictionSets)[bank], candidate, garbage)) {
+            return candidate;
+        }
+    }
+    return nullptr;
+}
+
+void RecordFrames(EvictionSetHealth* health, uint64_t bank) {
+    std::vector<Node*> nodes = SetMembers((*health->evictionSets)[bank]);
+    if (health->witnesses[bank] != nullptr) {
+        nodes.push_back(health->witnesses[bank]);
+    }
+    const std::vector<uint64_t> frames = ReadFrames(nodes);
+    for (uint64_t i = 0; i < nodes.size(); ++i) {
+        health->frames[nodes[i]] = frames[i];
+    }
+}
+
+void InitEvictionSetHealth(EvictionSetHealth* health, Node* array,
+                           uint64_t setIndex, std::vector<Node*>* evictionSets,
+                           uint64_t& garbage) {
+    const GeometryProfile& geometry = Geometry();
+
+    assert(evictionSets->size() == geometry.llcBanks);
+
+    health->array = array;
+    health->setIndex = setIndex;
+    health->evictionSets = evictionSets;
+    health->witnesses.assign(geometry.llcBanks, nullptr);
+    health->frames.clear();
+    health->failedChecks.assign(geometry.llcBanks, 0);
+    health->nextBank = 0;
+    health->repairs = 0;
+
+    for (uint64_t bank = 0; bank < geometry.llcBanks; ++bank) {
+        health->witnesses[bank] =
+            FindWitness(health, bank, UsedNodes(health), garbage);
+        assert(health->witnesses[bank] != nullptr);
+        RecordFrames(health, bank);
+    }
+
+    std::cout << "Found a witness for each eviction set" << std::endl;
+}
+
+bool CheckEvictionSetHealth(EvictionSetHealth* health, uint64_t bank,
+                            uint64_t& garbage) {
+    Node* head = (*health->evictionSets)[bank];
+    const Node* witness = health->witnesses[bank];
+
+    // Any member (or the witness) on a different frame than recorded may have
+    // changed bank. Frames of 0 mean pagemap hides them from us.
+    std::vector<Node*> nodes = SetMembers(head);
+    nodes.push_back(health->witnesses[bank]);
+    const std::vector<uint64_t> frames = ReadFrames(nodes);
+    for (uint64_t i = 0; i < nodes.size(); ++i) {
+        const uint64_t recorded = health->frames[nodes[i]];
+        if (recorded != 0 && frames[i] != recorded) {
+            health->failedChecks[bank] = MAX_FAILED_CHECKS;
+            return false;
+        }
+    }
+
+    // Traversing a healthy set evicts the witness, so reloading the witness
+    // misses to DRAM. On a non-inclusive LLC, the witness would stay in this
+    // core's L2 (the set and the witness fit in one L2 set), so the check
+    // goes through Probe(), whose helper core loads the witness instead.
+    bool healthy;
+    if (GetProbeConfig().strategy == ProbeStrategy::CROSS_CORE) {
+        healthy = ProbeMajority(head, witness, garbage);
+    } else {
+        Node* node = head;
+        uint64_t evicted = 0;
+
+        for (uint64_t burst = 0; burst < HEALTH_BURSTS_PER_CHECK; ++burst) {
+            // Loading the witness through the timed kernel keeps the load
+            // intact.
+            TimedLoad(witness);
+            node = ChaseNodes(node,
+                              HEALTH_EVICTION_PASSES * Geometry().waysPerBank);
+
+            if (MeasureLoad(witness) > Geometry().llcCycleThreshold) {
+                ++evicted;
+            }
+
+            garbage += node->padding[0];
+        }
+
+        healthy = evicted * 2 > HEALTH_BURSTS_PER_CHECK;
+    }
+    if (healthy) {
+        health->failedChecks[bank] = 0;
+    } else {
+        ++health->failedChecks[bank];
+    }
+    return healthy;
+}
+
+uint64_t CheckNextEvictionSet(EvictionSetHealth* health, uint64_t& garbage) {
+    const uint64_t bank = health->nextBank;
+    health->nextBank = (health->nextBank + 1) % Geometry().llcBanks;
+
+    if (!CheckEvictionSetHealth(health, bank, garbage) &&
+        health->failedChecks[bank] >= MAX_FAILED_CHECKS) {
+        return bank;
+    }
+    return Geometry().llcBanks;
+}
+
+bool RepairEvictionSet(EvictionSetHealth* health, uint64_t bank,
+                       uint64_t& garbage) {
+    const GeometryProfile& geometry = Geometry();
+
+    // Group-tested sets (ProbeConfig::smallPages) are at different set
+    // indices, so they do not form a conflict set to test membership against,
+    // and unused candidates may be at any set index.
+    if (GetProbeConfig().smallPages) {
+        std::cout << "Eviction set " << bank << ": group-tested sets cannot "
+                  << "be repaired, rebuild needed" << std::endl;
+        return false;
+    }
+
+    std::vector<Node*>& heads = *health->evictionSets;
+
+    // Membership is tested against the conflict set (all eviction sets joined
+    // into one list), as during construction: with one node removed, the
+    // node's own bank holds only waysPerBank - 1 conflict set nodes, so the
+    // node hits when probed. A node which moved to another bank instead finds
+    // that bank full and misses.
+    std::vector<std::vector<Node*>> members(geometry.llcBanks);
+    std::vector<Node*> conflictSet;
+    for (uint64_t b = 0; b < geometry.llcBanks; ++b) {
+        members[b] = SetMembers(heads[b]);
+        conflictSet.insert(conflictSet.end(), members[b].begin(),
+                           members[b].end());
+    }
+
+    // Only members on a different frame are suspects, unless pagemap cannot
+    // tell us (then every member of the set is).
+    const std::vector<uint64_t> frames = ReadFrames(members[bank]);
+    std::vector<Node*> suspects;
+    for (uint64_t i = 0; i < members[bank].size(); ++i) {
+        const uint64_t recorded = health->frames[members[bank][i]];
+        if (recorded != 0 && frames[i] != recorded) {
+            suspects.push_back(members[bank][i]);
+        }
+    }
+    if (suspects.empty()) {
+        suspects = members[bank];
+    }
+
+    LinkNodes(conflictSet);
+
+    std::set<Node*> removed;
+    for (Node* suspect : suspects) {
+        UnlinkNode(suspect);
+        const bool missToDRAM = ProbeMajority(suspect->next, suspect, garbage);
+        RelinkNode(suspect);
+
+        if (missToDRAM) {
+            removed.insert(suspect);
+        }
+    }
+
+    std::cout << "Eviction set " << bank << ": " << removed.size() << " of "
+              << suspects.size() << " suspect members left the bank"
+              << std::endl;
+
+    // Drop the members which left and refill the set from the unused
+    // candidates. With the bank one or more nodes short of full, a candidate
+    // which hits when probed against the conflict set maps to this bank.
+    std::vector<Node*> kept;
+    for (Node* node : members[bank]) {
+        if (removed.find(node) == removed.end()) {
+            kept.push_back(node);
+        }
+    }
+    members[bank] = kept;
+
+    std::set<Node*> used(removed);
+    conflictSet.clear();
+    for (uint64_t b = 0; b < geometry.llcBanks; ++b) {
+        conflictSet.insert(conflictSet.end(), members[b].begin(),
+                           members[b].end());
+        used.insert(members[b].begin(), members[b].end());
+    }
+    used.insert(health->witnesses.begin(), health->witnesses.end());
+
+    Node* conflictHead = LinkNodes(conflictSet);
+    const std::vector<Node*> candidates = UnusedCandidates(health, used);
+
+    for (uint64_t i = 0; i < candidates.size() &&
+         members[bank].size() < geometry.waysPerBank; ++i) {
+        Node* candidate = candidates[i];
+        if (!ProbeMajority(conflictHead, candidate, garbage)) {
+            // Add the candidate to the conflict set and the bank.
+            candidate->next = conflictHead;
+            candidate->prev = conflictHead->prev;
+            RelinkNode(candidate);
+            members[bank].push_back(candidate);
+        }
+    }
+
+    // Split the conflict set back into the per-bank eviction sets.
+    for (uint64_t b = 0; b < geometry.llcBanks; ++b) {
+        if (!members[b].empty()) {
+            heads[b] = LinkNodes(members[b]);
+        }
+    }
+
+    if (members[bank].size() < geometry.waysPerBank) {
+        std::cout << "Eviction set " << bank << ": ran out of candidates"
+                  << std::endl;
+        return false;
+    }
+
+    // The witness may have moved as well.
+    if (removed.find(health->witnesses[bank]) != removed.end() ||
+        health->frames[health->witnesses[bank]] !=
+        ReadFrames({health->witnesses[bank]})[0]) {
+        health->witnesses[bank] = nullptr;
+        std::set<Node*> used = UsedNodes(health);
+        used.insert(removed.begin(), removed.end());
+        health->witnesses[bank] = FindWitness(health, bank, used, garbage);
+        if (health->witnesses[bank] == nullptr) {
+            return false;
+        }
+    }
+
+    RecordFrames(health, bank);
+    health->failedChecks[bank] = 0;
+    ++health->repairs;
+
+    // Make sure the repaired set evicts again.
+    uint64_t healthyChecks = 0;
+    for (uint64_t i = 0; i < MAX_FAILED_CHECKS; ++i) {
+        healthyChecks += CheckEvictionSetHealth(health, bank, garbage);
+    }
+    const bool repaired = healthyChecks * 2 > MAX_FAILED_CHECKS;
+
+    std::cout << "Eviction set " << bank << ": "
+              << (repaired ? "repaired" : "still not evicting") << std::endl;
+
+    return repaired;
+}
+
+bool MaintainEvictionSets(EvictionSetHealth* health, uint64_t& garbage) {
+    bool allHealthy = true;
+    for (uint64_t bank = 0; bank < Geometry().llcBanks; ++bank) {
+        if (CheckEvictionSetHealth(health, bank, garbage)) {
+            continue;
+        }
+        // Retry a few times before repairing, unless a member moved.
+        while (health->failedChecks[bank] < MAX_FAILED_CHECKS &&
+               !CheckEvictionSetHealth(health, bank, garbage)) {
+        }
+        if (health->failedChecks[bank] >= MAX_FAILED_CHECKS &&
+            !RepairEvictionSet(health, bank, garbage)) {
+            allHealthy = false;
+        }
+    }
+    return allHealthy;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "constants.h"
+
+// Tracks whether the eviction sets returned by GetEvictionSet() still evict
+// their bank's set. Hugepage migration or compaction can move a member to a
+// different physical frame (and so a different bank), silently turning an
+// eviction set into a non-evicting one.
+struct EvictionSetHealth {
+    Node* array;
+    uint64_t setIndex;
+
+    // The eviction sets being tracked, one per bank. Repairs update the heads
+    // in place.
+    std::vector<Node*>* evictionSets;
+
+    // One line per bank which maps to the bank's set but belongs to no
+    // eviction set. Used to check that the set still evicts.
+    std::vector<Node*> witnesses;
+
+    // Physical frame number of every member and witness when last validated.
+    // All zero if pagemap does not expose frame numbers (needs CAP_SYS_ADMIN).
+    std::map<Node*, uint64_t> frames;
+
+    // Consecutive failed checks per bank.
+    std::vector<uint64_t> failedChecks;
+
+    // Next bank to check in CheckNextEvictionSet().
+    uint64_t nextBank;
+    uint64_t repairs;
+};
+
+// Records members' frames and finds a witness for every bank. Takes a few
+// hundred milliseconds of probing.
+void InitEvictionSetHealth(EvictionSetHealth* health, Node* array,
+                           uint64_t setIndex, std::vector<Node*>* evictionSets,
+                           uint64_t& garbage);
+
+// A few microseconds: re-reads the frames of the bank's members and checks
+// that traversing the set evicts its witness. Returns false if the set looks
+// unhealthy. With ProbeStrategy::CROSS_CORE the check runs a few Probe()s
+// instead, which takes longer.
+bool CheckEvictionSetHealth(EvictionSetHealth* health, uint64_t bank,
+                            uint64_t& garbage);
+
+// Checks the next bank in round-robin order. Returns the bank which needs
+// repairing, or Geometry().llcBanks if none does yet.
+uint64_t CheckNextEvictionSet(EvictionSetHealth* health, uint64_t& garbage);
+
+// Replaces only the members of the bank's set which no longer map to the bank,
+// probing the remaining candidates in "array" for replacements. Returns false
+// if the set could not be repaired and needs a full rebuild, which is always
+// the case for sets built by group testing (ProbeConfig::smallPages).
+bool RepairEvictionSet(EvictionSetHealth* health, uint64_t bank,
+                       uint64_t& garbage);
+
+// Checks every bank and repairs the unhealthy ones. Meant to run between
+// measurement windows. Returns false if some set needs a full rebuild.
+bool MaintainEvictionSets(EvictionSetHealth* health, uint64_t& garbage);
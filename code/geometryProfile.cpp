@@ -0,0 +1,494 @@
+#include <algorithm>
+#include <cassert>
+#include <cpuid.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "constants.h"
+#include "geometryProfile.h"
+#include "toolUtils.h"
+
+// Built-in profiles. The Broadwell numbers come from profiling our Intel Xeon
+// E5-2650 v4 machines:
+//
+// Size (https://en.wikichip.org/wiki/intel/xeon_e5/e5-2650_v4):
+// L1I$ 384 KiB	 12x32 KiB  8-way set associative (per core, write-back)
+// L1D$ 384 KiB	 12x32 KiB  8-way set associative (per core, write-back)
+// L2$    3 MiB	12x256 KiB  8-way set associative (per core, write-back)
+// L3$   30 MiB	12x2.5 MiB 20-way set associative (shared, per core, write-back)
+//
+// Latency (https://www.7-cpu.com/cpu/Broadwell.html):
+// L1D$ 4 cycles (for simple access via pointer)
+//      5 cycles (for access with complex address calculation:
+//                size_t n, *p; n = p[n])
+// L2$ 12 cycles
+// L3$ 40-70 cycles
+// RAM 100+ cycles
+//
+// The other profiles start from published geometry and rough latencies. Their
+// cycle bounds are estimates; tune them with a profile file (see
+// docs/geometryProfiles.txt) once measured on the machine.
+const GeometryProfile BUILTIN_PROFILES[] = {
+    {
+        "broadwell-ep",
+        /*llcBanks=*/12, /*waysPerBank=*/20, /*setsPerBank=*/2048,
+        // 32 KiB 8-way L1, 256 KiB 8-way L2.
+        /*l1Sets=*/64, /*l1Ways=*/8, /*l2Sets=*/512, /*l2Ways=*/8,
+        /*inclusive=*/true, SliceHash::COMPLEX,
+        /*slicePerCore=*/true, /*coresPerLlc=*/0,
+        /*arraySize=*/64 * MiB,
+        // An LLC hit is ~40 cycles, and a miss is ~170 cycles.
+        /*llcCycleThreshold=*/100,
+        /*probeCyclesMin=*/20, /*probeCyclesMax=*/200,
+        // DRAM access time usually ~175-180.
+        /*candidateCyclesMin=*/165, /*candidateCyclesMax=*/190,
+        // Average LLC access time is ~40 cycles.
+        /*conflictSetCyclesMin=*/30, /*conflictSetCyclesMax=*/50,
+        // Per-bank sets range from ~28-48 depending on bank location.
+        /*evictionSetCyclesMin=*/25, /*evictionSetCyclesMax=*/55,
+    },
+    {
+        // Skylake-SP, Cascade Lake and Cooper Lake: a CHA per tile, 11-way
+        // non-inclusive LLC slices and a 12-way snoop filter.
+        "skylake-sp",
+        /*llcBanks=*/28, /*waysPerBank=*/12, /*setsPerBank=*/2048,
+        // 32 KiB 8-way L1, 1 MiB 16-way L2.
+        /*l1Sets=*/64, /*l1Ways=*/8, /*l2Sets=*/1024, /*l2Ways=*/16,
+        /*inclusive=*/false, SliceHash::COMPLEX,
+        /*slicePerCore=*/true, /*coresPerLlc=*/0,
+        /*arraySize=*/128 * MiB,
+        /*llcCycleThreshold=*/180,
+        /*probeCyclesMin=*/20, /*probeCyclesMax=*/400,
+        /*candidateCyclesMin=*/180, /*candidateCyclesMax=*/320,
+        /*conflictSetCyclesMin=*/50, /*conflictSetCyclesMax=*/110,
+        /*evictionSetCyclesMin=*/40, /*evictionSetCyclesMax=*/120,
+    },
+    {
+        // Zen 2: a 16 MiB, 16-way L3 per 4-core CCX, in 4 slices. The L3 is a
+        // victim cache of the L2s.
+        "zen2",
+        /*llcBanks=*/4, /*waysPerBank=*/16, /*setsPerBank=*/4096,
+        // 32 KiB 8-way L1, 512 KiB 8-way L2.
+        /*l1Sets=*/64, /*l1Ways=*/8, /*l2Sets=*/1024, /*l2Ways=*/8,
+        /*inclusive=*/false, SliceHash::LOW_ORDER_XOR,
+        /*slicePerCore=*/false, /*coresPerLlc=*/4,
+        /*arraySize=*/64 * MiB,
+        /*llcCycleThreshold=*/120,
+        /*probeCyclesMin=*/20, /*probeCyclesMax=*/600,
+        /*candidateCyclesMin=*/150, /*candidateCyclesMax=*/450,
+        /*conflictSetCyclesMin=*/30, /*conflictSetCyclesMax=*/70,
+        /*evictionSetCyclesMin=*/25, /*evictionSetCyclesMax=*/80,
+    },
+    {
+        // Zen 3 and Zen 4: a 32 MiB, 16-way L3 per 8-core CCD, in 8 slices.
+        "zen3",
+        /*llcBanks=*/8, /*waysPerBank=*/16, /*setsPerBank=*/4096,
+        // Zen 3's 512 KiB 8-way L2. Zen 4's 1 MiB L2 needs l2Sets = 2048.
+        /*l1Sets=*/64, /*l1Ways=*/8, /*l2Sets=*/1024, /*l2Ways=*/8,
+        /*inclusive=*/false, SliceHash::LOW_ORDER_XOR,
+        /*slicePerCore=*/false, /*coresPerLlc=*/8,
+        /*arraySize=*/128 * MiB,
+        /*llcCycleThreshold=*/130,
+        /*probeCyclesMin=*/20, /*probeCyclesMax=*/600,
+        /*candidateCyclesMin=*/150, /*candidateCyclesMax=*/450,
+        /*conflictSetCyclesMin=*/35, /*conflictSetCyclesMax=*/80,
+        /*evictionSetCyclesMin=*/30, /*evictionSetCyclesMax=*/90,
+    },
+};
+
+// Used when CPUID matches none of the entries below.
+const char* DEFAULT_PROFILE = "broadwell-ep";
+
+struct CpuModel {
+    const char* vendor;
+    uint32_t family;
+    uint32_t model; // 0 matches every model of the family
+    const char* profile;
+};
+
+const CpuModel CPU_MODELS[] = {
+    {"GenuineIntel", 6, 0x3F, "broadwell-ep"}, // Haswell-EP, same layout
+    {"GenuineIntel", 6, 0x4F, "broadwell-ep"},
+    {"GenuineIntel", 6, 0x55, "skylake-sp"},
+    {"AuthenticAMD", 0x17, 0, "zen2"},
+    {"AuthenticAMD", 0x19, 0, "zen3"},
+    {"AuthenticAMD", 0x1A, 0, "zen3"},
+};
+
+const char* PROFILE_ENVIRONMENT_VARIABLE = "LLC_GEOMETRY_PROFILE";
+
+bool GetBuiltinGeometryProfile(const std::string& name,
+                               GeometryProfile* profile) {
+    for (const GeometryProfile& builtin : BUILTIN_PROFILES) {
+        if (builtin.name == name) {
+            *profile = builtin;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the name of the built-in profile for the CPU we run on.
+std::string DetectProfileName() {
+    uint32_t eax, ebx, ecx, edx;
+    if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) {
+        return DEFAULT_PROFILE;
+    }
+    char vendor[13] = {};
+    memcpy(vendor, &ebx, 4);
+    memcpy(vendor + 4, &edx, 4);
+    memcpy(vendor + 8, &ecx, 4);
+
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+    if (family == 0xF) {
+        family += (eax >> 20) & 0xFF;
+    }
+    if (family == 6 || family >= 0xF) {
+        model |= ((eax >> 16) & 0xF) << 4;
+    }
+
+    for (const CpuModel& cpu : CPU_MODELS) {
+        if (strcmp(cpu.vendor, vendor) == 0 && cpu.family == family &&
+            (cpu.model == 0 || cpu.model == model)) {
+            return cpu.profile;
+        }
+    }
+
+    std::cout << "No geometry profile for " << vendor << " family 0x"
+              << std::hex << family << " model 0x" << model << std::dec
+              << ", using " << DEFAULT_PROFILE << std::endl;
+    return DEFAULT_PROFILE;
+}
+
+std::string ReadFirstLine(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// Number of physical cores of the package of CPU 0, or 0 if the topology is
+// not readable.
+uint64_t CoresInFirstPackage() {
+    const std::string package =
+        ReadFirstLine("/sys/devices/system/cpu/cpu0/topology/"
+                      "physical_package_id");
+    std::set<std::string> cores;
+    for (int cpu = 0;; ++cpu) {
+        const std::string topology = "/sys/devices/system/cpu/cpu" +
+            std::to_string(cpu) + "/topology/";
+        const std::string cpuPackage =
+            ReadFirstLine(topology + "physical_package_id");
+        if (cpuPackage.empty()) {
+            break;
+        }
+        if (cpuPackage == package) {
+            cores.insert(ReadFirstLine(topology + "core_id"));
+        }
+    }
+    return cores.size();
+}
+
+bool ParseBool(const std::string& value, bool* result) {
+    if (value == "true" || value == "1") {
+        *result = true;
+    } else if (value == "false" || value == "0") {
+        *result = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool ParseSliceHash(const std::string& value, SliceHash* result) {
+    if (value == "complex") {
+        *result = SliceHash::COMPLEX;
+    } else if (value == "low-order-xor") {
+        *result = SliceHash::LOW_ORDER_XOR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Applies one "key = value" setting. Returns false if either is invalid.
+bool ApplySetting(const std::string& key, const std::string& value,
+                  GeometryProfile* profile) {
+    if (key == "base") {
+        return GetBuiltinGeometryProfile(value, profile);
+    }
+    if (key == "name") {
+        profile->name = value;
+        return true;
+    }
+    if (key == "inclusive") {
+        return ParseBool(value, &profile->inclusive);
+    }
+    if (key == "slicePerCore") {
+        return ParseBool(value, &profile->slicePerCore);
+    }
+    if (key == "sliceHash") {
+        return ParseSliceHash(value, &profile->sliceHash);
+    }
+
+    const std::map<std::string, uint64_t*> numbers = {
+        {"llcBanks", &profile->llcBanks},
+        {"waysPerBank", &profile->waysPerBank},
+        {"setsPerBank", &profile->setsPerBank},
+        {"l1Sets", &profile->l1Sets},
+        {"l1Ways", &profile->l1Ways},
+        {"l2Sets", &profile->l2Sets},
+        {"l2Ways", &profile->l2Ways},
+        {"coresPerLlc", &profile->coresPerLlc},
+        {"arraySize", &profile->arraySize},
+        {"llcCycleThreshold", &profile->llcCycleThreshold},
+        {"probeCyclesMin", &profile->probeCyclesMin},
+        {"probeCyclesMax", &profile->probeCyclesMax},
+        {"candidateCyclesMin", &profile->candidateCyclesMin},
+        {"candidateCyclesMax", &profile->candidateCyclesMax},
+        {"conflictSetCyclesMin", &profile->conflictSetCyclesMin},
+        {"conflictSetCyclesMax", &profile->conflictSetCyclesMax},
+        {"evictionSetCyclesMin", &profile->evictionSetCyclesMin},
+        {"evictionSetCyclesMax", &profile->evictionSetCyclesMax},
+    };
+    const auto it = numbers.find(key);
+    if (it == numbers.end()) {
+        return false;
+    }
+
+    // Accept a binary size suffix, e.g. "arraySize = 128M".
+    char* end;
+    uint64_t number = strtoull(value.c_str(), &end, 0);
+    const std::string suffix = end;
+    if (end == value.c_str()) {
+        return false;
+    } else if (suffix == "K") {
+        number *= KiB;
+    } else if (suffix == "M") {
+        number *= MiB;
+    } else if (suffix == "G") {
+        number *= GiB;
+    } else if (!suffix.empty()) {
+        return false;
+    }
+    *it->second = number;
+    return true;
+}
+
+bool LoadGeometryProfile(const std::string& path, GeometryProfile* profile) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Could not open geometry profile " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    for (uint64_t lineNumber = 1; std::getline(file, line); ++lineNumber) {
+        line = line.substr(0, line.find('#'));
+
+        std::string key, equals, value;
+        std::istringstream tokens(line);
+        if (!(tokens >> key)) {
+            continue;
+        }
+        if (!(tokens >> equals >> value) || equals != "=" ||
+            !ApplySetting(key, value, profile)) {
+            std::cerr << path << ":" << lineNumber << ": invalid setting \""
+                      << line << "\"" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checks that "profile" describes a geometry the construction can work with.
+void ValidateGeometryProfile(const GeometryProfile& profile) {
+    assert(profile.llcBanks > 0 && profile.llcBanks <= MAX_LLC_BANKS);
+    assert(profile.waysPerBank > 0);
+
+    // The set index must be a contiguous bit field, and inside a 2 MiB page
+    // so that virtual addresses tell it.
+    assert(profile.setsPerBank > 0 &&
+           (profile.setsPerBank & (profile.setsPerBank - 1)) == 0);
+    assert(profile.setsPerBank * CACHE_LINE_SIZE <= 2 * MiB);
+
+    // Private caches index with the low bits of the LLC set index, so that
+    // private eviction sets can be at another LLC set index.
+    assert(profile.l1Ways > 0 && profile.l2Ways > 0);
+    assert(profile.l1Sets > 0 && (profile.l1Sets & (profile.l1Sets - 1)) == 0);
+    assert(profile.l2Sets > 0 && (profile.l2Sets & (profile.l2Sets - 1)) == 0);
+    assert(profile.l1Sets <= profile.l2Sets &&
+           profile.l2Sets < profile.setsPerBank);
+
+    // Enough candidates per set index for two full conflict sets.
+    assert(profile.arraySize % (2 * MiB) == 0);
+    assert(profile.ArrayEntries() / profile.setsPerBank >=
+           2 * profile.ConflictSetSize());
+
+    assert(profile.probeCyclesMin < profile.llcCycleThreshold &&
+           profile.llcCycleThreshold < profile.probeCyclesMax);
+}
+
+GeometryProfile* activeProfile = nullptr;
+
+const GeometryProfile& Geometry() {
+    if (activeProfile != nullptr) {
+        return *activeProfile;
+    }
+
+    GeometryProfile profile;
+    const bool found = GetBuiltinGeometryProfile(DetectProfileName(), &profile);
+    assert(found);
+
+    if (profile.slicePerCore) {
+        const uint64_t cores = CoresInFirstPackage();
+        if (cores > 0) {
+            profile.llcBanks = cores;
+        }
+    }
+
+    const char* path = getenv(PROFILE_ENVIRONMENT_VARIABLE);
+    if (path != nullptr && *path != '\0') {
+        const bool loaded = LoadGeometryProfile(path, &profile);
+        assert(loaded);
+    }
+
+    SetGeometryProfile(profile);
+    PrintGeometryProfile(*activeProfile);
+
+    return *activeProfile;
+}
+
+void SetGeometryProfile(const GeometryProfile& profile) {
+    ValidateGeometryProfile(profile);
+
+    if (activeProfile == nullptr) {
+        activeProfile = new GeometryProfile;
+    }
+    *activeProfile = profile;
+}
+
+void PrintGeometryProfile(const GeometryProfile& profile) {
+    std::cout << "Geometry profile " << profile.name << ": "
+              << profile.llcBanks << " banks, " << profile.waysPerBank
+              << " ways, " << profile.setsPerBank << " sets per bank, "
+              << "L1 " << profile.l1Sets << "x" << profile.l1Ways << ", L2 "
+              << profile.l2Sets << "x" << profile.l2Ways << ", "
+              << (profile.inclusive ? "inclusive" : "non-inclusive")
+              << ", " << (profile.sliceHash == SliceHash::COMPLEX ?
+                          "complex" : "low-order-xor")
+              << " slice hash, LLC shared by "
+              << (profile.coresPerLlc == 0 ?
+                  std::string("the package") :
+                  std::to_string(profile.coresPerLlc) + " cores")
+              << std::endl;
+}
+
+bool SameGeometryProfile(const GeometryProfile& a, const GeometryProfile& b) {
+    auto fields = [](const GeometryProfile& p) {
+        return std::tie(p.name, p.llcBanks, p.waysPerBank, p.setsPerBank,
+                        p.l1Sets, p.l1Ways, p.l2Sets, p.l2Ways, p.inclusive,
+                        p.sliceHash, p.slicePerCore, p.coresPerLlc,
+                        p.arraySize, p.llcCycleThreshold, p.probeCyclesMin,
+                        p.probeCyclesMax, p.candidateCyclesMin,
+                        p.candidateCyclesMax, p.conflictSetCyclesMin,
+                        p.conflictSetCyclesMax, p.evictionSetCyclesMin,
+                        p.evictionSetCyclesMax);
+    };
+    return fields(a) == fields(b);
+}
+
+// Parses a sysfs CPU list such as "0-3,24-27".
+std::vector<int> ParseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        const size_t dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = dash == std::string::npos ?
+            first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+int LlcSharingCore(int coreID) {
+    const std::string cpu = "/sys/devices/system/cpu/cpu" +
+        std::to_string(coreID);
+    const std::string shared =
+        ReadFirstLine(cpu + "/cache/index3/shared_cpu_list");
+    const std::string siblings =
+        ReadFirstLine(cpu + "/topology/thread_siblings_list");
+    if (shared.empty() || siblings.empty()) {
+        return -1;
+    }
+
+    const std::vector<int> siblingCores = ParseCpuList(siblings);
+    for (int core : ParseCpuList(shared)) {
+        if (std::find(siblingCores.begin(), siblingCores.end(), core) ==
+            siblingCores.end()) {
+            return core;
+        }
+    }
+    return -1;
+}
+
+std::vector<int> LlcSharingCores(int coreID) {
+    const std::string shared = ReadFirstLine(
+        "/sys/devices/system/cpu/cpu" + std::to_string(coreID) +
+        "/cache/index3/shared_cpu_list");
+    if (shared.empty()) {
+        return {coreID};
+    }
+    return ParseCpuList(shared);
+}
+
+std::vector<int> LlcPhysicalCores(int coreID) {
+    std::vector<int> cores;
+    std::set<int> covered;
+    for (int core : LlcSharingCores(coreID)) {
+        const std::string siblings = ReadFirstLine(
+            "/sys/devices/system/cpu/cpu" + std::to_string(core) +
+            "/topology/thread_siblings_list");
+        const std::vector<int> siblingCores = siblings.empty() ?
+            std::vector<int>{core} : ParseCpuList(siblings);
+        const bool own = std::find(siblingCores.begin(), siblingCores.end(),
+                                   coreID) != siblingCores.end();
+        if (covered.count(core) == 0) {
+            cores.push_back(own ? coreID : core);
+            covered.insert(siblingCores.begin(), siblingCores.end());
+        }
+    }
+    std::sort(cores.begin(), cores.end());
+    return cores;
+}
+
+int UnusedCore(const std::vector<int>& exclude) {
+    for (int core : AllowedCores()) {
+        if (std::find(exclude.begin(), exclude.end(), core) == exclude.end()) {
+            return core;
+        }
+    }
+    return -1;
+}
+
+bool RunningUnderHypervisor() {
+    uint32_t eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ecx >> 31) & 1;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+
+// Upper bound on LLC slices per profile, for fixed-size tables (e.g., in the
+// shared eviction set descriptor).
+const uint64_t MAX_LLC_BANKS = 64;
+
+// How physical addresses are spread over the slices. Only a hint: the slice of
+// an address is always found by probing, never computed.
+enum class SliceHash {
+    // Intel's undocumented hash over the physical address bits above the line
+    // offset (ring and mesh parts).
+    COMPLEX,
+    // AMD's hash over low physical address bits, within one CCX/CCD L3.
+    LOW_ORDER_XOR,
+};
+
+// LLC geometry of one processor model, as seen from one core. "Banks" are the
+// LLC slices that core shares (Intel: one per core of the package, each behind
+// a ring stop or a CHA; AMD: the slices of the CCX/CCD L3).
+struct GeometryProfile {
+    std::string name;
+
+    uint64_t llcBanks;
+    uint64_t waysPerBank;
+    uint64_t setsPerBank;
+
+    // Data L1 and L2 of each core. Both are indexed by the address bits right
+    // above the line offset, which are also the low bits of the LLC set index.
+    // Sizes the private eviction sets (see FindPrivateEvictionSet()).
+    uint64_t l1Sets;
+    uint64_t l1Ways;
+    uint64_t l2Sets;
+    uint64_t l2Ways;
+
+    // Inclusive LLCs are probed from the attacker core alone. Non-inclusive
+    // ones use ProbeStrategy::CROSS_CORE, and "waysPerBank" is then the
+    // associativity that has to be overfilled to evict a line from a helper
+    // core's L2 (the snoop filter ways on Intel).
+    bool inclusive;
+
+    SliceHash sliceHash;
+
+    // Core-to-slice relationship. If "slicePerCore" is set, "llcBanks" is
+    // replaced by the number of physical cores of the package at startup.
+    // "coresPerLlc" is the number of cores sharing one LLC (0: the whole
+    // package).
+    bool slicePerCore;
+    uint64_t coresPerLlc;
+
+    // Bytes to allocate for candidates. Must be at least twice the LLC size,
+    // so that every set index has enough candidates.
+    uint64_t arraySize;
+
+    // Access time above which a probed line missed in the LLC.
+    uint64_t llcCycleThreshold;
+
+    // Plausible range of a single probe. Probe() retries outside of it.
+    uint64_t probeCyclesMin;
+    uint64_t probeCyclesMax;
+
+    // Bounds for the construction sanity checks (average cycles per access).
+    uint64_t candidateCyclesMin;
+    uint64_t candidateCyclesMax;
+    uint64_t conflictSetCyclesMin;
+    uint64_t conflictSetCyclesMax;
+    uint64_t evictionSetCyclesMin;
+    uint64_t evictionSetCyclesMax;
+
+    uint64_t ConflictSetSize() const { return llcBanks * waysPerBank; }
+    uint64_t ArrayEntries() const { return arraySize / CACHE_LINE_SIZE; }
+    // Address bits which select the set within a bank.
+    uint64_t SetIndexMask() const {
+        return (setsPerBank - 1) << NUM_CACHE_LINE_BITS;
+    }
+};
+
+// The profile of the processor this program runs on. Selected on first use
+// from the built-in profiles by CPUID vendor, family and model, then
+// overridden from the file named by $LLC_GEOMETRY_PROFILE, if set. See
+// docs/geometryProfiles.txt for the file format.
+const GeometryProfile& Geometry();
+
+// Replaces the active profile, e.g., from a command line option. Must be
+// called before any eviction sets are built.
+void SetGeometryProfile(const GeometryProfile& profile);
+
+// Returns the built-in profile "name" in "*profile", or false if there is none.
+bool GetBuiltinGeometryProfile(const std::string& name,
+                               GeometryProfile* profile);
+
+// Applies the "key = value" lines of the file at "path" on top of "*profile".
+// Returns false (and reports why) on unknown keys or malformed values.
+bool LoadGeometryProfile(const std::string& path, GeometryProfile* profile);
+
+void PrintGeometryProfile(const GeometryProfile& profile);
+
+// True if "a" and "b" have the same name and values.
+bool SameGeometryProfile(const GeometryProfile& a, const GeometryProfile& b);
+
+// Returns a core other than "coreID" (and its hyperthread siblings) which
+// shares the LLC with it, or -1 if there is none.
+int LlcSharingCore(int coreID);
+
+// Returns every core which shares the LLC with "coreID", including it, in
+// ascending order. Only "coreID" if sysfs does not list the LLC.
+std::vector<int> LlcSharingCores(int coreID);
+
+// Same as LlcSharingCores(), but only one hyperthread per physical core:
+// "coreID" for its own, the lowest-numbered one for the others.
+std::vector<int> LlcPhysicalCores(int coreID);
+
+// Returns an online core the process may run on (see AllowedCores()) which is
+// not in "exclude", or -1 if there is none. Works from pinned threads too.
+int UnusedCore(const std::vector<int>& exclude);
+
+// True if CPUID reports a hypervisor.
+bool RunningUnderHypervisor();
@@ -0,0 +1,285 @@
+#include <cassert>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "constants.h"
+#include "hugePages.h"
+
+// Collapses a range into huge pages synchronously (Linux 6.1+). Missing from
+// older headers.
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
+const char* const THP_ENABLED_PATH =
+    "/sys/kernel/mm/transparent_hugepage/enabled";
+
+const uint64_t SMALL_PAGES_PER_HUGE_PAGE = HUGE_PAGE_SIZE / SMALL_PAGE_SIZE;
+
+// Fields of a /proc/self/pagemap entry.
+const uint64_t PAGEMAP_PRESENT = 1ULL << 63;
+const uint64_t PAGEMAP_PFN_MASK = (1ULL << 55) - 1;
+
+// An array allocated in THP mode. The mapping has a PROT_NONE guard region on
+// each side of the array, so that the array never merges with a neighboring
+// mapping and has an smaps entry of its own.
+struct ThpArray {
+    char* mapping;
+    uint64_t mappingSize;
+    uint64_t size;
+    std::vector<bool> hugeRegions;
+};
+
+// Keyed by array address. bankTelemetry allocates one array per socket in
+// parallel.
+std::map<const Node*, ThpArray> thpArrays;
+std::mutex thpArraysMutex;
+
+uint64_t RoundUpToHugePage(uint64_t size) {
+    return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+// Returns the active THP mode ("always", "madvise" or "never"), or "" if the
+// kernel has no THP support.
+std::string ThpMode() {
+    std::ifstream file(THP_ENABLED_PATH);
+    std::string word;
+    while (file >> word) {
+        if (word.size() > 2 && word.front() == '[' && word.back() == ']') {
+            return word.substr(1, word.size() - 2);
+        }
+    }
+    return "";
+}
+
+// A region is on a huge page if its small pages are present and physically
+// contiguous from a huge page frame. Returns false if the frame numbers are
+// hidden (they read as zero without CAP_SYS_ADMIN).
+bool CheckRegionsByPagemap(ThpArray* array, const char* start) {
+    const int fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::vector<uint64_t> entries(SMALL_PAGES_PER_HUGE_PAGE);
+    const uint64_t entriesSize = entries.size() * sizeof(uint64_t);
+    bool visible = true;
+    for (uint64_t r = 0; r < array->hugeRegions.size() && visible; ++r) {
+        const uint64_t address =
+            reinterpret_cast<uintptr_t>(start) + r * HUGE_PAGE_SIZE;
+        const off_t offset = address / SMALL_PAGE_SIZE * sizeof(uint64_t);
+        if (pread(fd, entries.data(), entriesSize, offset) !=
+            static_cast<ssize_t>(entriesSize)) {
+            visible = false;
+            break;
+        }
+
+        const uint64_t firstFrame = entries[0] & PAGEMAP_PFN_MASK;
+        bool huge = firstFrame % SMALL_PAGES_PER_HUGE_PAGE == 0;
+        for (uint64_t i = 0; i < entries.size(); ++i) {
+            const uint64_t frame = entries[i] & PAGEMAP_PFN_MASK;
+            if ((entries[i] & PAGEMAP_PRESENT) && frame == 0) {
+                visible = false;
+            }
+            huge = huge && (entries[i] & PAGEMAP_PRESENT) &&
+                frame == firstFrame + i;
+        }
+        array->hugeRegions[r] = huge;
+    }
+    close(fd);
+
+    return visible;
+}
+
+// Returns the AnonHugePages of the mapping which starts at "start", in bytes.
+uint64_t AnonHugePageBytes(const char* start) {
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool inMapping = false;
+    while (std::getline(smaps, line)) {
+        // Each mapping starts with its address range, e.g.,
+        // "7f2c00000000-7f2c40000000 rw-p 00000000 00:00 0".
+        std::istringstream header(line);
+        uint64_t from = 0;
+        uint64_t to = 0;
+        char dash = 0;
+        if (header >> std::hex >> from >> dash >> to && dash == '-') {
+            inMapping = from == reinterpret_cast<uintptr_t>(start);
+            continue;
+        }
+
+        const std::string field = "AnonHugePages:";
+        if (inMapping && line.compare(0, field.size(), field) == 0) {
+            std::istringstream value(line.substr(field.size()));
+            uint64_t kib = 0;
+            value >> kib;
+            return kib * KiB;
+        }
+    }
+    return 0;
+}
+
+// Without access to frame numbers, smaps only tells how much of the array is
+// huge, not where. All regions count if all of it is, none otherwise.
+void CheckRegionsBySmaps(ThpArray* array, const char* start) {
+    const bool allHuge = AnonHugePageBytes(start) >= array->size;
+    array->hugeRegions.assign(array->hugeRegions.size(), allHuge);
+}
+
+// Returns the method used ("pagemap" or "smaps").
+std::string CheckRegions(ThpArray* array, const char* start) {
+    if (CheckRegionsByPagemap(array, start)) {
+        return "pagemap";
+    }
+    CheckRegionsBySmaps(array, start);
+    return "smaps";
+}
+
+uint64_t CountHugeRegions(const ThpArray& array) {
+    uint64_t count = 0;
+    for (bool huge : array.hugeRegions) {
+        count += huge;
+    }
+    return count;
+}
+
+Node* AllocateCandidateArray(uint64_t size) {
+    const uint64_t arraySize = RoundUpToHugePage(size);
+
+    if (getenv("HUGETLB_MORECORE") != nullptr) {
+        // libhugetlbfs backs the heap.
+        return static_cast<Node*>(aligned_alloc(HUGE_PAGE_SIZE, arraySize));
+    }
+
+    const std::string mode = ThpMode();
+    if (mode != "always" && mode != "madvise") {
+        std::cout << "Warning: transparent huge pages are unavailable ("
+                  << THP_ENABLED_PATH << ": "
+                  << (mode.empty() ? "missing" : mode)
+                  << "), few candidates will be usable" << std::endl;
+    }
+
+    // Room for aligning the array, plus the guard regions.
+    ThpArray array;
+    array.size = arraySize;
+    array.mappingSize = arraySize + 3 * HUGE_PAGE_SIZE;
+    array.mapping = static_cast<char*>(
+        mmap(nullptr, array.mappingSize, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+    assert(array.mapping != MAP_FAILED);
+
+    char* start = reinterpret_cast<char*>(RoundUpToHugePage(
+        reinterpret_cast<uintptr_t>(array.mapping) + HUGE_PAGE_SIZE));
+    int result = mprotect(start, arraySize, PROT_READ | PROT_WRITE);
+    assert(result == 0);
+    madvise(start, arraySize, MADV_HUGEPAGE);
+
+    // Fault in every page now, so that the huge pages are allocated before
+    // anything is timed.
+    volatile char* bytes = start;
+    for (uint64_t offset = 0; offset < arraySize; offset += SMALL_PAGE_SIZE) {
+        bytes[offset] = 0;
+    }
+
+    array.hugeRegions.assign(arraySize / HUGE_PAGE_SIZE, false);
+    std::string method = CheckRegions(&array, start);
+    if (CountHugeRegions(array) < array.hugeRegions.size() &&
+        madvise(start, arraySize, MADV_COLLAPSE) == 0) {
+        method = CheckRegions(&array, start);
+    }
+
+    std::cout << "Candidate array: " << CountHugeRegions(array) << " of "
+              << array.hugeRegions.size()
+              << " 2 MiB regions on transparent huge pages (checked in "
+              << method << ")" << std::endl;
+
+    Node* node = reinterpret_cast<Node*>(start);
+    std::lock_guard<std::mutex> lock(thpArraysMutex);
+    thpArrays[node] = std::move(array);
+
+    return node;
+}
+
+void FreeCandidateArray(Node* array) {
+    std::unique_lock<std::mutex> lock(thpArraysMutex);
+    auto it = thpArrays.find(array);
+    if (it == thpArrays.end()) {
+        lock.unlock();
+        free(array);
+        return;
+    }
+
+    munmap(it->second.mapping, it->second.mappingSize);
+    thpArrays.erase(it);
+}
+
+uint64_t ReleaseUnusedRegions(Node* array,
+                              const std::vector<const void*>& keep) {
+    std::lock_guard<std::mutex> lock(thpArraysMutex);
+    auto it = thpArrays.find(array);
+    if (it == thpArrays.end()) {
+        return 0;
+    }
+
+    ThpArray& thpArray = it->second;
+    const char* start = reinterpret_cast<const char*>(array);
+    std::vector<bool> used(thpArray.hugeRegions.size(), false);
+    for (const void* line : keep) {
+        const uint64_t offset = static_cast<const char*>(line) - start;
+        assert(offset < thpArray.size);
+        used[offset / HUGE_PAGE_SIZE] = true;
+    }
+
+    uint64_t released = 0;
+    for (uint64_t r = 0; r < used.size(); ++r) {
+        char* region = reinterpret_cast<char*>(array) + r * HUGE_PAGE_SIZE;
+        if (!used[r] && madvise(region, HUGE_PAGE_SIZE, MADV_DONTNEED) == 0) {
+            thpArray.hugeRegions[r] = false;
+            released += HUGE_PAGE_SIZE;
+        }
+    }
+    return released;
+}
+
+std::vector<bool> HugePageRegions(const Node* array, uint64_t size) {
+    std::lock_guard<std::mutex> lock(thpArraysMutex);
+    auto it = thpArrays.find(array);
+    if (it == thpArrays.end()) {
+        return std::vector<bool>(RoundUpToHugePage(size) / HUGE_PAGE_SIZE,
+                                 true);
+    }
+
+    assert(size <= it->second.size);
+    return it->second.hugeRegions;
+}
+
+std::vector<uint64_t> ReadFrames(const std::vector<Node*>& nodes) {
+    std::vector<uint64_t> frames(nodes.size(), 0);
+
+    const int fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0) {
+        return frames;
+    }
+
+    for (uint64_t i = 0; i < nodes.size(); ++i) {
+        const uint64_t page =
+            reinterpret_cast<uintptr_t>(nodes[i]) / SMALL_PAGE_SIZE;
+        uint64_t entry = 0;
+        if (pread(fd, &entry, sizeof(entry), page * sizeof(entry)) ==
+                sizeof(entry) && (entry & PAGEMAP_PRESENT)) {
+            frames[i] = entry & PAGEMAP_PFN_MASK;
+        }
+    }
+
+    close(fd);
+    return frames;
+}
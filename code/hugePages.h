@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "constants.h"
+
+// Candidate arrays backed by 2 MiB pages, so that the virtual address of a line
+// determines its LLC set index.
+//
+// Under libhugetlbfs (LD_PRELOAD=libhugetlbfs.so HUGETLB_MORECORE=yes) the heap
+// already is on huge pages, and arrays come from aligned_alloc(). Otherwise
+// they are anonymous mappings advised for transparent huge pages (THP), which
+// needs neither a hugetlbfs mount nor a preloaded library. THP is best effort,
+// so every 2 MiB region of the array is checked after prefaulting it.
+
+// Returns a HUGE_PAGE_SIZE-aligned array of "size" bytes, with every page
+// faulted in. Free with FreeCandidateArray().
+Node* AllocateCandidateArray(uint64_t size);
+
+void FreeCandidateArray(Node* array);
+
+// Gives the huge pages of the array at "array" which hold none of "keep" back
+// to the kernel, and returns how many bytes that was. They stay mapped and
+// read as zero if touched again. Only arrays allocated in THP mode are
+// released; for others this returns 0.
+uint64_t ReleaseUnusedRegions(Node* array,
+                              const std::vector<const void*>& keep);
+
+// One entry per HUGE_PAGE_SIZE region of the "size" bytes at "array": true if
+// the region is known to be on a single huge page. Arrays that were not
+// allocated in THP mode (libhugetlbfs, hugetlbfs files) are assumed to be.
+std::vector<bool> HugePageRegions(const Node* array, uint64_t size);
+
+// Reads the physical frame numbers of "nodes" from /proc/self/pagemap. Frames
+// read as 0 if the process lacks CAP_SYS_ADMIN.
+std::vector<uint64_t> ReadFrames(const std::vector<Node*>& nodes);
@@ -0,0 +1,370 @@
+// Spectral and periodicity analysis of attacker latency series, to spot
+// periodic interference (garbage collection, batch ticks, polling loops) and
+// tie it to a workload.
+//
+// Reads an access time file written by portAttack: one or more sections, each
+// a count followed by that many times (cycles per attacker iteration). The
+// constant_access_times files have one section; per_bank_access_times files
+// have one per victim bank. Each section is cut into overlapping windows,
+// which are analyzed in parallel:
+// - a Hann-windowed FFT of the detrended series gives the dominant period and
+//   the fraction of the power in it,
+// - the autocorrelation (through a zero-padded FFT) at that period tells
+//   whether it repeats,
+// - the duty cycle is the fraction of samples above the pressure threshold,
+//   the section's median plus THRESHOLD_MADS scaled median absolute
+//   deviations.
+// Every window's result goes to the output file:
+//   SECTION WINDOW_START PERIOD_SAMPLES PERIOD_CYCLES PEAK_POWER_FRACTION
+//   AUTOCORRELATION DUTY_CYCLE PERIODIC
+// Periods are in samples (attacker iterations) and in TSC cycles, since
+// consecutive samples are back to back. Files of portAttack --evict-private
+// hold single access times, with the private cache eviction between samples
+// left out, so with --evict-private the cycles are not known and written as
+// "-".
+//
+// e.g.
+// $ ./latencySpectrum ../results/constant_access_times_3_threads.txt
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+const uint64_t DEFAULT_WINDOW = 1 << 16;
+
+// Windows overlap by half.
+const uint64_t WINDOW_HOPS = 2;
+
+// Pressure threshold, in median absolute deviations above the median.
+const double DEFAULT_THRESHOLD_MADS = 3.0;
+
+// Scales the median absolute deviation to a standard deviation for normal
+// data.
+const double MAD_TO_STDDEV = 1.4826;
+
+// Shortest period considered (in samples); two samples is the Nyquist limit.
+const uint64_t MIN_PERIOD = 2;
+
+// A window counts as periodic if its autocorrelation at the dominant period
+// is at least this.
+const double PERIODIC_AUTOCORRELATION = 0.2;
+
+const char* const DEFAULT_OUTPUT_PATH = "../results/latency_spectrum.txt";
+
+using Complex = std::complex<double>;
+
+struct WindowResult {
+    uint64_t section;
+    uint64_t start;
+    double periodSamples;
+    // NAN if the samples are not back to back.
+    double periodCycles;
+    double peakPowerFraction;
+    double autocorrelation;
+    double dutyCycle;
+    bool periodic;
+};
+
+// In-place iterative radix-2 FFT. "values.size()" must be a power of two.
+// "inverse" computes the unscaled inverse transform.
+void Fft(std::vector<Complex>& values, bool inverse) {
+    const uint64_t n = values.size();
+    assert((n & (n - 1)) == 0);
+
+    for (uint64_t i = 1, j = 0; i < n; ++i) {
+        uint64_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(values[i], values[j]);
+        }
+    }
+
+    for (uint64_t length = 2; length <= n; length <<= 1) {
+        const double angle = 2 * M_PI / length * (inverse ? 1 : -1);
+        const Complex step(std::cos(angle), std::sin(angle));
+        for (uint64_t i = 0; i < n; i += length) {
+            Complex twiddle(1);
+            for (uint64_t k = 0; k < length / 2; ++k) {
+                const Complex even = values[i + k];
+                const Complex odd = values[i + k + length / 2] * twiddle;
+                values[i + k] = even + odd;
+                values[i + k + length / 2] = even - odd;
+                twiddle *= step;
+            }
+        }
+    }
+}
+
+double Median(std::vector<double> values) {
+    assert(!values.empty());
+    std::nth_element(values.begin(), values.begin() + values.size() / 2,
+                     values.end());
+    return values[values.size() / 2];
+}
+
+// Reads every section of an access time file.
+std::vector<std::vector<double>> ReadSections(const std::string& path) {
+    std::ifstream file(path);
+    assert(file.is_open());
+
+    std::vector<std::vector<double>> sections;
+    uint64_t count = 0;
+    while (file >> count) {
+        std::vector<double> section(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            file >> section[i];
+        }
+        assert(file);
+        sections.push_back(std::move(section));
+    }
+    return sections;
+}
+
+WindowResult AnalyzeWindow(const std::vector<double>& samples,
+                           uint64_t section, uint64_t start, uint64_t window,
+                           double threshold, bool backToBack) {
+    WindowResult result;
+    result.section = section;
+    result.start = start;
+
+    double mean = 0;
+    uint64_t pressured = 0;
+    for (uint64_t i = 0; i < window; ++i) {
+        mean += samples[start + i] / window;
+        pressured += samples[start + i] > threshold;
+    }
+    result.dutyCycle = static_cast<double>(pressured) / window;
+
+    // Power spectrum of the Hann-windowed, detrended window.
+    std::vector<Complex> spectrum(window);
+    for (uint64_t i = 0; i < window; ++i) {
+        const double hann = 0.5 - 0.5 * std::cos(2 * M_PI * i / (window - 1));
+        spectrum[i] = (samples[start + i] - mean) * hann;
+    }
+    Fft(spectrum, false);
+
+    uint64_t peakBin = 1;
+    double peakPower = 0;
+    double totalPower = 0;
+    for (uint64_t bin = 1; bin <= window / 2; ++bin) {
+        const double power = std::norm(spectrum[bin]);
+        totalPower += power;
+        if (bin <= window / MIN_PERIOD && power > peakPower) {
+            peakPower = power;
+            peakBin = bin;
+        }
+    }
+    // Refines the peak between bins with a parabola through the log powers
+    // of the peak bin and its neighbours.
+    double peak = peakBin;
+    if (peakBin > 1 && peakBin < window / 2 &&
+        std::norm(spectrum[peakBin - 1]) > 0 &&
+        std::norm(spectrum[peakBin + 1]) > 0) {
+        const double before = std::log(std::norm(spectrum[peakBin - 1]));
+        const double at = std::log(peakPower);
+        const double after = std::log(std::norm(spectrum[peakBin + 1]));
+        const double curvature = before - 2 * at + after;
+        if (curvature < 0) {
+            peak += 0.5 * (before - after) / curvature;
+        }
+    }
+    result.periodSamples = window / peak;
+    result.periodCycles =
+        backToBack ? result.periodSamples * mean : NAN;
+    result.peakPowerFraction = totalPower > 0 ? peakPower / totalPower : 0;
+
+    // Autocorrelation of the detrended window, zero-padded to avoid circular
+    // wraparound, normalized to 1 at lag 0.
+    std::vector<Complex> padded(2 * window);
+    for (uint64_t i = 0; i < window; ++i) {
+        padded[i] = samples[start + i] - mean;
+    }
+    Fft(padded, false);
+    for (Complex& value : padded) {
+        value = std::norm(value);
+    }
+    Fft(padded, true);
+    const uint64_t lag = std::min<uint64_t>(
+        std::llround(result.periodSamples), window - 1);
+    result.autocorrelation =
+        padded[0].real() > 0 ? padded[lag].real() / padded[0].real() : 0;
+    result.periodic = result.autocorrelation >= PERIODIC_AUTOCORRELATION;
+
+    return result;
+}
+
+void PrintUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--window N] [--threads N]"
+              << " [--threshold-mads X] [--output PATH] [--evict-private]"
+              << " ACCESS_TIME_FILE"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t window = DEFAULT_WINDOW;
+    uint64_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+    double thresholdMads = DEFAULT_THRESHOLD_MADS;
+    std::string outputPath = DEFAULT_OUTPUT_PATH;
+    std::string inputPath;
+    bool evictPrivate = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--evict-private") {
+            evictPrivate = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            inputPath = arg;
+            break;
+        }
+
+        if (arg == "--window") {
+            window = std::stoull(argv[++i]);
+        } else if (arg == "--threads") {
+            numThreads = std::stoull(argv[++i]);
+        } else if (arg == "--threshold-mads") {
+            thresholdMads = std::stod(argv[++i]);
+        } else if (arg == "--output") {
+            outputPath = argv[++i];
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (inputPath.empty() || window < 2 * MIN_PERIOD ||
+        (window & (window - 1)) != 0 || numThreads == 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    const std::vector<std::vector<double>> sections = ReadSections(inputPath);
+
+    // Pressure thresholds, and the windows of every section.
+    std::vector<double> thresholds;
+    std::vector<std::pair<uint64_t, uint64_t>> windows;
+    for (uint64_t section = 0; section < sections.size(); ++section) {
+        const std::vector<double>& samples = sections[section];
+        thresholds.push_back(0);
+        if (samples.size() < window) {
+            std::cout << "Section " << section << " has " << samples.size()
+                      << " samples, fewer than one window" << std::endl;
+            continue;
+        }
+
+        const double median = Median(samples);
+        std::vector<double> deviations;
+        deviations.reserve(samples.size());
+        for (double sample : samples) {
+            deviations.push_back(std::fabs(sample - median));
+        }
+        thresholds.back() =
+            median + thresholdMads * MAD_TO_STDDEV * Median(deviations);
+
+        for (uint64_t start = 0; start + window <= samples.size();
+             start += window / WINDOW_HOPS) {
+            windows.emplace_back(section, start);
+        }
+    }
+
+    // Each thread takes the next window until none is left.
+    std::vector<WindowResult> results(windows.size());
+    std::atomic<uint64_t> next{0};
+    std::vector<std::thread> threads;
+    for (uint64_t t = 0; t < numThreads; ++t) {
+        threads.push_back(std::thread([&]() {
+            for (uint64_t i = next++; i < windows.size(); i = next++) {
+                const uint64_t section = windows[i].first;
+                results[i] = AnalyzeWindow(sections[section], section,
+                                           windows[i].second, window,
+                                           thresholds[section],
+                                           !evictPrivate);
+            }
+        }));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    std::ofstream output(outputPath);
+    assert(output.is_open());
+    for (const WindowResult& result : results) {
+        output << result.section << " " << result.start << " "
+               << result.periodSamples << " ";
+        if (std::isnan(result.periodCycles)) {
+            output << "-";
+        } else {
+            output << result.periodCycles;
+        }
+        output << " " << result.peakPowerFraction << " "
+               << result.autocorrelation
+               << " " << result.dutyCycle << " " << result.periodic
+               << std::endl;
+    }
+
+    // Per section: the most frequent dominant period of the periodic windows
+    // (in whole samples), and the average duty cycle.
+    std::cout << "section  windows  periodic  period (samples)  period (cycles)"
+              << "  duty cycle" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (uint64_t section = 0; section < sections.size(); ++section) {
+        std::map<uint64_t, uint64_t> periodCounts;
+        std::map<uint64_t, double> periodCycles;
+        uint64_t numWindows = 0;
+        uint64_t numPeriodic = 0;
+        double dutyCycle = 0;
+        for (const WindowResult& result : results) {
+            if (result.section != section) {
+                continue;
+            }
+            ++numWindows;
+            dutyCycle += result.dutyCycle;
+            if (result.periodic) {
+                ++numPeriodic;
+                const uint64_t period = std::llround(result.periodSamples);
+                ++periodCounts[period];
+                periodCycles[period] = result.periodCycles;
+            }
+        }
+        if (numWindows == 0) {
+            continue;
+        }
+
+        std::cout << std::setw(7) << section << std::setw(9) << numWindows
+                  << std::setw(10) << numPeriodic;
+        if (periodCounts.empty()) {
+            std::cout << std::setw(18) << "-" << std::setw(17) << "-";
+        } else {
+            const auto dominant = std::max_element(
+                periodCounts.begin(), periodCounts.end(),
+                [](const auto& a, const auto& b) {
+                    return a.second < b.second;
+                });
+            std::cout << std::setw(18) << dominant->first << std::setw(17);
+            if (evictPrivate) {
+                std::cout << "-";
+            } else {
+                std::cout << periodCycles[dominant->first];
+            }
+        }
+        std::cout << std::setw(12) << dutyCycle / numWindows << std::endl;
+    }
+
+    std::cout << "Wrote " << results.size() << " windows to " << outputPath
+              << std::endl;
+
+    return 0;
+}
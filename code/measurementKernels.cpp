@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <pthread.h>
+#include <thread>
+#include <vector>
+#include <x86intrin.h>
+
+#include "constants.h"
+#include "measurementKernels.h"
+
+// Enough lines to cover every remainder of the 8-way unrolled loops, but few
+// enough to stay in the L1.
+const uint64_t TEST_RING_SIZE = 61;
+const uint64_t OVERHEAD_SAMPLES = 1000;
+const uint64_t LATENCY_ACCESSES = 100000;
+
+// Samples per access type for TscResolvesCacheLevels().
+const uint64_t TSC_QUALITY_SAMPLES = 1000;
+// A DRAM access must take this many more cycles than an L1 hit...
+const uint64_t MIN_TSC_MISS_GAP = 50;
+// ...and the gap must be this many times the spread of L1 hit times.
+const uint64_t MIN_TSC_GAP_TO_SPREAD = 4;
+
+// Time over which the counting timer is calibrated against the TSC.
+const uint64_t COUNTING_TIMER_CALIBRATION_MS = 20;
+
+uint64_t SanityCheckMeasurementKernels() {
+    Node* ring = static_cast<Node*>(
+        aligned_alloc(CACHE_LINE_SIZE, TEST_RING_SIZE * sizeof(Node)));
+    const char* base = reinterpret_cast<const char*>(ring);
+    SharedNode* sharedRing = reinterpret_cast<SharedNode*>(ring);
+
+    // Link the ring in order with pointers, and check every chase length up to
+    // twice around the ring.
+    for (uint64_t i = 0; i < TEST_RING_SIZE; ++i) {
+        ring[i].next = &ring[(i + 1) % TEST_RING_SIZE];
+    }
+    for (uint64_t accesses = 0; accesses < 2 * TEST_RING_SIZE; ++accesses) {
+        assert(ChaseNodes(ring, accesses) ==
+               &ring[accesses % TEST_RING_SIZE]);
+
+        Node* node = ring;
+        TimedChase(&node, accesses);
+        assert(node == &ring[accesses % TEST_RING_SIZE]);
+    }
+
+    // The stamped chase must advance the node and produce increasing stamps.
+    std::vector<uint64_t> times(100);
+    Node* node = ring;
+    StampedChase(&node, times.size(), 7, times.data());
+    assert(node == &ring[(times.size() * 7) % TEST_RING_SIZE]);
+    for (uint64_t i = 1; i < times.size(); ++i) {
+        assert(times[i] > times[i - 1]);
+    }
+
+    // The evicted loads must advance both nodes, with one timed link per
+    // sample.
+    std::vector<uint64_t> latencies(times.size());
+    node = ring;
+    Node* evictionList = &ring[5];
+    StampedEvictedLoads(&node, &evictionList, 3, times.size(), times.data(),
+                        latencies.data());
+    assert(node == &ring[times.size() % TEST_RING_SIZE]);
+    assert(evictionList == &ring[(5 + 3 * times.size()) % TEST_RING_SIZE]);
+    for (uint64_t i = 1; i < times.size(); ++i) {
+        assert(times[i] > times[i - 1]);
+        assert(times[i] - times[i - 1] >= latencies[i]);
+    }
+
+    // The probe sequence must leave the set node where two chases would.
+    node = ring;
+    ProbeKernel(&node, ring, 5);
+    assert(node == &ring[10]);
+
+    // The counted kernels, with a counter which does not move.
+    const volatile uint64_t stoppedCounter = 0;
+    node = ring;
+    assert(CountedChase(&node, 13, &stoppedCounter) == 0);
+    assert(node == &ring[13]);
+    node = ring;
+    CountedProbeKernel(&node, ring, 5, &stoppedCounter);
+    assert(node == &ring[10]);
+    assert(CountedLoad(ring, &stoppedCounter) == 0);
+
+    // Now the same with offset links.
+    for (uint64_t i = 0; i < TEST_RING_SIZE; ++i) {
+        sharedRing[i].next = ((i + 1) % TEST_RING_SIZE) * sizeof(SharedNode);
+    }
+    for (uint64_t accesses = 0; accesses < 2 * TEST_RING_SIZE; ++accesses) {
+        assert(ChaseSharedNodes(base, sharedRing, accesses) ==
+               &sharedRing[accesses % TEST_RING_SIZE]);
+
+        SharedNode* sharedNode = sharedRing;
+        TimedSharedChase(base, &sharedNode, accesses);
+        assert(sharedNode == &sharedRing[accesses % TEST_RING_SIZE]);
+    }
+    SharedNode* sharedNode = sharedRing;
+    StampedSharedChase(base, &sharedNode, times.size(), 7, times.data());
+    assert(sharedNode == &sharedRing[(times.size() * 7) % TEST_RING_SIZE]);
+    for (uint64_t i = 1; i < times.size(); ++i) {
+        assert(times[i] > times[i - 1]);
+    }
+
+    // Overhead of the timestamps themselves.
+    for (uint64_t i = 0; i < TEST_RING_SIZE; ++i) {
+        ring[i].next = &ring[(i + 1) % TEST_RING_SIZE];
+    }
+    uint64_t overhead = -1;
+    uint64_t loadOverhead = -1;
+    for (uint64_t i = 0; i < OVERHEAD_SAMPLES; ++i) {
+        node = ring;
+        overhead = std::min(overhead, TimedChase(&node, 0));
+        loadOverhead = std::min(loadOverhead, TimedLoad(ring));
+    }
+
+    // An L1-resident chase costs the load-to-use latency per access (4-5
+    // cycles). If the loads were not dependent, they would overlap and cost
+    // well under one cycle each.
+    node = ring;
+    const double latency =
+        static_cast<double>(TimedChase(&node, LATENCY_ACCESSES) - overhead) /
+        LATENCY_ACCESSES;
+
+    std::cout << "Timestamp overhead: " << overhead
+              << " cycles, L1 load (with overhead): " << loadOverhead
+              << " cycles, L1 chase: " << latency << " cycles per access"
+              << std::endl;
+
+    // The TSC may tick slower than the core (e.g., with turbo), so only
+    // require clearly more than one TSC cycle per access.
+    assert(latency > 1.5);
+
+    std::cout << "Validated measurement kernels" << std::endl;
+
+    free(ring);
+
+    return overhead;
+}
+
+// Returns the "percentile" (0-100) of "samples".
+uint64_t Percentile(std::vector<uint64_t> samples, uint64_t percentile) {
+    std::sort(samples.begin(), samples.end());
+    return samples[(samples.size() - 1) * percentile / 100];
+}
+
+bool TscResolvesCacheLevels() {
+    Node* line = static_cast<Node*>(aligned_alloc(CACHE_LINE_SIZE,
+                                                  sizeof(Node)));
+    line->next = line;
+
+    std::vector<uint64_t> hits(TSC_QUALITY_SAMPLES);
+    std::vector<uint64_t> misses(TSC_QUALITY_SAMPLES);
+    for (uint64_t i = 0; i < TSC_QUALITY_SAMPLES; ++i) {
+        TimedLoad(line);
+        hits[i] = TimedLoad(line);
+
+        _mm_clflush(line);
+        _mm_mfence();
+        misses[i] = TimedLoad(line);
+    }
+    free(line);
+
+    const uint64_t hit = Percentile(hits, 50);
+    const uint64_t miss = Percentile(misses, 50);
+    const uint64_t spread = Percentile(hits, 90) - Percentile(hits, 10);
+    const bool resolves = miss > hit + MIN_TSC_MISS_GAP &&
+        miss - hit > MIN_TSC_GAP_TO_SPREAD * spread;
+
+    std::cout << "TSC: L1 hit " << hit << " cycles (spread " << spread
+              << "), DRAM " << miss << " cycles, "
+              << (resolves ? "usable" : "too coarse or noisy") << std::endl;
+
+    return resolves;
+}
+
+// State of the counting timer. The counter has a cache line to itself, since
+// the counting core writes it continuously.
+struct CountingTimer {
+    alignas(CACHE_LINE_SIZE) volatile uint64_t counter = 0;
+    alignas(CACHE_LINE_SIZE) volatile uint8_t stop = 0;
+    std::thread thread;
+    double ticksPerCycle = 0;
+
+    ~CountingTimer() {
+        stop = 1;
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+};
+
+// Each thread times with its own counting timer, which stops when the thread
+// exits.
+thread_local std::unique_ptr<CountingTimer> countingTimer;
+
+void RunCountingTimer(CountingTimer* timer, int coreID) {
+    // Set core affinity.
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(coreID, &cpuset);
+    pthread_t currentThread = pthread_self();
+    pthread_setaffinity_np(currentThread, sizeof(cpu_set_t), &cpuset);
+
+    CountingTimerLoop(&timer->counter, &timer->stop);
+}
+
+void StartCountingTimer(int coreID) {
+    assert(countingTimer == nullptr);
+    countingTimer = std::make_unique<CountingTimer>();
+    countingTimer->thread = std::thread(RunCountingTimer, countingTimer.get(),
+                                        coreID);
+
+    // Wait for the counter to start, then calibrate it against the TSC.
+    while (countingTimer->counter == 0) {
+        _mm_pause();
+    }
+    const uint64_t startTicks = countingTimer->counter;
+    const uint64_t startCycles = __rdtsc();
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(COUNTING_TIMER_CALIBRATION_MS));
+    const uint64_t ticks = countingTimer->counter - startTicks;
+    const uint64_t cycles = __rdtsc() - startCycles;
+
+    countingTimer->ticksPerCycle = static_cast<double>(ticks) / cycles;
+    assert(countingTimer->ticksPerCycle > 0);
+
+    std::cout << "Counting timer on core " << coreID << ": "
+              << countingTimer->ticksPerCycle << " ticks per TSC cycle"
+              << std::endl;
+}
+
+void StopCountingTimer() {
+    countingTimer.reset();
+}
+
+bool CountingTimerRunning() {
+    return countingTimer != nullptr;
+}
+
+const volatile uint64_t* CountingTimerCounter() {
+    assert(countingTimer != nullptr);
+    return &countingTimer->counter;
+}
+
+double CountingTimerTicksPerCycle() {
+    assert(countingTimer != nullptr);
+    return countingTimer->ticksPerCycle;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+
+#include "constants.h"
+#include "sharedEvictionSet.h"
+
+// Measurement kernels, written in assembly (measurementKernels.S) so that the
+// instructions between timestamps do not depend on the compiler.
+//
+// Uop footprint (fused domain, Broadwell):
+// - Node chase: 1 load uop per access. Blocks of 8 accesses add one
+//   macro-fused dec/jnz, i.e. 9 uops per 8 accesses.
+// - SharedNode chase: 1 load + 1 add per access (the add is on the dependency
+//   chain, so about 1 extra cycle per access), plus dec/jnz per 8 accesses.
+// - Timestamp pair: lfence, rdtsc, lfence before and rdtscp, lfence after the
+//   measured code (roughly 40 uops). Its cost is included in every timed
+//   result; SanityCheckMeasurementKernels() reports it.
+// - Evicted load: one timestamp pair around a single load per sample. The
+//   chase of the eviction list before it is outside the pair.
+
+extern "C" {
+
+// Follows "accesses" links from "node" and returns the node reached.
+Node* ChaseNodes(Node* node, uint64_t accesses);
+SharedNode* ChaseSharedNodes(const char* base, SharedNode* node,
+                             uint64_t accesses);
+
+// Returns the cycles taken to follow "accesses" links from "*node". "*node" is
+// advanced to the node reached.
+uint64_t TimedChase(Node** node, uint64_t accesses);
+uint64_t TimedSharedChase(const char* base, SharedNode** node,
+                          uint64_t accesses);
+
+// For each of "iterations" iterations, follows "accessesPerIteration" links
+// and stores a timestamp in "times" (lfence, chase, lfence, rdtsc, as the
+// attacker loop always did).
+void StampedChase(Node** node, uint64_t iterations,
+                  uint64_t accessesPerIteration, uint64_t* times);
+void StampedSharedChase(const char* base, SharedNode** node,
+                        uint64_t iterations, uint64_t accessesPerIteration,
+                        uint64_t* times);
+
+// For each of "samples" samples, follows "evictionAccesses" links of
+// "*evictionList" (e.g., lines which evict "*node" from the private caches,
+// see FindPrivateEvictionSet()), then times a single link from "*node". Stores
+// the access time in "latencies" and the timestamp after it in "times". Both
+// nodes are advanced.
+void StampedEvictedLoads(Node** node, Node** evictionList,
+                         uint64_t evictionAccesses, uint64_t samples,
+                         uint64_t* times, uint64_t* latencies);
+
+// The probe sequence of Probe(): follows "accesses" links, loads "candidate",
+// follows "accesses" links again and returns the cycles taken to reload
+// "candidate".
+uint64_t ProbeKernel(Node** set, const Node* candidate, uint64_t accesses);
+
+// Returns the cycles taken to load "line".
+uint64_t TimedLoad(const void* line);
+
+// Same as TimedChase(), ProbeKernel() and TimedLoad(), but timed with the
+// counter of a counting-thread timer (see StartCountingTimer()). Return
+// counter ticks.
+uint64_t CountedChase(Node** node, uint64_t accesses,
+                      const volatile uint64_t* counter);
+uint64_t CountedProbeKernel(Node** set, const Node* candidate,
+                            uint64_t accesses,
+                            const volatile uint64_t* counter);
+uint64_t CountedLoad(const void* line, const volatile uint64_t* counter);
+
+// Body of the counting thread: increments "*counter" until "*stop" is set.
+void CountingTimerLoop(volatile uint64_t* counter,
+                       const volatile uint8_t* stop);
+
+}
+
+// Returns true if rdtsc clearly separates an L1 hit from a DRAM access. Under
+// some hypervisors rdtsc traps or jitters too much for that.
+bool TscResolvesCacheLevels();
+
+// Starts a thread on "coreID" which counts in a loop, for timing where rdtsc
+// is unusable. Calibrates the counter against the TSC. The timer belongs to the
+// calling thread: the functions below refer to that thread's timer, and it
+// stops when the thread exits.
+void StartCountingTimer(int coreID);
+void StopCountingTimer();
+bool CountingTimerRunning();
+const volatile uint64_t* CountingTimerCounter();
+// Counter ticks per TSC cycle, to convert counted times to cycles.
+double CountingTimerTicksPerCycle();
+
+// Checks that the chase kernels follow links correctly and are serialized by
+// their dependency chain, and reports the timestamp overhead. Returns the
+// smallest measured overhead of an empty TimedChase().
+uint64_t SanityCheckMeasurementKernels();
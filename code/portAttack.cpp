@@ -1,9 +1,18 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <thread>
 #include <unistd.h>
 #include <vector>
@@ -11,6 +20,17 @@
 
 #include "constants.h"
 #include "constructingEvictionSet.h"
+#include "evictionSetHealth.h"
+#include "geometryProfile.h"
+#include "hugePages.h"
+#include "measurementKernels.h"
+#include "prefetcherControl.h"
+#include "raplEnergy.h"
+#include "setIndexSelection.h"
+#include "sharedEvictionSet.h"
+#include "toolUtils.h"
+#include "victimFootprint.h"
+#include "victimWorkloads.h"
 
 const uint64_t VICTIM_ITERATIONS = 5000000;
 const uint64_t ATTACKER_WARMUP_ACCESSES = 50000000;
@@ -20,19 +40,178 @@ const uint64_t ATTACKER_ACCESSES_PER_ITERATION = 100;
 // Run the attack once for every number of victim threads up to this value.
 const uint64_t MAX_NUM_VICTIM_THREADS = 10;
 
-// Cache sets can be arbitrary, as long as they are different.
+// Cache sets can be arbitrary, as long as they are different. With
+// --select-sets (threaded mode), they are only candidates, next to
+// SET_INDEX_SAMPLES - 2 random ones (see setIndexSelection.h).
 const uint64_t CACHE_SET_ATTACKER = 27;
 const uint64_t CACHE_SET_VICTIM = 1898;
+const uint64_t SET_INDEX_SAMPLES = 8;
+
+// With --victim-sets N, each victim bank segment accesses N eviction sets of
+// the bank, at set indices this far apart from CACHE_SET_VICTIM (see
+// victimFootprint.h).
+const uint64_t VICTIM_SET_INDEX_STRIDE = 97;
+
+// With --victim-workload, victims run a service-style kernel (see
+// victimWorkloads.h) over the lines of their bank's sets instead of chasing
+// them, VICTIM_ITERATIONS operations each. With --victim-spread, the kernel's
+// data is spread over the sets of all banks in every bank segment, as the
+// baseline for confining it to one bank.
+
+// With --evict-private, each attacker sample is a single access to its set,
+// timed after chasing lines which evict the set from the attacker core's L1 and
+// L2 (see FindPrivateEvictionSet()). Every sample is then an LLC access, on any
+// geometry, instead of relying on the set having more members than the L2 has
+// ways. Samples in isolation, to report the pure LLC access time.
+const uint64_t PURE_LLC_SAMPLES = 100000;
+
+// Attempts at matching the banks of an extra victim group, or of the victim
+// group to the attacker group for the sensitivity map, before giving up.
+const uint64_t BANK_MATCH_ATTEMPTS = 3;
+
+// Sensitivity map (--sensitivity-map): the attacker loop runs against every
+// bank of its group in turn, quiet and under the same reference load on each
+// victim bank. Victim threads of the reference load, and attacker iterations
+// per measurement.
+const uint64_t MAP_VICTIM_THREADS = 4;
+const uint64_t MAP_ITERATIONS = 20000;
+const char* const SENSITIVITY_MAP_PATH =
+    "../results/attacker_bank_sensitivity.txt";
+
+// The logical cores of the experiment, from the sysfs topology: those the
+// process may run on (see the taskset in the Makefile) which share the LLC
+// with the first of them. The attacker runs on the first, victims on the
+// following ones.
+struct ExperimentCoreList {
+    // One per physical core first, then their hyperthread siblings.
+    std::vector<int> cores;
+    uint64_t physicalCores;
+};
+
+// Read once, before any thread of the process is pinned.
+const ExperimentCoreList& ExperimentCores() {
+    static const ExperimentCoreList list = [] {
+        const std::vector<int> allowed = AllowedCores();
+        auto isAllowed = [&allowed](int core) {
+            return std::find(allowed.begin(), allowed.end(), core) !=
+                allowed.end();
+        };
+
+        ExperimentCoreList list;
+        for (int core : LlcPhysicalCores(allowed[0])) {
+            if (isAllowed(core)) {
+                list.cores.push_back(core);
+            }
+        }
+        list.physicalCores = list.cores.size();
+        for (int core : LlcSharingCores(allowed[0])) {
+            if (isAllowed(core) &&
+                std::find(list.cores.begin(), list.cores.end(), core) ==
+                list.cores.end()) {
+                list.cores.push_back(core);
+            }
+        }
+        return list;
+    }();
+    return list;
+}
 
-// Needs to match the logical cores being used in the Makefile.
-const uint64_t coreIDs[] = { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11,
-                            24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35};
+int ExperimentCore(uint64_t index) {
+    const std::vector<int>& cores = ExperimentCores().cores;
+    assert(index < cores.size());
+    return cores[index];
+}
 
 // Allocating this inside main (a few separate times) caused immediate
 // segfaults. I read this is possible from attempting to allocate data
 // structures larger than the stack. This structure isn't that big, but moving
 // it out and allocating it just this once did solve the problem.
 uint64_t attackerTimesArray[ATTACKER_TIMED_ITERATIONS];
+// Access time of each sample with --evict-private.
+uint64_t attackerLatenciesArray[ATTACKER_TIMED_ITERATIONS];
+
+// Conditions of the run, next to the access time files (which the graph
+// scripts read as plain numbers).
+const char* const RUN_METADATA_PATH = "../results/run_metadata.txt";
+
+// Energy of every phase of the sweep (see raplEnergy.h).
+const char* const ENERGY_PATH = "../results/energy_per_phase.txt";
+
+// Multi-process mode (--multi-process). The attacker and every victim run as
+// separate processes, each with its own address space and page tables, and
+// use the eviction sets published by buildSharedEvictionSets. The coordinator
+// drives the experiment through a shared control block.
+const char* const CONTROL_BLOCK_NAME = "/llcPortAttackControl";
+const uint64_t CONTROL_BLOCK_MAGIC = 0x4c4c43504f525431ULL;
+
+const uint64_t COMMAND_RUN = 1;
+const uint64_t COMMAND_EXIT = 2;
+
+// One per process, on its own cache line so that spinning processes do not
+// disturb each other.
+struct alignas(CACHE_LINE_SIZE) ProcessSlot {
+    std::atomic<uint64_t> ready;
+    // Generation of the last command this process finished.
+    std::atomic<uint64_t> doneGeneration;
+    // TSC stamps around this process's part of the last command.
+    uint64_t startTsc;
+    uint64_t endTsc;
+    uint64_t garbage;
+};
+
+// A command is published by writing its arguments and then incrementing the
+// generation. Processes spin on the generation.
+struct alignas(CACHE_LINE_SIZE) CommandChannel {
+    std::atomic<uint64_t> generation;
+    uint64_t command;
+    uint64_t bank;
+    uint64_t activeVictims;
+};
+
+struct ControlBlock {
+    uint64_t magic;
+    uint64_t closestBank;
+    CommandChannel attackerChannel;
+    CommandChannel victimChannel;
+    ProcessSlot attacker;
+    ProcessSlot victims[MAX_NUM_VICTIM_THREADS];
+    // Followed by ATTACKER_TIMED_ITERATIONS attacker TSC stamps, in the same
+    // format as "attackerTimesArray".
+};
+
+const uint64_t CONTROL_BLOCK_SIZE =
+    sizeof(ControlBlock) + ATTACKER_TIMED_ITERATIONS * sizeof(uint64_t);
+
+// Measurement kernels for either node layout. "base" is only used by
+// SharedNode, whose links are offsets into the shared mapping.
+inline Node* Chase(const char*, Node* node, uint64_t accesses) {
+    return ChaseNodes(node, accesses);
+}
+
+inline SharedNode* Chase(const char* base, SharedNode* node,
+                         uint64_t accesses) {
+    return ChaseSharedNodes(base, node, accesses);
+}
+
+inline uint64_t TimedChase(const char*, Node** node, uint64_t accesses) {
+    return TimedChase(node, accesses);
+}
+
+inline uint64_t TimedChase(const char* base, SharedNode** node,
+                           uint64_t accesses) {
+    return TimedSharedChase(base, node, accesses);
+}
+
+inline void StampedChase(const char*, Node** node, uint64_t iterations,
+                         uint64_t accessesPerIteration, uint64_t* times) {
+    StampedChase(node, iterations, accessesPerIteration, times);
+}
+
+inline void StampedChase(const char* base, SharedNode** node,
+                         uint64_t iterations, uint64_t accessesPerIteration,
+                         uint64_t* times) {
+    StampedSharedChase(base, node, iterations, accessesPerIteration, times);
+}
 
 double AverageAttackerTimes(const uint64_t* times) {
     double total = 0;
@@ -47,8 +226,222 @@ void CreateEvictionSets(Node** array, std::vector<Node*>* evictionSets,
     *evictionSets = GetEvictionSet(array, setIndex);
 }
 
-void GetAttackerClosestBank(std::vector<Node*> evictionSetsAttacker,
-                            uint64_t* garbage, int coreID,
+// Attacker access times of one measurement of the sensitivity map.
+struct AttackerSample {
+    // Cycles per attacker iteration (ATTACKER_ACCESSES_PER_ITERATION
+    // accesses).
+    double mean;
+    double variance;
+    double iterationsPerSecond;
+};
+
+void RunReferenceVictim(Node* node, int coreID, const std::atomic<bool>* stop,
+                        uint64_t* garbage) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(coreID, &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+
+    while (!stop->load(std::memory_order_relaxed)) {
+        node = ChaseNodes(node, VICTIM_ITERATIONS / 100);
+    }
+    *garbage += node->padding[0];
+}
+
+void SampleAttacker(Node* node, int coreID, AttackerSample* sample,
+                    uint64_t* garbage) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(coreID, &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+
+    std::vector<uint64_t> times(MAP_ITERATIONS);
+    node = ChaseNodes(node, ATTACKER_WARMUP_ACCESSES / 100);
+    const auto start = std::chrono::steady_clock::now();
+    StampedChase(&node, MAP_ITERATIONS, ATTACKER_ACCESSES_PER_ITERATION,
+                 times.data());
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    *garbage += node->padding[0];
+
+    double mean = 0;
+    for (uint64_t i = 1; i < MAP_ITERATIONS; ++i) {
+        mean += static_cast<double>(times[i] - times[i - 1]) /
+            (MAP_ITERATIONS - 1);
+    }
+    double variance = 0;
+    for (uint64_t i = 1; i < MAP_ITERATIONS; ++i) {
+        const double difference = times[i] - times[i - 1] - mean;
+        variance += difference * difference / (MAP_ITERATIONS - 1);
+    }
+
+    sample->mean = mean;
+    sample->variance = variance;
+    sample->iterationsPerSecond = MAP_ITERATIONS / seconds;
+}
+
+// Times the attacker on "attackerHead" while MAP_VICTIM_THREADS victims
+// chase "victimHead" (no victims if null).
+AttackerSample MeasureAttackerBank(Node* attackerHead, Node* victimHead,
+                                   uint64_t& garbage) {
+    std::atomic<bool> stop{false};
+    std::vector<uint64_t> garbageVictim(MAP_VICTIM_THREADS);
+    std::vector<std::thread> victims;
+    if (victimHead != nullptr) {
+        for (uint64_t i = 0; i < MAP_VICTIM_THREADS; ++i) {
+            victims.push_back(std::thread(RunReferenceVictim, victimHead,
+                                          ExperimentCore(1 + i), &stop,
+                                          &garbageVictim[i]));
+        }
+    }
+
+    AttackerSample sample;
+    std::thread attacker(SampleAttacker, attackerHead, ExperimentCore(0),
+                         &sample, &garbage);
+    attacker.join();
+
+    stop = true;
+    for (uint64_t i = 0; i < victims.size(); ++i) {
+        victims[i].join();
+        garbage += garbageVictim[i];
+    }
+    return sample;
+}
+
+// Standardized difference of the means (Cohen's d).
+double EffectSize(const AttackerSample& quiet, const AttackerSample& loaded) {
+    const double pooled = std::sqrt((quiet.variance + loaded.variance) / 2);
+    return pooled > 0 ? (loaded.mean - quiet.mean) / pooled : 0;
+}
+
+// The cores of the socket, one per physical core, for latency signatures.
+std::vector<int> SignatureCores() {
+    const ExperimentCoreList& list = ExperimentCores();
+    const uint64_t numCores =
+        std::min<uint64_t>(Geometry().llcBanks, list.physicalCores);
+    return std::vector<int>(list.cores.begin(),
+                            list.cores.begin() + numCores);
+}
+
+// Runs the sensitivity map and writes every attacker bank/victim bank pair to
+// SENSITIVITY_MAP_PATH:
+//   ATTACKER_BANK VICTIM_BANK QUIET_CYCLES LOADED_CYCLES EFFECT_SIZE
+//   ITERATIONS_PER_SECOND
+// Bank numbers are those of the attacker group's construction: the victim
+// sets are first matched to them (see MatchBanks()), so the diagonal is the
+// same bank.
+void RunSensitivityMap(const std::vector<Node*>& evictionSetsAttacker,
+                       std::vector<Node*> evictionSetsVictim,
+                       uint64_t closestBank, uint64_t& garbage) {
+    const uint64_t banks = Geometry().llcBanks;
+    std::ofstream file(SENSITIVITY_MAP_PATH);
+    assert(file.is_open());
+
+    const std::vector<int> cores = SignatureCores();
+    const std::vector<std::vector<double>> reference =
+        GroupLatencySignatures(evictionSetsAttacker, cores, garbage);
+    bool matched = false;
+    for (uint64_t attempt = 0; attempt < BANK_MATCH_ATTEMPTS && !matched;
+         ++attempt) {
+        matched = MatchBanks(reference, &evictionSetsVictim, cores, garbage);
+    }
+    assert(matched);
+    std::cout << "Matched the victim banks to the attacker banks" << std::endl;
+
+    std::cout << "Effect size (Cohen's d) per attacker bank (rows) and victim "
+              << "bank (columns), " << MAP_VICTIM_THREADS << " victims:"
+              << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+
+    uint64_t mostSensitiveBank = 0;
+    double mostSensitiveEffect = 0;
+    for (uint64_t attackerBank = 0; attackerBank < banks; ++attackerBank) {
+        const AttackerSample quiet = MeasureAttackerBank(
+            evictionSetsAttacker[attackerBank], nullptr, garbage);
+
+        std::cout << std::setw(3) << attackerBank
+                  << (attackerBank == closestBank ? "*" : " ");
+        double strongestEffect = 0;
+        for (uint64_t victimBank = 0; victimBank < banks; ++victimBank) {
+            const AttackerSample loaded = MeasureAttackerBank(
+                evictionSetsAttacker[attackerBank],
+                evictionSetsVictim[victimBank], garbage);
+            const double effect = EffectSize(quiet, loaded);
+            strongestEffect = std::max(strongestEffect, effect);
+
+            file << attackerBank << " " << victimBank << " " << quiet.mean
+                 << " " << loaded.mean << " " << effect << " "
+                 << loaded.iterationsPerSecond << std::endl;
+            std::cout << std::setw(6) << effect;
+        }
+        std::cout << "  (" << quiet.iterationsPerSecond / 1e3
+                  << " k samples/s quiet)" << std::endl;
+
+        if (strongestEffect > mostSensitiveEffect) {
+            mostSensitiveEffect = strongestEffect;
+            mostSensitiveBank = attackerBank;
+        }
+    }
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+
+    std::cout << "Closest attacker bank (*): " << closestBank
+              << ", most sensitive attacker bank: " << mostSensitiveBank
+              << " (effect size " << mostSensitiveEffect << ")" << std::endl;
+    std::cout << "Wrote " << SENSITIVITY_MAP_PATH << std::endl;
+}
+
+// Set indices of the victim footprint: "setVictim", then every
+// VICTIM_SET_INDEX_STRIDE sets, skipping "setAttacker".
+std::vector<uint64_t> VictimSetIndices(uint64_t victimSetsPerBank,
+                                       uint64_t setAttacker,
+                                       uint64_t setVictim) {
+    std::vector<uint64_t> setIndices = {setVictim};
+    uint64_t setIndex = setVictim;
+    while (setIndices.size() < victimSetsPerBank) {
+        setIndex = (setIndex + VICTIM_SET_INDEX_STRIDE) %
+            Geometry().setsPerBank;
+        assert(setIndex != setVictim);
+        if (setIndex != setAttacker) {
+            setIndices.push_back(setIndex);
+        }
+    }
+    return setIndices;
+}
+
+// Builds the victim groups after the first one, with their banks in the order
+// of "evictionSetsVictim".
+void CreateExtraVictimGroups(const std::vector<uint64_t>& setIndices,
+                             const std::vector<Node*>& evictionSetsVictim,
+                             std::vector<Node*>* arrays,
+                             std::vector<std::vector<Node*>>* groups,
+                             uint64_t& garbage) {
+    const std::vector<int> cores = SignatureCores();
+    const std::vector<std::vector<double>> reference =
+        GroupLatencySignatures(evictionSetsVictim, cores, garbage);
+
+    for (uint64_t i = 1; i < setIndices.size(); ++i) {
+        Node* array = nullptr;
+        std::vector<Node*> group;
+        CreateEvictionSets(&array, &group, setIndices[i]);
+
+        bool matched = false;
+        for (uint64_t attempt = 0;
+             attempt < BANK_MATCH_ATTEMPTS && !matched; ++attempt) {
+            matched = MatchBanks(reference, &group, cores, garbage);
+        }
+        assert(matched);
+        std::cout << "Matched the banks of victim set index " << setIndices[i]
+                  << std::endl;
+
+        arrays->push_back(array);
+        groups->push_back(group);
+    }
+}
+
+template <typename NodeType>
+void GetAttackerClosestBank(std::vector<NodeType*> evictionSetsAttacker,
+                            const char* base, uint64_t* garbage, int coreID,
                             uint64_t* closestBank) {
     // Set core affinity.
     cpu_set_t cpuset;
@@ -65,18 +458,10 @@ void GetAttackerClosestBank(std::vector<Node*> evictionSetsAttacker,
     // Enough iterations for a stable result.
     const uint64_t iterations = 10000000;
 
-    for (uint64_t bank = 0; bank < LLC_BANKS; ++bank) {
-        Node* node = evictionSetsAttacker[bank];
-
-        _mm_lfence();
-        time = __rdtsc();
+    for (uint64_t bank = 0; bank < Geometry().llcBanks; ++bank) {
+        NodeType* node = evictionSetsAttacker[bank];
 
-        for (uint64_t i = 0; i < iterations; ++i) {
-            node = node->next;
-        }
-
-        _mm_lfence();
-        time = __rdtsc() - time;
+        time = TimedChase(base, &node, iterations);
 
         if (time < shortestTime) {
             shortestTime = time;
@@ -91,8 +476,9 @@ void GetAttackerClosestBank(std::vector<Node*> evictionSetsAttacker,
               << static_cast<double>(shortestTime) / iterations << std::endl;
 }
 
-void IterateThroughSetAttacker(Node* node, uint64_t* times, uint64_t* garbage,
-                               int coreID) {
+template <typename NodeType>
+void IterateThroughSetAttacker(NodeType* node, const char* base,
+                               uint64_t* times, uint64_t* garbage, int coreID) {
     // Set core affinity.
     cpu_set_t cpuset;
     CPU_ZERO(&cpuset);
@@ -106,52 +492,130 @@ void IterateThroughSetAttacker(Node* node, uint64_t* times, uint64_t* garbage,
     // std::cout << ss.str();
 
     // Warmup iterations.
-    for (uint64_t i = 0; i < ATTACKER_WARMUP_ACCESSES; ++i) {
-        node = node->next;
-    }
+    node = Chase(base, node, ATTACKER_WARMUP_ACCESSES);
 
     // Timed iterations.
-    for (uint64_t i = 0; i < ATTACKER_TIMED_ITERATIONS; ++i) {
-        _mm_lfence();
+    StampedChase(base, &node, ATTACKER_TIMED_ITERATIONS,
+                 ATTACKER_ACCESSES_PER_ITERATION, times);
 
-        for (uint64_t j = 0; j < ATTACKER_ACCESSES_PER_ITERATION; ++j) {
-            node = node->next;
-        }
+    *garbage += node->padding[0];
 
-        _mm_lfence();
-        times[i] = __rdtsc();
+    std::cout << "Attacker finished" << std::endl;
+}
+
+// Links the lines which evict "setIndex" from the L1 and L2 of the core which
+// loads them into one list, and returns its length in "*size". Excludes the
+// members of "evictionSets" in "array". Chosen anew for each experiment, since
+// maintenance may have replaced members.
+Node* LinkPrivateEvictionList(Node* array, uint64_t setIndex,
+                              const std::vector<Node*>& evictionSets,
+                              uint64_t* size) {
+    std::vector<Node*> members;
+    for (Node* head : evictionSets) {
+        Node* node = head;
+        do {
+            members.push_back(node);
+            node = node->next;
+        } while (node != head);
     }
 
-    *garbage += node->padding[0];
+    std::vector<Node*> lines =
+        FindPrivateEvictionSet(array, setIndex, PrivateCache::L1, members);
+    members.insert(members.end(), lines.begin(), lines.end());
+    const std::vector<Node*> l2 =
+        FindPrivateEvictionSet(array, setIndex, PrivateCache::L2, members);
+    lines.insert(lines.end(), l2.begin(), l2.end());
 
-    std::cout << "Attacker finished" << std::endl;
+    *size = lines.size();
+    return LinkCandidates(lines);
 }
 
-void IterateThroughSetVictim(Node* node, uint64_t* time, uint64_t* garbage) {
-    // Perform the iterations.
-    _mm_lfence();
-    *time = __rdtsc();
+// Accesses of the private eviction list per sample: at least one pass, and
+// otherwise as many as a chase iteration has, so that the attacker runs as long
+// as the chase and outlasts the victims.
+uint64_t PrivateEvictionAccesses(uint64_t listSize) {
+    return std::max(listSize, ATTACKER_ACCESSES_PER_ITERATION);
+}
 
-    for (uint64_t i = 0; i < VICTIM_ITERATIONS; ++i) {
-        node = node->next;
-    }
+// IterateThroughSetAttacker() with --evict-private: "times" gets the timestamp
+// after each sample, and "latencies" its access time.
+void IterateThroughSetAttackerEvicted(Node* node, Node* evictionList,
+                                      uint64_t evictionAccesses,
+                                      uint64_t* times, uint64_t* latencies,
+                                      uint64_t* garbage, int coreID) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(coreID, &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+
+    node = ChaseNodes(node, ATTACKER_WARMUP_ACCESSES);
+
+    StampedEvictedLoads(&node, &evictionList, evictionAccesses,
+                        ATTACKER_TIMED_ITERATIONS, times, latencies);
 
-    _mm_lfence();
-    *time = __rdtsc() - *time;
+    *garbage += node->padding[0] + evictionList->padding[0];
+
+    std::cout << "Attacker finished" << std::endl;
+}
+
+// Reports the access time of the attacker's set in the LLC alone: the median of
+// PURE_LLC_SAMPLES evicted loads without victims, next to the timestamp
+// overhead included in it.
+void MeasurePureLlcLatency(Node* node, Node* evictionList,
+                           uint64_t evictionAccesses, uint64_t overhead,
+                           uint64_t* garbage, int coreID) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(coreID, &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+
+    std::vector<uint64_t> times(PURE_LLC_SAMPLES);
+    std::vector<uint64_t> latencies(PURE_LLC_SAMPLES);
+    StampedEvictedLoads(&node, &evictionList, evictionAccesses,
+                        PURE_LLC_SAMPLES, times.data(), latencies.data());
+    *garbage += node->padding[0] + evictionList->padding[0];
+
+    const uint64_t misses = std::count_if(
+        latencies.begin(), latencies.end(), [](uint64_t latency) {
+            return latency > Geometry().llcCycleThreshold;
+        });
+    std::nth_element(latencies.begin(),
+                     latencies.begin() + latencies.size() / 2,
+                     latencies.end());
+    const uint64_t median = latencies[latencies.size() / 2];
+
+    std::cout << "Pure LLC access time (private caches evicted): median "
+              << median << " cycles, " << median - std::min(median, overhead)
+              << " without the timestamp overhead of " << overhead
+              << " cycles, " << misses << " of " << PURE_LLC_SAMPLES
+              << " samples above the LLC threshold" << std::endl;
+}
+
+template <typename NodeType>
+void IterateThroughSetVictim(NodeType* node, const char* base, uint64_t* time,
+                             uint64_t* garbage) {
+    // Perform the iterations.
+    *time = TimedChase(base, &node, VICTIM_ITERATIONS);
 
     *garbage += node->padding[0];
 }
 
+void RunVictimWorkloadThread(const VictimWorkloadData* data, uint64_t thread,
+                             uint64_t* time, uint64_t* garbage) {
+    *time = RunVictimWorkload(*data, thread, VICTIM_ITERATIONS, garbage);
+}
+
 // NOTE: this function will probably segfault if the attacker finishes before
 // all the victims do. I should put a check for that.
-std::vector<uint64_t> SplitResultsIntoBanks(uint64_t victimBankBoundaries[24]) {
+std::vector<uint64_t> SplitResultsIntoBanks(
+    const uint64_t* times, const std::vector<uint64_t>& victimBankBoundaries) {
     std::vector<uint64_t> boundaries;
 
     // Current index into the attacker's accesses.
     uint64_t access = 0;
 
-    for (uint64_t bank = 0; bank < LLC_BANKS; ++bank) {
-        while (attackerTimesArray[access] < victimBankBoundaries[bank * 2]) {
+    for (uint64_t bank = 0; bank < Geometry().llcBanks; ++bank) {
+        while (times[access] < victimBankBoundaries[bank * 2]) {
             ++access;
         }
 
@@ -163,7 +627,7 @@ std::vector<uint64_t> SplitResultsIntoBanks(uint64_t victimBankBoundaries[24]) {
 
         // Find the last attacker access which occurred while the victim
         // accessed the first bank.
-        while (attackerTimesArray[access] < victimBankBoundaries[bank * 2 + 1]) {
+        while (times[access] < victimBankBoundaries[bank * 2 + 1]) {
             ++access;
         }
 
@@ -177,23 +641,575 @@ std::vector<uint64_t> SplitResultsIntoBanks(uint64_t victimBankBoundaries[24]) {
     return boundaries;
 }
 
+// Writes the attacker's results for one experiment: all access times, and the
+// access times split by the bank the victims accessed at the time. The access
+// times are "latencies" (--evict-private), or else the differences of "times".
+void WriteResults(const uint64_t* times, const uint64_t* latencies,
+                  uint64_t numVictimThreads,
+                  const std::vector<uint64_t>& victimBankBoundaries) {
+    auto accessTime = [&](uint64_t i) {
+        return latencies != nullptr ? latencies[i] : times[i] - times[i - 1];
+    };
+
+    // Create the output files. One which splits results by bank and another
+    // which outputs all times for the attacker.
+    std::ofstream filePerBank, fileConstant;
+    filePerBank.open("../results/per_bank_access_times_" +
+                     std::to_string(numVictimThreads) + "_threads.txt");
+    fileConstant.open("../results/constant_access_times_" +
+                      std::to_string(numVictimThreads) + "_threads.txt");
+    assert(filePerBank.is_open());
+    assert(fileConstant.is_open());
+
+    // Output each timing difference to file. Only output results that
+    // occurred during a victim access for "filePerBank".
+    std::cout << "Start writing to files" << std::endl;
+
+    // First write all times to "fileConstant".
+    fileConstant << ATTACKER_TIMED_ITERATIONS - 1 << std::endl;
+    for (uint64_t i = 1; i < ATTACKER_TIMED_ITERATIONS; ++i) {
+        fileConstant << accessTime(i) << std::endl;
+    }
+    fileConstant.close();
+
+    // Now write the per-bank results to "filePerBank".
+    //
+    // Corner case for 0 victim threads. Just write all results to file.
+    if (numVictimThreads == 0) {
+        // First output the number of results.
+        filePerBank << ATTACKER_TIMED_ITERATIONS - 1 << std::endl;
+
+        // Now output the actual results.
+        for (uint64_t i = 1; i < ATTACKER_TIMED_ITERATIONS; ++i) {
+            filePerBank << accessTime(i) << std::endl;
+        }
+
+        filePerBank.close();
+        std::cout << "Finish writing to files" << std::endl;
+
+        std::cout << "Finished experiment with " << numVictimThreads
+                  << " victim threads." << std::endl;
+
+        return;
+    }
+
+    // At least one victim thread. Determine boundaries.
+    std::vector<uint64_t> boundaries =
+        SplitResultsIntoBanks(times, victimBankBoundaries);
+
+    // Output results results per-bank.
+    for (uint64_t bank = 0; bank < Geometry().llcBanks; ++bank) {
+        // First output the number of attacker accesses which occurred while
+        // the victim accessed this bank.
+        const uint64_t accesses =
+            boundaries[2 * bank + 1] - boundaries[2 * bank] + 1;
+        filePerBank << accesses << std::endl;
+
+        // Then output values.
+        for (uint64_t i = boundaries[2 * bank];
+             i <= boundaries[2 * bank + 1]; ++i) {
+            filePerBank << accessTime(i) << std::endl;
+        }
+    }
+
+    filePerBank.close();
+    std::cout << "Finish writing to files" << std::endl;
+
+    std::cout << "Finished experiment with " << numVictimThreads
+              << " victim threads." << std::endl;
+}
+
+// Applies $LLC_PREFETCHERS to every core of the experiment. The MSRs are per
+// core, so in multi-process mode the coordinator covers the roles too.
+void ApplyPrefetcherModeToExperimentCores() {
+    ApplyPrefetcherMode(ExperimentCores().cores);
+}
+
+// Writes the conditions of the sweep to RUN_METADATA_PATH.
+void WriteRunMetadata(const std::string& mode, uint64_t setAttacker,
+                      const std::vector<uint64_t>& victimSetIndices,
+                      const std::string& victimWorkload,
+                      const std::string& attackerSamples) {
+    std::ofstream file(RUN_METADATA_PATH);
+    assert(file.is_open());
+    file << "mode: " << mode << std::endl;
+    file << "geometry profile: " << Geometry().name << std::endl;
+    file << "construction seed: " << ConstructionSeed() << std::endl;
+    file << "attacker set index: " << setAttacker << std::endl;
+    file << "victim set indices:";
+    for (uint64_t setIndex : victimSetIndices) {
+        file << " " << setIndex;
+    }
+    file << std::endl;
+    file << "victim workload: " << victimWorkload << std::endl;
+    file << "attacker samples: " << attackerSamples << std::endl;
+    file << "prefetchers: " << PrefetcherStateDescription() << std::endl;
+}
+
+std::string AttackerSamplesName(bool evictPrivate) {
+    return evictPrivate ?
+        "single LLC accesses, L1 and L2 evicted before each" :
+        std::to_string(ATTACKER_ACCESSES_PER_ITERATION) + "-access chases";
+}
+
+// Phase names are "construction", then for N victim threads
+// "threads_N_maintenance" (eviction set checks, threaded mode only),
+// "threads_N_warmup" (attacker warmup), "threads_N_bank_B" (victims on bank
+// B, with VICTIM_ITERATIONS accesses or workload operations per victim as
+// operations),
+// "threads_N_idle" (pauses between banks) and "threads_N_finish" (attacker
+// tail and writing results).
+std::string PhaseName(uint64_t numVictimThreads, const std::string& part) {
+    return "threads_" + std::to_string(numVictimThreads) + "_" + part;
+}
+
+void WriteEnergy(EnergyLog* energy) {
+    EndPhase(energy);
+    std::ofstream file(ENERGY_PATH);
+    assert(file.is_open());
+    file << "# phase seconds zone joules watts nanojoules_per_victim_access"
+         << std::endl;
+    WriteEnergyLog(*energy, file);
+    std::cout << "Wrote energy per phase to " << ENERGY_PATH << std::endl;
+}
+
+// Maps the multi-process control block. The coordinator creates it; the
+// attacker and victim processes attach to it.
+ControlBlock* MapControlBlock(bool create) {
+    const int flags = create ? O_CREAT | O_TRUNC | O_RDWR : O_RDWR;
+    const int fd = shm_open(CONTROL_BLOCK_NAME, flags, 0660);
+    if (fd < 0) {
+        return nullptr;
+    }
+    if (create && ftruncate(fd, CONTROL_BLOCK_SIZE) != 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void* map = mmap(nullptr, CONTROL_BLOCK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return nullptr;
+    }
+
+    ControlBlock* control = static_cast<ControlBlock*>(map);
+    if (!create && control->magic != CONTROL_BLOCK_MAGIC) {
+        munmap(map, CONTROL_BLOCK_SIZE);
+        return nullptr;
+    }
+    return control;
+}
+
+uint64_t* AttackerTimes(ControlBlock* control) {
+    return reinterpret_cast<uint64_t*>(control + 1);
+}
+
+void PublishCommand(CommandChannel* channel, uint64_t command, uint64_t bank,
+                    uint64_t activeVictims) {
+    channel->command = command;
+    channel->bank = bank;
+    channel->activeVictims = activeVictims;
+    channel->generation.fetch_add(1, std::memory_order_release);
+}
+
+// Spins until a command newer than "seen" is published. Returns its
+// generation.
+uint64_t WaitForCommand(const CommandChannel& channel, uint64_t seen) {
+    uint64_t generation;
+    while ((generation = channel.generation.load(std::memory_order_acquire)) ==
+           seen) {
+        _mm_pause();
+    }
+    return generation;
+}
+
+// Looks up one group of the shared eviction sets, one head per bank.
+bool AttachRoleEvictionSets(SharedEvictionSets* shared, uint64_t setIndex,
+                            std::vector<SharedNode*>* evictionSets) {
+    if (!AttachSharedEvictionSets(DEFAULT_SHARED_EVICTION_SET_PATH, shared)) {
+        return false;
+    }
+    for (uint64_t bank = 0; bank < Geometry().llcBanks; ++bank) {
+        SharedNode* head = SharedEvictionSetHead(*shared, setIndex, bank);
+        if (head == nullptr) {
+            return false;
+        }
+        evictionSets->push_back(head);
+    }
+    return true;
+}
+
+int RunAttackerProcess() {
+    ControlBlock* control = MapControlBlock(/*create=*/false);
+    SharedEvictionSets shared;
+    std::vector<SharedNode*> evictionSetsAttacker;
+    if (control == nullptr ||
+        !AttachRoleEvictionSets(&shared, CACHE_SET_ATTACKER,
+                                &evictionSetsAttacker)) {
+        std::cerr << "Attacker could not attach to the coordinator"
+                  << std::endl;
+        return 1;
+    }
+
+    // Fault in the times array now rather than during the timed loop.
+    uint64_t* times = AttackerTimes(control);
+    memset(times, 0, ATTACKER_TIMED_ITERATIONS * sizeof(uint64_t));
+
+    uint64_t garbage = 0;
+    GetAttackerClosestBank<SharedNode>(evictionSetsAttacker, shared.base,
+                                       &garbage, ExperimentCore(0),
+                                       &control->closestBank);
+    control->attacker.ready.store(1, std::memory_order_release);
+
+    uint64_t generation = 0;
+    while (true) {
+        generation = WaitForCommand(control->attackerChannel, generation);
+        if (control->attackerChannel.command == COMMAND_EXIT) {
+            break;
+        }
+
+        control->attacker.startTsc = __rdtsc();
+        IterateThroughSetAttacker<SharedNode>(
+            evictionSetsAttacker[control->closestBank], shared.base, times,
+            &garbage, ExperimentCore(0));
+        control->attacker.endTsc = __rdtsc();
+
+        control->attacker.doneGeneration.store(generation,
+                                               std::memory_order_release);
+    }
+
+    control->attacker.garbage = garbage;
+    DetachSharedEvictionSets(&shared);
+    munmap(control, CONTROL_BLOCK_SIZE);
+
+    return 0;
+}
+
+int RunVictimProcess(uint64_t id) {
+    assert(id < MAX_NUM_VICTIM_THREADS);
+
+    ControlBlock* control = MapControlBlock(/*create=*/false);
+    SharedEvictionSets shared;
+    std::vector<SharedNode*> evictionSetsVictim;
+    if (control == nullptr ||
+        !AttachRoleEvictionSets(&shared, CACHE_SET_VICTIM,
+                                &evictionSetsVictim)) {
+        std::cerr << "Victim " << id << " could not attach to the coordinator"
+                  << std::endl;
+        return 1;
+    }
+
+    // Unlike victim threads, victim processes stay alive (spinning) between
+    // banks, so pin each to its own core away from the attacker.
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(ExperimentCore(1 + id), &cpuset);
+    sched_setaffinity(0, sizeof(cpu_set_t), &cpuset);
+
+    ProcessSlot& slot = control->victims[id];
+    slot.ready.store(1, std::memory_order_release);
+
+    uint64_t garbage = 0;
+    uint64_t generation = 0;
+    while (true) {
+        generation = WaitForCommand(control->victimChannel, generation);
+        if (control->victimChannel.command == COMMAND_EXIT) {
+            break;
+        }
+
+        if (id < control->victimChannel.activeVictims) {
+            uint64_t time;
+            slot.startTsc = __rdtsc();
+            IterateThroughSetVictim<SharedNode>(
+                evictionSetsVictim[control->victimChannel.bank], shared.base,
+                &time, &garbage);
+            slot.endTsc = __rdtsc();
+        }
+
+        slot.doneGeneration.store(generation, std::memory_order_release);
+    }
+
+    slot.garbage = garbage;
+    DetachSharedEvictionSets(&shared);
+    munmap(control, CONTROL_BLOCK_SIZE);
+
+    return 0;
+}
+
+// Starts this program again as the given role. exec() gives the role a fresh
+// address space, as if it were launched separately.
+pid_t SpawnRole(const char* program, const char* role, uint64_t id) {
+    const pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        const std::string idString = std::to_string(id);
+        execl("/proc/self/exe", program, "--role", role, "--id",
+              idString.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    return pid;
+}
+
+// Runs the same sweep as the threaded mode in main(), with the attacker and
+// victims in separate processes. With "spawn" false, the roles are expected to
+// be launched separately (e.g., in other cgroups) with
+//   portAttack --role attacker
+//   portAttack --role victim --id N    (for N in 0..MAX_NUM_VICTIM_THREADS-1)
+int RunMultiProcessCoordinator(const char* program, bool spawn) {
+    EnergyLog energy;
+    InitEnergyLog(&energy);
+    BeginPhase(&energy, "construction");
+
+    // The roles only attach to the shared eviction sets. Build them here if
+    // buildSharedEvictionSets has not been run yet.
+    SharedEvictionSets shared;
+    if (!AttachSharedEvictionSets(DEFAULT_SHARED_EVICTION_SET_PATH, &shared) &&
+        !CreateSharedEvictionSets(DEFAULT_SHARED_EVICTION_SET_PATH,
+                                  {CACHE_SET_ATTACKER, CACHE_SET_VICTIM},
+                                  &shared)) {
+        return 1;
+    }
+    DetachSharedEvictionSets(&shared);
+
+    ApplyPrefetcherModeToExperimentCores();
+
+    ControlBlock* control = MapControlBlock(/*create=*/true);
+    if (control == nullptr) {
+        std::cerr << "Could not create the control block: " << strerror(errno)
+                  << std::endl;
+        return 1;
+    }
+    memset(static_cast<void*>(control), 0, sizeof(ControlBlock));
+    __atomic_store_n(&control->magic, CONTROL_BLOCK_MAGIC, __ATOMIC_RELEASE);
+
+    std::vector<pid_t> children;
+    if (spawn) {
+        children.push_back(SpawnRole(program, "attacker", 0));
+        for (uint64_t i = 0; i < MAX_NUM_VICTIM_THREADS; ++i) {
+            children.push_back(SpawnRole(program, "victim", i));
+        }
+    }
+
+    // Wait for every role to attach (and the attacker to find its bank).
+    bool allReady = false;
+    while (!allReady) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        allReady = control->attacker.ready.load(std::memory_order_acquire);
+        for (uint64_t i = 0; i < MAX_NUM_VICTIM_THREADS; ++i) {
+            allReady = allReady &&
+                control->victims[i].ready.load(std::memory_order_acquire);
+        }
+    }
+    std::cout << "Attacker and " << MAX_NUM_VICTIM_THREADS
+              << " victim processes attached." << std::endl;
+
+    const uint64_t* times = AttackerTimes(control);
+
+    for (uint64_t numVictimThreads = 0;
+         numVictimThreads <= MAX_NUM_VICTIM_THREADS; ++numVictimThreads) {
+        // Start and end of the victims' accesses to each bank.
+        std::vector<uint64_t> victimBankBoundaries(2 * Geometry().llcBanks);
+
+        // Start the attacker.
+        BeginPhase(&energy, PhaseName(numVictimThreads, "warmup"));
+        PublishCommand(&control->attackerChannel, COMMAND_RUN, 0, 0);
+        const uint64_t attackerGeneration =
+            control->attackerChannel.generation.load();
+
+        // Give some time for the warmup requests.
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+        if (numVictimThreads > 0) {
+            for (uint64_t bank = 0; bank < Geometry().llcBanks; ++bank) {
+                BeginPhase(&energy, PhaseName(numVictimThreads, "idle"));
+                std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+                BeginPhase(&energy,
+                           PhaseName(numVictimThreads,
+                                     "bank_" + std::to_string(bank)),
+                           numVictimThreads * VICTIM_ITERATIONS);
+                PublishCommand(&control->victimChannel, COMMAND_RUN, bank,
+                               numVictimThreads);
+                const uint64_t generation =
+                    control->victimChannel.generation.load();
+
+                for (uint64_t i = 0; i < MAX_NUM_VICTIM_THREADS; ++i) {
+                    while (control->victims[i].doneGeneration.load(
+                               std::memory_order_acquire) != generation) {
+                        _mm_pause();
+                    }
+                }
+
+                // The bank's boundaries are the victims' own TSC stamps, so
+                // process wakeup latency does not widen them.
+                victimBankBoundaries[2 * bank] = -1;
+                victimBankBoundaries[2 * bank + 1] = 0;
+                for (uint64_t i = 0; i < numVictimThreads; ++i) {
+                    victimBankBoundaries[2 * bank] =
+                        std::min(victimBankBoundaries[2 * bank],
+                                 control->victims[i].startTsc);
+                    victimBankBoundaries[2 * bank + 1] =
+                        std::max(victimBankBoundaries[2 * bank + 1],
+                                 control->victims[i].endTsc);
+                }
+            }
+
+            std::cout << "Victim(s) done" << std::endl;
+        }
+
+        BeginPhase(&energy, PhaseName(numVictimThreads, "finish"));
+        while (control->attacker.doneGeneration.load(
+                   std::memory_order_acquire) != attackerGeneration) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        WriteResults(times, nullptr, numVictimThreads, victimBankBoundaries);
+    }
+
+    PublishCommand(&control->attackerChannel, COMMAND_EXIT, 0, 0);
+    PublishCommand(&control->victimChannel, COMMAND_EXIT, 0, 0);
+    for (pid_t child : children) {
+        waitpid(child, nullptr, 0);
+    }
+    WriteRunMetadata("multi-process", CACHE_SET_ATTACKER,
+                     {CACHE_SET_VICTIM}, "chase",
+                     AttackerSamplesName(/*evictPrivate=*/false));
+    WriteEnergy(&energy);
+
+    uint64_t finalGarbage = control->attacker.garbage;
+    for (uint64_t i = 0; i < MAX_NUM_VICTIM_THREADS; ++i) {
+        finalGarbage += control->victims[i].garbage;
+    }
+    std::cout << "All done! (Garbage:" << finalGarbage << ")" << std::endl;
+
+    munmap(control, CONTROL_BLOCK_SIZE);
+    shm_unlink(CONTROL_BLOCK_NAME);
+
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
+    std::cout << "Experiment cores:";
+    for (int core : ExperimentCores().cores) {
+        std::cout << " " << core;
+    }
+    std::cout << std::endl;
+
+    const uint64_t timestampOverhead = SanityCheckMeasurementKernels();
+
+    // Without arguments, run the attack with all roles as threads of this
+    // process. See RunMultiProcessCoordinator() for the other modes.
+    if (argc > 1) {
+        const std::string mode = argv[1];
+        if (mode == "--multi-process") {
+            const bool spawn =
+                !(argc > 2 && std::string(argv[2]) == "--no-spawn");
+            return RunMultiProcessCoordinator(argv[0], spawn);
+        }
+        if (mode == "--role" && argc > 2) {
+            const std::string role = argv[2];
+            const uint64_t id =
+                (argc > 4 && std::string(argv[3]) == "--id") ?
+                std::stoull(argv[4]) : 0;
+            if (role == "attacker") {
+                return RunAttackerProcess();
+            }
+            if (role == "victim") {
+                return RunVictimProcess(id);
+            }
+        }
+    }
+
+    // Options of the threaded mode.
+    uint64_t victimSetsPerBank = 1;
+    bool selectSets = false;
+    bool sensitivityMap = false;
+    bool workloadKernels = false;
+    VictimWorkload victimWorkload = VictimWorkload::CHASE;
+    bool spreadVictims = false;
+    bool evictPrivate = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--victim-sets" && i + 1 < argc) {
+            victimSetsPerBank = std::stoull(argv[++i]);
+        } else if (arg == "--select-sets") {
+            selectSets = true;
+        } else if (arg == "--sensitivity-map") {
+            sensitivityMap = true;
+        } else if (arg == "--victim-workload" && i + 1 < argc &&
+                   ParseVictimWorkload(argv[i + 1], &victimWorkload)) {
+            workloadKernels = true;
+            ++i;
+        } else if (arg == "--victim-spread") {
+            workloadKernels = true;
+            spreadVictims = true;
+        } else if (arg == "--evict-private") {
+            evictPrivate = true;
+        } else {
+            victimSetsPerBank = 0;
+            break;
+        }
+    }
+    if (victimSetsPerBank == 0) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--victim-sets N] [--select-sets] [--sensitivity-map]"
+                  << " [--victim-workload chase|hash|btree|memcpy|kv]"
+                  << " [--victim-spread] [--evict-private]"
+                  << " | --multi-process [--no-spawn]"
+                  << " | --role attacker | --role victim --id N" << std::endl;
+        return 1;
+    }
+
     Node* arrayAttacker = nullptr;
     Node* arrayVictim = nullptr;
     uint64_t garbage;
 
     std::vector<Node*> evictionSetsAttacker, evictionSetsVictim;
 
+    ApplyPrefetcherModeToExperimentCores();
+
+    EnergyLog energy;
+    InitEnergyLog(&energy);
+    BeginPhase(&energy, "construction");
+
+    // The set indices with the best signal, if requested. The attacker core
+    // probes, the first victim core loads.
+    uint64_t setAttacker = CACHE_SET_ATTACKER;
+    uint64_t setVictim = CACHE_SET_VICTIM;
+    if (selectSets) {
+        const std::vector<uint64_t> selected = SelectSetIndices(
+            2, SET_INDEX_SAMPLES, {CACHE_SET_ATTACKER, CACHE_SET_VICTIM},
+            ExperimentCore(0), ExperimentCore(1), garbage);
+        if (selected.size() == 2) {
+            setAttacker = selected[0];
+            setVictim = selected[1];
+        }
+        std::cout << "Attacker set index " << setAttacker
+                  << ", victim set index " << setVictim << std::endl;
+    }
+
     // Create the two groups of eviction sets. We cannot do this in parallel
     // with two threads because they would impact each other's timing
     // measurements.
-    CreateEvictionSets(&arrayAttacker, &evictionSetsAttacker,
-                       CACHE_SET_ATTACKER);
-    CreateEvictionSets(&arrayVictim, &evictionSetsVictim, CACHE_SET_VICTIM);
+    CreateEvictionSets(&arrayAttacker, &evictionSetsAttacker, setAttacker);
+    CreateEvictionSets(&arrayVictim, &evictionSetsVictim, setVictim);
 
     std::cout << "Made two groups of eviction sets for different cache sets."
               << std::endl;
 
+    // The rest of the victim footprint, if more than one set per bank.
+    const std::vector<uint64_t> victimSetIndices =
+        VictimSetIndices(victimSetsPerBank, setAttacker, setVictim);
+    std::vector<Node*> arraysVictim = {arrayVictim};
+    std::vector<std::vector<Node*>> extraGroupsVictim;
+    CreateExtraVictimGroups(victimSetIndices, evictionSetsVictim,
+                            &arraysVictim, &extraGroupsVictim, garbage);
+    std::vector<std::vector<Node*>*> groupsVictim = {&evictionSetsVictim};
+    for (std::vector<Node*>& group : extraGroupsVictim) {
+        groupsVictim.push_back(&group);
+    }
+
     // Although it probably doesn't make much of a difference, let's find the
     // eviction set with the shortest access time for the attacker (i.e., its
     // local LLC bank) so that bank contention shows the biggest impact.
@@ -201,10 +1217,49 @@ int main(int argc, char* argv[]) {
     // Run in a spawned thread in order to set its core affinity without
     // affecting the main thread.
     uint64_t closestBank;
-    std::thread threadProfiler(GetAttackerClosestBank, evictionSetsAttacker,
-                               &garbage, coreIDs[0], &closestBank);
+    std::thread threadProfiler(GetAttackerClosestBank<Node>,
+                               evictionSetsAttacker, nullptr, &garbage,
+                               ExperimentCore(0), &closestBank);
     threadProfiler.join();
 
+    if (evictPrivate) {
+        uint64_t listSize = 0;
+        Node* evictionList = LinkPrivateEvictionList(
+            arrayAttacker, setAttacker, evictionSetsAttacker, &listSize);
+        std::thread threadPureLlc(MeasurePureLlcLatency,
+                                  evictionSetsAttacker[closestBank],
+                                  evictionList,
+                                  PrivateEvictionAccesses(listSize),
+                                  timestampOverhead, &garbage,
+                                  ExperimentCore(0));
+        threadPureLlc.join();
+    }
+
+    // Only the map, instead of the sweep.
+    if (sensitivityMap) {
+        RunSensitivityMap(evictionSetsAttacker, evictionSetsVictim,
+                          closestBank, garbage);
+        FreeCandidateArray(arrayAttacker);
+        for (Node* array : arraysVictim) {
+            FreeCandidateArray(array);
+        }
+        std::cout << "All done! (Garbage:" << garbage << ")" << std::endl;
+        return 0;
+    }
+
+    // Track both groups of eviction sets so they can be re-validated between
+    // experiments. A whole sweep takes long enough for the kernel to migrate
+    // some of the hugepages.
+    EvictionSetHealth healthAttacker;
+    InitEvictionSetHealth(&healthAttacker, arrayAttacker, setAttacker,
+                          &evictionSetsAttacker, garbage);
+    std::vector<std::unique_ptr<EvictionSetHealth>> healthVictim;
+    for (uint64_t i = 0; i < groupsVictim.size(); ++i) {
+        healthVictim.emplace_back(new EvictionSetHealth);
+        InitEvictionSetHealth(healthVictim.back().get(), arraysVictim[i],
+                              victimSetIndices[i], groupsVictim[i], garbage);
+    }
+
     // Needed to prevent compiler optimizations.
     std::vector<uint64_t> garbageVictim(MAX_NUM_VICTIM_THREADS);
 
@@ -215,13 +1270,65 @@ int main(int argc, char* argv[]) {
         // std::cout << "Number of victim threads: "
         //           << numVictimThreads << std::endl;
 
-        uint64_t victimBankBoundaries[24];
+        BeginPhase(&energy, PhaseName(numVictimThreads, "maintenance"));
+
+        // Repair any eviction sets which stopped evicting since the last
+        // experiment. A set which cannot be repaired would invalidate the
+        // rest of the sweep.
+        const bool attackerHealthy =
+            MaintainEvictionSets(&healthAttacker, garbage);
+        bool victimHealthy = true;
+        for (std::unique_ptr<EvictionSetHealth>& health : healthVictim) {
+            victimHealthy = MaintainEvictionSets(health.get(), garbage) &&
+                victimHealthy;
+        }
+        assert(attackerHealthy && victimHealthy);
+
+        // Interleave each bank's victim sets into one list, or lay out the
+        // workload over them, until the end of this experiment. Maintenance
+        // needs the sets' own lists.
+        std::vector<Node*> victimHeads = evictionSetsVictim;
+        std::vector<std::vector<std::vector<Node*>>> footprints;
+        if (groupsVictim.size() > 1 || workloadKernels) {
+            for (uint64_t bank = 0; bank < Geometry().llcBanks; ++bank) {
+                footprints.push_back(FootprintSets(groupsVictim, bank));
+                if (!workloadKernels) {
+                    victimHeads[bank] = InterleaveSets(footprints.back());
+                }
+            }
+        }
+
+        VictimWorkloadData workload;
+        if (spreadVictims && numVictimThreads > 0) {
+            std::vector<std::vector<Node*>> sets;
+            for (const auto& footprint : footprints) {
+                sets.insert(sets.end(), footprint.begin(), footprint.end());
+            }
+            BuildVictimWorkload(victimWorkload, PoolLines(sets),
+                                numVictimThreads, &workload);
+        }
+
+        // Start and end of the victims' accesses to each bank.
+        std::vector<uint64_t> victimBankBoundaries(2 * Geometry().llcBanks);
 
         // Start the attacker.
-        std::thread threadAttacker(IterateThroughSetAttacker,
-                                   evictionSetsAttacker[closestBank],
-                                   attackerTimesArray, &garbage,
-                                   coreIDs[0]);
+        BeginPhase(&energy, PhaseName(numVictimThreads, "warmup"));
+        std::thread threadAttacker;
+        if (evictPrivate) {
+            uint64_t listSize = 0;
+            Node* evictionList = LinkPrivateEvictionList(
+                arrayAttacker, setAttacker, evictionSetsAttacker, &listSize);
+            threadAttacker = std::thread(
+                IterateThroughSetAttackerEvicted,
+                evictionSetsAttacker[closestBank], evictionList,
+                PrivateEvictionAccesses(listSize), attackerTimesArray,
+                attackerLatenciesArray, &garbage, ExperimentCore(0));
+        } else {
+            threadAttacker = std::thread(IterateThroughSetAttacker<Node>,
+                                         evictionSetsAttacker[closestBank],
+                                         nullptr, attackerTimesArray,
+                                         &garbage, ExperimentCore(0));
+        }
 
         // Give some time for the warmup requests.
         std::this_thread::sleep_for(std::chrono::milliseconds(1000));
@@ -229,19 +1336,36 @@ int main(int argc, char* argv[]) {
         // Access each bank of one eviction set a certain number of times with a
         // pause in between each bank.
         if (numVictimThreads > 0) {
-            for (uint64_t bank = 0; bank < LLC_BANKS; ++bank) {
+            for (uint64_t bank = 0; bank < Geometry().llcBanks; ++bank) {
+                BeginPhase(&energy, PhaseName(numVictimThreads, "idle"));
+                if (workloadKernels && !spreadVictims) {
+                    BuildVictimWorkload(victimWorkload,
+                                        PoolLines(footprints[bank]),
+                                        numVictimThreads, &workload);
+                }
                 std::this_thread::sleep_for(std::chrono::milliseconds(300));
 
                 std::vector<uint64_t> timesVictim(numVictimThreads);
 
+                BeginPhase(&energy,
+                           PhaseName(numVictimThreads,
+                                     "bank_" + std::to_string(bank)),
+                           numVictimThreads * VICTIM_ITERATIONS);
+
                 victimBankBoundaries[2 * bank] = __rdtsc();
 
                 std::vector<std::thread> threadVictim;
                 for (uint64_t i = 0; i < numVictimThreads; ++i) {
-                    threadVictim.push_back(std::thread(IterateThroughSetVictim,
-                                                       evictionSetsVictim[bank],
-                                                       &timesVictim[i],
-                                                       &garbageVictim[i]));
+                    if (workloadKernels) {
+                        threadVictim.push_back(
+                            std::thread(RunVictimWorkloadThread, &workload, i,
+                                        &timesVictim[i], &garbageVictim[i]));
+                    } else {
+                        threadVictim.push_back(
+                            std::thread(IterateThroughSetVictim<Node>,
+                                        victimHeads[bank], nullptr,
+                                        &timesVictim[i], &garbageVictim[i]));
+                    }
                 }
 
                 for (uint64_t i = 0; i < numVictimThreads; ++i) {
@@ -258,83 +1382,30 @@ int main(int argc, char* argv[]) {
             std::cout << "Victim(s) done" << std::endl;
         }
 
+        BeginPhase(&energy, PhaseName(numVictimThreads, "finish"));
         threadAttacker.join();
 
-        // Create the output files. One which splits results by bank and another
-        // which outputs all times for the attacker.
-        std::ofstream filePerBank, fileConstant;
-        filePerBank.open("../results/per_bank_access_times_" +
-                         std::to_string(numVictimThreads) + "_threads.txt");
-        fileConstant.open("../results/constant_access_times_" +
-                          std::to_string(numVictimThreads) + "_threads.txt");
-        assert(filePerBank.is_open());
-        assert(fileConstant.is_open());
-
-        // Output each timing difference to file. Only output results that
-        // occurred during a victim access for "filePerBank".
-        std::cout << "Start writing to files" << std::endl;
-
-        // First write all times to "fileConstant".
-        fileConstant << ATTACKER_TIMED_ITERATIONS - 1 << std::endl;
-        for (uint64_t i = 1; i < ATTACKER_TIMED_ITERATIONS; ++i) {
-            const uint64_t accessTime =
-                attackerTimesArray[i] - attackerTimesArray[i - 1];
-            fileConstant << accessTime << std::endl;
+        for (const auto& footprint : footprints) {
+            RelinkSets(footprint);
         }
-        fileConstant.close();
-
-        // Now write the per-bank results to "filePerBank".
-        //
-        // Corner case for 0 victim threads. Just write all results to file.
-        if (numVictimThreads == 0) {
-            // First output the number of results.
-            filePerBank << ATTACKER_TIMED_ITERATIONS - 1 << std::endl;
-
-            // Now output the actual results.
-            for (uint64_t i = 1; i < ATTACKER_TIMED_ITERATIONS; ++i) {
-                const uint64_t accessTime =
-                    attackerTimesArray[i] - attackerTimesArray[i - 1];
-                filePerBank << accessTime << std::endl;
-            }
-
-            filePerBank.close();
-            std::cout << "Finish writing to files" << std::endl;
 
-            std::cout << "Finished experiment with " << numVictimThreads
-                      << " victim threads." << std::endl;
-
-            continue;
-        }
-
-        // At least one victim thread. Determine boundaries.
-        std::vector<uint64_t> boundaries =
-            SplitResultsIntoBanks(victimBankBoundaries);
-
-        // Output results results per-bank.
-        for (uint64_t bank = 0; bank < LLC_BANKS; ++bank) {
-            // First output the number of attacker accesses which occurred while
-            // the victim accessed this bank.
-            const uint64_t accesses =
-                boundaries[2 * bank + 1] - boundaries[2 * bank] + 1;
-            filePerBank << accesses << std::endl;
-
-            // Then output values.
-            for (uint64_t i = boundaries[2 * bank];
-                 i <= boundaries[2 * bank + 1]; ++i) {
-                filePerBank << attackerTimesArray[i] - attackerTimesArray[i - 1]
-                            << std::endl;
-            }
-        }
-
-        filePerBank.close();
-        std::cout << "Finish writing to files" << std::endl;
-
-        std::cout << "Finished experiment with " << numVictimThreads
-                  << " victim threads." << std::endl;
+        WriteResults(attackerTimesArray,
+                     evictPrivate ? attackerLatenciesArray : nullptr,
+                     numVictimThreads, victimBankBoundaries);
     }
 
-    delete [] arrayAttacker;
-    delete [] arrayVictim;
+    WriteRunMetadata("threads", setAttacker, victimSetIndices,
+                     !workloadKernels ? "chase" :
+                     VictimWorkloadName(victimWorkload) +
+                     (spreadVictims ? ", spread over all banks" :
+                      ", confined to each bank"),
+                     AttackerSamplesName(evictPrivate));
+    WriteEnergy(&energy);
+
+    FreeCandidateArray(arrayAttacker);
+    for (Node* array : arraysVictim) {
+        FreeCandidateArray(array);
+    }
 
     uint64_t finalGarbage = garbage;
     for (uint64_t i = 0; i < garbageVictim.size(); ++i) {
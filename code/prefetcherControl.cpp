@@ -0,0 +1,277 @@
+#include <cerrno>
+#include <cpuid.h>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "prefetcherControl.h"
+
+const char* const PREFETCHER_MODE_VARIABLE = "LLC_PREFETCHERS";
+
+// Saved MSR values live in a fixed table, so that the signal handler can
+// restore them without allocating.
+const int MAX_PREFETCHER_CORES = 1024;
+
+// L2_RQSTS.ALL_PF (event 0x24, umask 0xF8): L2 requests from the L2 and L1D
+// prefetchers, Haswell through Ice Lake.
+const uint64_t INTEL_ALL_PF_EVENT = 0xF824;
+
+struct SavedMsr {
+    int coreID;
+    int fd;
+    uint64_t value;
+};
+
+SavedMsr savedMsrs[MAX_PREFETCHER_CORES];
+volatile int savedMsrCount = 0;
+
+// Forked children inherit the table and the exit handlers, but must leave the
+// parent's prefetchers alone.
+pid_t prefetcherOwner = 0;
+
+bool restoreHandlersInstalled = false;
+bool msrUnavailable = false;
+int prefetchCounterFd = -1;
+std::string prefetchCounterName;
+std::mutex prefetcherMutex;
+
+bool IsIntel() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return ebx == 0x756e6547 && edx == 0x49656e69 && ecx == 0x6c65746e;
+}
+
+// Async-signal-safe: only pwrite() and getpid().
+void WriteBackSavedMsrs() {
+    if (getpid() != prefetcherOwner) {
+        return;
+    }
+    for (int i = 0; i < savedMsrCount; ++i) {
+        const SavedMsr& saved = savedMsrs[i];
+        if (pwrite(saved.fd, &saved.value, sizeof(saved.value),
+                   PREFETCHER_MSR) != sizeof(saved.value)) {
+            const char message[] = "Could not restore prefetcher MSR\n";
+            ssize_t ignored = write(STDERR_FILENO, message,
+                                    sizeof(message) - 1);
+            (void)ignored;
+        }
+    }
+}
+
+void HandleFatalSignal(int signal) {
+    WriteBackSavedMsrs();
+    // The handler was installed with SA_RESETHAND, so this takes the default
+    // action (terminate, or dump core).
+    raise(signal);
+}
+
+// Restores the MSRs on exit() (including returning from main) and on signals
+// which would kill the process. Termination signals are left alone if the
+// program handles them itself; such programs exit normally.
+void InstallRestoreHandlers() {
+    std::atexit(RestorePrefetchers);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = HandleFatalSignal;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+
+    for (int signal : {SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGABRT, SIGSEGV,
+                       SIGBUS, SIGFPE, SIGILL}) {
+        struct sigaction current;
+        if (sigaction(signal, nullptr, &current) == 0 &&
+            current.sa_handler == SIG_DFL) {
+            sigaction(signal, &action, nullptr);
+        }
+    }
+}
+
+long PerfEventOpen(perf_event_attr* attr) {
+    return syscall(__NR_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+// Counts prefetch requests of this process and of the threads it starts from
+// now on. Tries the Intel L2 event, then the generic L1D prefetch event.
+void OpenPrefetchCounter() {
+    if (prefetchCounterFd >= 0) {
+        return;
+    }
+
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    if (IsIntel()) {
+        attr.type = PERF_TYPE_RAW;
+        attr.config = INTEL_ALL_PF_EVENT;
+        prefetchCounterFd = PerfEventOpen(&attr);
+        prefetchCounterName = "L2_RQSTS.ALL_PF";
+    }
+    if (prefetchCounterFd < 0) {
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_PREFETCH << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16);
+        prefetchCounterFd = PerfEventOpen(&attr);
+        prefetchCounterName = "L1D prefetch accesses";
+    }
+
+    if (prefetchCounterFd < 0) {
+        std::cout << "Warning: no perf counter for prefetch requests ("
+                  << strerror(errno) << ")" << std::endl;
+    }
+}
+
+bool PrefetcherControlRequested() {
+    const char* mode = getenv(PREFETCHER_MODE_VARIABLE);
+    return mode != nullptr && std::string(mode) == "off";
+}
+
+bool DisablePrefetchers(const std::vector<int>& cores) {
+    std::lock_guard<std::mutex> lock(prefetcherMutex);
+    if (!IsIntel()) {
+        return false;
+    }
+
+    for (int coreID : cores) {
+        if (coreID < 0) {
+            continue;
+        }
+
+        bool saved = false;
+        for (int i = 0; i < savedMsrCount; ++i) {
+            saved = saved || savedMsrs[i].coreID == coreID;
+        }
+        if (saved) {
+            continue;
+        }
+        if (savedMsrCount == MAX_PREFETCHER_CORES) {
+            return false;
+        }
+
+        const std::string path =
+            "/dev/cpu/" + std::to_string(coreID) + "/msr";
+        const int fd = open(path.c_str(), O_RDWR);
+        if (fd < 0) {
+            std::cout << "Could not open " << path << ": " << strerror(errno)
+                      << std::endl;
+            return false;
+        }
+
+        uint64_t value = 0;
+        if (pread(fd, &value, sizeof(value), PREFETCHER_MSR) !=
+            sizeof(value)) {
+            std::cout << "Could not read MSR " << std::hex << PREFETCHER_MSR
+                      << std::dec << " on core " << coreID << ": "
+                      << strerror(errno) << std::endl;
+            close(fd);
+            return false;
+        }
+        const uint64_t newValue = value | PREFETCHER_DISABLE_BITS;
+        if (pwrite(fd, &newValue, sizeof(newValue), PREFETCHER_MSR) !=
+            sizeof(newValue)) {
+            std::cout << "Could not write MSR " << std::hex << PREFETCHER_MSR
+                      << std::dec << " on core " << coreID << ": "
+                      << strerror(errno) << std::endl;
+            close(fd);
+            return false;
+        }
+
+        if (!restoreHandlersInstalled) {
+            prefetcherOwner = getpid();
+            InstallRestoreHandlers();
+            restoreHandlersInstalled = true;
+        }
+        savedMsrs[savedMsrCount] = {coreID, fd, value};
+        savedMsrCount = savedMsrCount + 1;
+    }
+
+    return true;
+}
+
+void RestorePrefetchers() {
+    std::lock_guard<std::mutex> lock(prefetcherMutex);
+    WriteBackSavedMsrs();
+    if (getpid() == prefetcherOwner) {
+        for (int i = 0; i < savedMsrCount; ++i) {
+            close(savedMsrs[i].fd);
+        }
+        savedMsrCount = 0;
+    }
+}
+
+void ApplyPrefetcherMode(const std::vector<int>& cores) {
+    if (!PrefetcherControlRequested() || msrUnavailable) {
+        return;
+    }
+
+    if (!DisablePrefetchers(cores)) {
+        std::cout << "Warning: cannot disable the prefetchers, counting "
+                  << "prefetch requests instead" << std::endl;
+        std::lock_guard<std::mutex> lock(prefetcherMutex);
+        msrUnavailable = true;
+        OpenPrefetchCounter();
+    }
+}
+
+int64_t PrefetchRequests() {
+    std::lock_guard<std::mutex> lock(prefetcherMutex);
+    if (prefetchCounterFd < 0) {
+        return -1;
+    }
+
+    uint64_t count = 0;
+    if (read(prefetchCounterFd, &count, sizeof(count)) != sizeof(count)) {
+        return -1;
+    }
+    return count;
+}
+
+std::string PrefetcherStateDescription() {
+    std::ostringstream description;
+    const int64_t requests = PrefetchRequests();
+
+    std::lock_guard<std::mutex> lock(prefetcherMutex);
+    if (savedMsrCount == 0 && !msrUnavailable) {
+        return "enabled (not controlled)";
+    }
+
+    if (savedMsrCount > 0) {
+        description << (msrUnavailable ? "partially " : "")
+                    << "disabled (msr 0x" << std::hex << PREFETCHER_MSR
+                    << " |= 0x" << PREFETCHER_DISABLE_BITS << std::dec
+                    << " on cores ";
+        for (int i = 0; i < savedMsrCount; ++i) {
+            description << (i == 0 ? "" : ",") << savedMsrs[i].coreID;
+        }
+        description << ")";
+    } else {
+        description << "enabled";
+    }
+
+    if (msrUnavailable) {
+        description << " (msr unavailable, ";
+        if (requests >= 0) {
+            description << requests << " " << prefetchCounterName;
+        } else {
+            description << "no prefetch counter";
+        }
+        description << ")";
+    }
+    return description.str();
+}
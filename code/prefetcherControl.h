@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Control of the hardware prefetchers of the measurement cores.
+//
+// Randomized candidate lists keep the L2 streamer from following a traversal,
+// but the adjacent-line and DCU prefetchers can still pull extra lines into
+// the measured sets. With $LLC_PREFETCHERS=off, construction and the
+// measurement tools disable all four prefetchers through MSR 0x1A4
+// (MISC_FEATURE_CONTROL, Intel only) on the cores they use, via
+// /dev/cpu/N/msr (root and the msr module). The previous values are written
+// back at exit, including exits through assert() and fatal signals, but not
+// through SIGKILL.
+//
+// If the MSR cannot be written, prefetchers stay on and a perf counter of
+// prefetch requests is opened instead, so that the results record how active
+// they were.
+
+// Bits of MSR 0x1A4 which disable the L2 streamer, L2 adjacent line, DCU
+// (L1D) streamer and DCU IP prefetchers.
+const uint64_t PREFETCHER_MSR = 0x1A4;
+const uint64_t PREFETCHER_DISABLE_BITS = 0xF;
+
+// True if $LLC_PREFETCHERS is "off".
+bool PrefetcherControlRequested();
+
+// Disables the prefetchers on "cores" (negative IDs are ignored), saving each
+// core's MSR value the first time. Returns false if any MSR could not be read
+// or written; the cores done so far stay disabled.
+bool DisablePrefetchers(const std::vector<int>& cores);
+
+// Writes back the saved MSR values. Also runs at exit.
+void RestorePrefetchers();
+
+// Applies $LLC_PREFETCHERS to "cores": does nothing unless it is "off", then
+// disables the prefetchers, or starts counting prefetch requests if that
+// fails. Idempotent, so every construction can call it.
+void ApplyPrefetcherMode(const std::vector<int>& cores);
+
+// Prefetch requests counted in this process (and threads started after
+// counting began), or -1 if no counter is open.
+int64_t PrefetchRequests();
+
+// One line for result metadata, e.g., "disabled (msr 0x1a4 = 0xf on cores
+// 0,1)" or "enabled (msr unavailable, 1234 prefetch requests)".
+std::string PrefetcherStateDescription();
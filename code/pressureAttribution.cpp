@@ -0,0 +1,633 @@
+// Passive per-bank pressure attribution for a target process or cgroup.
+//
+// portAttack only measures the pressure created by its own victim threads.
+// This program instead samples per-bank probe latency from a dedicated core
+// while an existing workload runs, and attributes the pressure to that
+// workload by correlating every probe sample with the target's scheduled-in
+// intervals. Those intervals come from the sched_switch tracepoint on every
+// logical core that shares the probing core's LLC. The target's LLC misses are
+// counted alongside.
+//
+// For each bank the output compares the probe latency while the target was
+// running with the latency while it was not. The difference is the pressure
+// attributable to the target's accesses to that bank.
+//
+// Needs permission to open tracepoints and system-wide perf events (root, or
+// kernel.perf_event_paranoid <= -1).
+//
+// To run (with huge pages):
+// $ make runPressureAttribution TARGET="--pid 1234"
+// $ make runPressureAttribution TARGET="--cgroup /sys/fs/cgroup/myservice"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <set>
+#include <sstream>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "geometryProfile.h"
+#include "hugePages.h"
+#include "measurementKernels.h"
+#include "toolUtils.h"
+
+// Timed accesses per bank per probe sample.
+const uint64_t PROBE_ACCESSES_PER_SAMPLE = 200;
+
+// Upper bound on the sampling rate, used to size the sample buffer. One sample
+// takes a few microseconds.
+const uint64_t MAX_SAMPLES_PER_SECOND = 500000;
+
+// The sample buffer is a ring of at most this many samples (48 MiB). Longer
+// runs overwrite the oldest samples, so the result covers only the end of the
+// run; the output reports how many were dropped.
+const uint64_t MAX_PROBE_SAMPLES = 1 << 21;
+
+// Cache set used for the probe sets. Arbitrary.
+const uint64_t CACHE_SET_PROBE = 27;
+
+const uint64_t DEFAULT_DURATION_S = 10;
+const int DEFAULT_PROBE_CORE = 0;
+
+// Core which drains the tracepoint buffers. Must be on a different physical
+// core than the probe, but can be on the same socket.
+const int DEFAULT_READER_CORE = 1;
+
+// Ring buffer size per logical core, in pages (must be a power of two).
+const uint64_t RING_BUFFER_PAGES = 512;
+const uint64_t READER_INTERVAL_MS = 50;
+
+// A probe sample counts as "target running" or "target idle" only if the
+// target ran during at least / at most this fraction of the sample.
+const double ON_CPU_FRACTION = 0.9;
+const double OFF_CPU_FRACTION = 0.1;
+
+const char* const RESULTS_FILENAME = "../results/pressure_attribution.txt";
+
+struct ProbeSample {
+    uint64_t start; // ns, CLOCK_MONOTONIC
+    uint64_t end;
+    uint32_t bank;
+    uint32_t cycles; // total for PROBE_ACCESSES_PER_SAMPLE accesses
+};
+
+struct SwitchEvent {
+    uint64_t time; // ns, CLOCK_MONOTONIC
+    uint32_t cpu;
+    int32_t prevPid;
+    int32_t nextPid;
+};
+
+struct TracepointFormat {
+    uint64_t id;
+    uint64_t prevPidOffset;
+    uint64_t nextPidOffset;
+};
+
+struct RingBuffer {
+    int fd;
+    uint32_t cpu;
+    perf_event_mmap_page* header;
+    char* data;
+    uint64_t dataSize;
+};
+
+std::atomic<bool> sampling(true);
+
+long PerfEventOpen(perf_event_attr* attr, pid_t pid, int cpu, int groupFd,
+                   unsigned long flags) {
+    return syscall(__NR_perf_event_open, attr, pid, cpu, groupFd, flags);
+}
+
+uint64_t MonotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Reads the sched_switch tracepoint id and the offsets of the pid fields in
+// its raw payload. The layout differs between kernel versions.
+bool ReadTracepointFormat(TracepointFormat* format) {
+    const char* const roots[] = {"/sys/kernel/tracing",
+                                 "/sys/kernel/debug/tracing"};
+    for (const char* root : roots) {
+        const std::string dir = std::string(root) + "/events/sched/sched_switch";
+        std::ifstream idFile(dir + "/id");
+        std::ifstream formatFile(dir + "/format");
+        if (!idFile.is_open() || !formatFile.is_open()) {
+            continue;
+        }
+        idFile >> format->id;
+
+        bool foundPrev = false, foundNext = false;
+        std::string line;
+        while (std::getline(formatFile, line)) {
+            const size_t offsetPos = line.find("offset:");
+            if (offsetPos == std::string::npos) {
+                continue;
+            }
+            const uint64_t offset = std::stoull(line.substr(offsetPos + 7));
+            if (line.find(" prev_pid;") != std::string::npos) {
+                format->prevPidOffset = offset;
+                foundPrev = true;
+            } else if (line.find(" next_pid;") != std::string::npos) {
+                format->nextPidOffset = offset;
+                foundNext = true;
+            }
+        }
+        if (foundPrev && foundNext) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Thread ids belonging to the target. Re-read periodically since the target
+// may create threads while we sample.
+std::set<int32_t> ReadTargetThreads(pid_t pid, const std::string& cgroup) {
+    std::set<int32_t> threads;
+
+    if (pid > 0) {
+        const std::string taskDir = "/proc/" + std::to_string(pid) + "/task";
+        DIR* dir = opendir(taskDir.c_str());
+        if (dir == nullptr) {
+            return threads;
+        }
+        while (dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') {
+                threads.insert(std::stoi(entry->d_name));
+            }
+        }
+        closedir(dir);
+        return threads;
+    }
+
+    // cgroup v2 lists threads in "cgroup.threads", v1 in "tasks".
+    std::ifstream file(cgroup + "/cgroup.threads");
+    if (!file.is_open()) {
+        file.open(cgroup + "/tasks");
+    }
+    int32_t tid;
+    while (file >> tid) {
+        threads.insert(tid);
+    }
+    return threads;
+}
+
+bool OpenSwitchTracepoints(const TracepointFormat& format,
+                           const std::vector<uint32_t>& cores,
+                           std::vector<RingBuffer>* buffers) {
+    const long pageSize = sysconf(_SC_PAGESIZE);
+
+    for (uint32_t cpu : cores) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.config = format.id;
+        attr.sample_period = 1;
+        attr.sample_type = PERF_SAMPLE_TIME | PERF_SAMPLE_RAW;
+        attr.use_clockid = 1;
+        attr.clockid = CLOCK_MONOTONIC;
+        attr.disabled = 1;
+
+        const int fd = PerfEventOpen(&attr, -1, cpu, -1, 0);
+        if (fd < 0) {
+            std::cerr << "Could not open sched_switch on core " << cpu << ": "
+                      << strerror(errno) << std::endl;
+            return false;
+        }
+
+        const uint64_t mapSize = (RING_BUFFER_PAGES + 1) * pageSize;
+        void* map = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         fd, 0);
+        if (map == MAP_FAILED) {
+            std::cerr << "Could not map ring buffer for core " << cpu << ": "
+                      << strerror(errno) << std::endl;
+            close(fd);
+            return false;
+        }
+
+        RingBuffer buffer;
+        buffer.fd = fd;
+        buffer.cpu = cpu;
+        buffer.header = static_cast<perf_event_mmap_page*>(map);
+        buffer.data = static_cast<char*>(map) + pageSize;
+        buffer.dataSize = RING_BUFFER_PAGES * pageSize;
+        buffers->push_back(buffer);
+    }
+
+    return true;
+}
+
+// Copies "size" bytes out of the ring buffer starting at "offset", handling
+// wraparound.
+void CopyFromRing(const RingBuffer& buffer, uint64_t offset, void* dest,
+                  uint64_t size) {
+    char* out = static_cast<char*>(dest);
+    for (uint64_t i = 0; i < size; ++i) {
+        out[i] = buffer.data[(offset + i) % buffer.dataSize];
+    }
+}
+
+void DrainRingBuffer(const RingBuffer& buffer, const TracepointFormat& format,
+                     std::vector<SwitchEvent>* events, uint64_t* lost) {
+    const uint64_t head = __atomic_load_n(&buffer.header->data_head,
+                                          __ATOMIC_ACQUIRE);
+    uint64_t tail = buffer.header->data_tail;
+
+    std::vector<char> record;
+    while (tail < head) {
+        perf_event_header header;
+        CopyFromRing(buffer, tail, &header, sizeof(header));
+        record.resize(header.size);
+        CopyFromRing(buffer, tail, record.data(), header.size);
+
+        if (header.type == PERF_RECORD_SAMPLE) {
+            // Layout: header, u64 time, u32 raw size, raw payload.
+            const char* body = record.data() + sizeof(header);
+            SwitchEvent event;
+            memcpy(&event.time, body, sizeof(uint64_t));
+            const char* raw = body + sizeof(uint64_t) + sizeof(uint32_t);
+            memcpy(&event.prevPid, raw + format.prevPidOffset, sizeof(int32_t));
+            memcpy(&event.nextPid, raw + format.nextPidOffset, sizeof(int32_t));
+            event.cpu = buffer.cpu;
+            events->push_back(event);
+        } else if (header.type == PERF_RECORD_LOST) {
+            uint64_t lostCount;
+            memcpy(&lostCount,
+                   record.data() + sizeof(header) + sizeof(uint64_t),
+                   sizeof(uint64_t));
+            *lost += lostCount;
+        }
+
+        tail += header.size;
+    }
+
+    __atomic_store_n(&buffer.header->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+// Opens LLC miss counters which only count while the target runs. A process
+// target gets one counter per thread; a cgroup target one per core.
+std::vector<int> OpenMissCounters(pid_t pid, const std::string& cgroup,
+                                  const std::vector<uint32_t>& cores) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.inherit = 1;
+    attr.disabled = 1;
+
+    std::vector<int> fds;
+
+    if (pid > 0) {
+        for (int32_t tid : ReadTargetThreads(pid, cgroup)) {
+            const int fd = PerfEventOpen(&attr, tid, -1, -1, 0);
+            if (fd >= 0) {
+                fds.push_back(fd);
+            }
+        }
+    } else {
+        const int cgroupFd = open(cgroup.c_str(), O_RDONLY);
+        if (cgroupFd < 0) {
+            return fds;
+        }
+        attr.inherit = 0;
+        for (uint32_t cpu : cores) {
+            const int fd = PerfEventOpen(&attr, cgroupFd, cpu, -1,
+                                         PERF_FLAG_PID_CGROUP);
+            if (fd >= 0) {
+                fds.push_back(fd);
+            }
+        }
+        close(cgroupFd);
+    }
+
+    return fds;
+}
+
+// Sum of the counters, scaled up for any time they were multiplexed out.
+uint64_t ReadMissCounters(const std::vector<int>& fds) {
+    double total = 0;
+    for (int fd : fds) {
+        uint64_t values[3];
+        if (read(fd, values, sizeof(values)) != sizeof(values)) {
+            continue;
+        }
+        if (values[2] > 0) {
+            total += static_cast<double>(values[0]) * values[1] / values[2];
+        }
+    }
+    return total;
+}
+
+// Writes the samples round-robin into "samples", whose size is fixed, and
+// counts them in "written".
+void ProbeBanks(const std::vector<Node*>& evictionSets, int coreID,
+                std::vector<ProbeSample>* samples, uint64_t* written,
+                uint64_t* garbage) {
+    PinToCore(coreID);
+
+    std::vector<Node*> nodes = evictionSets;
+    const uint64_t llcBanks = Geometry().llcBanks;
+
+    while (sampling) {
+        for (uint32_t bank = 0; bank < llcBanks; ++bank) {
+            Node* node = nodes[bank];
+            ProbeSample sample;
+            sample.bank = bank;
+            sample.start = MonotonicNs();
+
+            const uint64_t time = MeasureChase(&node, PROBE_ACCESSES_PER_SAMPLE);
+
+            sample.end = MonotonicNs();
+            sample.cycles = time;
+            (*samples)[*written % samples->size()] = sample;
+            ++*written;
+
+            nodes[bank] = node;
+        }
+    }
+
+    for (uint64_t bank = 0; bank < llcBanks; ++bank) {
+        *garbage += nodes[bank]->padding[0];
+    }
+}
+
+// Turns the sched_switch events into a list of (time, +1/-1) steps of the
+// number of target threads on-CPU.
+std::vector<std::pair<uint64_t, int>> BuildRunningSteps(
+        std::vector<SwitchEvent>& events, const std::set<int32_t>& targets) {
+    std::sort(events.begin(), events.end(),
+              [](const SwitchEvent& a, const SwitchEvent& b) {
+                  return a.time < b.time;
+              });
+
+    std::vector<std::pair<uint64_t, int>> steps;
+    for (const SwitchEvent& event : events) {
+        if (targets.count(event.prevPid) > 0) {
+            steps.push_back({event.time, -1});
+        }
+        if (targets.count(event.nextPid) > 0) {
+            steps.push_back({event.time, +1});
+        }
+    }
+    return steps;
+}
+
+void PrintUsage(const char* program) {
+    std::cerr << "Usage: " << program << " (--pid PID | --cgroup PATH)"
+              << " [--duration-s N] [--core N] [--reader-core N]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    pid_t pid = 0;
+    std::string cgroup;
+    uint64_t durationS = DEFAULT_DURATION_S;
+    int probeCore = DEFAULT_PROBE_CORE;
+    int readerCore = DEFAULT_READER_CORE;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        if (arg == "--pid") {
+            pid = std::stoi(argv[++i]);
+        } else if (arg == "--cgroup") {
+            cgroup = argv[++i];
+        } else if (arg == "--duration-s") {
+            durationS = std::stoull(argv[++i]);
+        } else if (arg == "--core") {
+            probeCore = std::stoi(argv[++i]);
+        } else if (arg == "--reader-core") {
+            readerCore = std::stoi(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((pid > 0) == !cgroup.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    TracepointFormat format;
+    if (!ReadTracepointFormat(&format)) {
+        std::cerr << "Could not read the sched_switch tracepoint format. Is "
+                  << "tracefs mounted?" << std::endl;
+        return 1;
+    }
+
+    const std::vector<int> llcCores = LlcSharingCores(probeCore);
+    const std::vector<uint32_t> cores(llcCores.begin(), llcCores.end());
+    std::cout << "Tracing " << cores.size() << " logical cores sharing the LLC"
+              << " of core " << probeCore << std::endl;
+
+    // Build the probe sets on the probing core.
+    PinToCore(probeCore);
+    Node* array = nullptr;
+    const std::vector<Node*> evictionSets =
+        GetEvictionSet(&array, CACHE_SET_PROBE);
+    PinToCore(readerCore);
+
+    std::vector<RingBuffer> buffers;
+    if (!OpenSwitchTracepoints(format, cores, &buffers)) {
+        return 1;
+    }
+    const std::vector<int> missCounters = OpenMissCounters(pid, cgroup, cores);
+    if (missCounters.empty()) {
+        std::cerr << "Could not open LLC miss counters for the target"
+                  << std::endl;
+    }
+
+    // Allocate all samples up front so the probe never reallocates.
+    std::vector<ProbeSample> samples(std::min(
+        durationS * MAX_SAMPLES_PER_SECOND, MAX_PROBE_SAMPLES));
+    uint64_t written = 0;
+
+    std::vector<SwitchEvent> events;
+    std::set<int32_t> targets = ReadTargetThreads(pid, cgroup);
+    uint64_t lost = 0;
+    uint64_t garbage = 0;
+
+    for (const RingBuffer& buffer : buffers) {
+        ioctl(buffer.fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    for (int fd : missCounters) {
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    const uint64_t startNs = MonotonicNs();
+    std::thread threadProbe(ProbeBanks, evictionSets, probeCore, &samples,
+                            &written, &garbage);
+
+    while (MonotonicNs() - startNs < durationS * 1000000000) {
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(READER_INTERVAL_MS));
+        for (const RingBuffer& buffer : buffers) {
+            DrainRingBuffer(buffer, format, &events, &lost);
+        }
+        const std::set<int32_t> current = ReadTargetThreads(pid, cgroup);
+        targets.insert(current.begin(), current.end());
+    }
+
+    sampling = false;
+    threadProbe.join();
+
+    for (const RingBuffer& buffer : buffers) {
+        ioctl(buffer.fd, PERF_EVENT_IOC_DISABLE, 0);
+        DrainRingBuffer(buffer, format, &events, &lost);
+    }
+    const uint64_t misses = ReadMissCounters(missCounters);
+    const uint64_t endNs = MonotonicNs();
+
+    // Oldest first: once the ring has wrapped, that is the next slot to be
+    // overwritten.
+    const uint64_t kept = std::min<uint64_t>(written, samples.size());
+    const uint64_t dropped = written - kept;
+    if (dropped > 0) {
+        std::rotate(samples.begin(),
+                    samples.begin() + written % samples.size(), samples.end());
+    }
+    samples.resize(kept);
+
+    std::cout << "Collected " << written << " probe samples and "
+              << events.size() << " context switches (" << lost << " lost)"
+              << std::endl;
+    if (dropped > 0) {
+        std::cout << "Warning: the sample buffer overflowed, only the last "
+                  << kept << " samples are attributed" << std::endl;
+    }
+
+    // Walk the probe samples (which are in time order) alongside the running
+    // steps, accumulating how long at least one target thread was on-CPU
+    // during each sample.
+    const std::vector<std::pair<uint64_t, int>> steps =
+        BuildRunningSteps(events, targets);
+
+    const uint64_t llcBanks = Geometry().llcBanks;
+    std::vector<double> onTotal(llcBanks), offTotal(llcBanks);
+    std::vector<uint64_t> onCount(llcBanks), offCount(llcBanks);
+
+    // Threads already running when tracing started only show up when they are
+    // switched out. Start from the count implied by those first events.
+    int running = 0, lowest = 0;
+    for (const auto& step : steps) {
+        running += step.second;
+        lowest = std::min(lowest, running);
+    }
+    running = -lowest;
+
+    uint64_t step = 0;
+    for (const ProbeSample& sample : samples) {
+        uint64_t onNs = 0;
+        uint64_t time = sample.start;
+
+        while (step < steps.size() && steps[step].first < sample.end) {
+            const uint64_t stepTime = std::max(steps[step].first, sample.start);
+            if (running > 0) {
+                onNs += stepTime - time;
+            }
+            time = stepTime;
+            running += steps[step].second;
+            ++step;
+        }
+        if (running > 0) {
+            onNs += sample.end - time;
+        }
+
+        const double fraction =
+            static_cast<double>(onNs) / (sample.end - sample.start);
+        const double latency =
+            static_cast<double>(sample.cycles) / PROBE_ACCESSES_PER_SAMPLE;
+
+        if (fraction >= ON_CPU_FRACTION) {
+            onTotal[sample.bank] += latency;
+            ++onCount[sample.bank];
+        } else if (fraction <= OFF_CPU_FRACTION) {
+            offTotal[sample.bank] += latency;
+            ++offCount[sample.bank];
+        }
+    }
+
+    // Total on-CPU time of the target over the whole run, for the miss rate.
+    uint64_t onCpuNs = 0;
+    {
+        int count = -lowest;
+        uint64_t previous = startNs;
+        for (const auto& s : steps) {
+            if (count > 0) {
+                onCpuNs += s.first - previous;
+            }
+            count += s.second;
+            previous = s.first;
+        }
+        if (count > 0) {
+            onCpuNs += endNs - previous;
+        }
+    }
+
+    std::ofstream file(RESULTS_FILENAME);
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << "# target: " << (pid > 0 ? "pid " + std::to_string(pid) : cgroup)
+       << std::endl;
+    ss << "# on-cpu time (ms): " << onCpuNs / 1000000.0 << std::endl;
+    ss << "# probe samples: " << written << " (" << dropped
+       << " dropped by the sample buffer)" << std::endl;
+    ss << "# llc misses: " << misses << std::endl;
+    ss << "# llc misses per on-cpu ms: "
+       << (onCpuNs > 0 ? misses / (onCpuNs / 1000000.0) : 0) << std::endl;
+    ss << "# bank on_samples on_latency off_samples off_latency pressure"
+       << std::endl;
+
+    for (uint64_t bank = 0; bank < llcBanks; ++bank) {
+        const double on = onCount[bank] > 0 ? onTotal[bank] / onCount[bank] : 0;
+        const double off =
+            offCount[bank] > 0 ? offTotal[bank] / offCount[bank] : 0;
+        const double pressure = (on > 0 && off > 0) ? (on - off) / off : 0;
+
+        ss << bank << " " << onCount[bank] << " " << on << " "
+           << offCount[bank] << " " << off << " " << std::setprecision(4)
+           << pressure << std::setprecision(2) << std::endl;
+    }
+
+    std::cout << ss.str();
+    file << ss.str();
+    std::cout << "Wrote " << RESULTS_FILENAME << std::endl;
+
+    for (const RingBuffer& buffer : buffers) {
+        munmap(buffer.header, buffer.dataSize + sysconf(_SC_PAGESIZE));
+        close(buffer.fd);
+    }
+    for (int fd : missCounters) {
+        close(fd);
+    }
+    FreeCandidateArray(array);
+
+    std::cout << "(Garbage: " << garbage << ")" << std::endl;
+
+    return 0;
+}
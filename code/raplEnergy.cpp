@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "raplEnergy.h"
+
+const char* const POWERCAP_PATH = "/sys/class/powercap";
+
+// Top-level package zones are "intel-rapl:N", their subzones
+// "intel-rapl:N:M". AMD exposes its package counters under the same name.
+const char* const RAPL_ZONE_PREFIX = "intel-rapl:";
+
+const double MICROJOULES_PER_JOULE = 1e6;
+
+// Returns the first line of a sysfs attribute, or "" if it cannot be read.
+std::string ReadAttribute(const std::string& path) {
+    std::ifstream file(path);
+    std::string value;
+    std::getline(file, value);
+    return value;
+}
+
+// Reads "energyPath" into "*energy". Returns false if it cannot be read.
+bool ReadEnergy(const std::string& energyPath, uint64_t* energy) {
+    const std::string value = ReadAttribute(energyPath);
+    if (value.empty()) {
+        return false;
+    }
+    *energy = std::stoull(value);
+    return true;
+}
+
+std::vector<RaplZone> FindRaplZones() {
+    std::vector<RaplZone> zones;
+
+    DIR* directory = opendir(POWERCAP_PATH);
+    if (directory == nullptr) {
+        return zones;
+    }
+
+    std::vector<std::string> entries;
+    while (dirent* entry = readdir(directory)) {
+        const std::string name = entry->d_name;
+        if (name.compare(0, strlen(RAPL_ZONE_PREFIX), RAPL_ZONE_PREFIX) == 0) {
+            entries.push_back(name);
+        }
+    }
+    closedir(directory);
+    std::sort(entries.begin(), entries.end());
+
+    for (const std::string& entry : entries) {
+        const std::string path = std::string(POWERCAP_PATH) + "/" + entry;
+
+        // "package-0" for packages, "dram" (numbered here after its package)
+        // for DRAM subzones. Core and uncore subzones are part of the
+        // package.
+        std::string name = ReadAttribute(path + "/name");
+        const std::string package =
+            entry.substr(strlen(RAPL_ZONE_PREFIX),
+                         entry.find(':', strlen(RAPL_ZONE_PREFIX)) -
+                         strlen(RAPL_ZONE_PREFIX));
+        if (name == "dram") {
+            name += "-" + package;
+        } else if (name.compare(0, 8, "package-") != 0) {
+            continue;
+        }
+
+        RaplZone zone;
+        zone.name = name;
+        zone.energyPath = path + "/energy_uj";
+        const std::string range = ReadAttribute(path + "/max_energy_range_uj");
+        uint64_t energy = 0;
+        if (range.empty() || !ReadEnergy(zone.energyPath, &energy)) {
+            std::cout << "Cannot read RAPL zone " << name << " (" << path
+                      << "), skipping it" << std::endl;
+            continue;
+        }
+        zone.maxEnergyRange = std::stoull(range);
+        zones.push_back(zone);
+    }
+
+    return zones;
+}
+
+std::vector<uint64_t> ReadZones(const std::vector<RaplZone>& zones) {
+    std::vector<uint64_t> energy(zones.size(), 0);
+    for (uint64_t i = 0; i < zones.size(); ++i) {
+        ReadEnergy(zones[i].energyPath, &energy[i]);
+    }
+    return energy;
+}
+
+void InitEnergyLog(EnergyLog* log) {
+    log->zones = FindRaplZones();
+    log->phases.clear();
+    log->inPhase = false;
+
+    if (log->zones.empty()) {
+        std::cout << "No readable RAPL zones, energy is not measured"
+                  << std::endl;
+    }
+}
+
+void BeginPhase(EnergyLog* log, const std::string& name,
+                uint64_t operations) {
+    EndPhase(log);
+
+    log->inPhase = true;
+    log->currentName = name;
+    log->currentOperations = operations;
+    log->start = std::chrono::steady_clock::now();
+    log->startEnergy = ReadZones(log->zones);
+}
+
+void EndPhase(EnergyLog* log) {
+    if (!log->inPhase) {
+        return;
+    }
+
+    const std::vector<uint64_t> endEnergy = ReadZones(log->zones);
+    const auto end = std::chrono::steady_clock::now();
+
+    EnergyPhase phase;
+    phase.name = log->currentName;
+    phase.seconds = std::chrono::duration<double>(end - log->start).count();
+    phase.operations = log->currentOperations;
+    for (uint64_t i = 0; i < log->zones.size(); ++i) {
+        // The counter wraps to 0 after max_energy_range_uj.
+        uint64_t delta = endEnergy[i] - log->startEnergy[i];
+        if (endEnergy[i] < log->startEnergy[i]) {
+            delta = log->zones[i].maxEnergyRange - log->startEnergy[i] +
+                endEnergy[i];
+        }
+        phase.joules.push_back(delta / MICROJOULES_PER_JOULE);
+    }
+    log->phases.push_back(phase);
+    log->inPhase = false;
+}
+
+void WriteEnergyLog(const EnergyLog& log, std::ostream& out) {
+    for (const EnergyPhase& phase : log.phases) {
+        if (log.zones.empty()) {
+            out << phase.name << " " << phase.seconds << " - - - -"
+                << std::endl;
+            continue;
+        }
+
+        for (uint64_t i = 0; i < log.zones.size(); ++i) {
+            out << phase.name << " " << phase.seconds << " "
+                << log.zones[i].name << " " << phase.joules[i] << " "
+                << phase.joules[i] / phase.seconds << " ";
+            if (phase.operations > 0) {
+                out << phase.joules[i] * 1e9 / phase.operations;
+            } else {
+                out << "-";
+            }
+            out << std::endl;
+        }
+    }
+}
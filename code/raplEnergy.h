@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Energy per experiment phase from the RAPL counters in powercap
+// (/sys/class/powercap/intel-rapl:*), e.g., to weigh the cost of a mitigation
+// against its effect on latency. Package zones are named "package-N" and their
+// DRAM subzones "dram-N". The counters are in microjoules and wrap at
+// max_energy_range_uj. A phase must be shorter than one wrap (minutes at full
+// power) to be counted correctly.
+//
+// Reading energy_uj needs root on kernels since 5.10. Without readable zones,
+// every phase reports time only.
+
+struct RaplZone {
+    std::string name;
+    std::string energyPath;
+    uint64_t maxEnergyRange;
+};
+
+// Readable package and DRAM zones, in a stable order.
+std::vector<RaplZone> FindRaplZones();
+
+// One closed phase: its wall time, joules per zone and the useful operations
+// done in it (0: not counted).
+struct EnergyPhase {
+    std::string name;
+    double seconds;
+    std::vector<double> joules;
+    uint64_t operations;
+};
+
+// Splits a run into consecutive phases. Each BeginPhase() closes the phase
+// before it.
+struct EnergyLog {
+    std::vector<RaplZone> zones;
+    std::vector<EnergyPhase> phases;
+
+    bool inPhase = false;
+    std::string currentName;
+    uint64_t currentOperations = 0;
+    std::chrono::steady_clock::time_point start;
+    std::vector<uint64_t> startEnergy;
+};
+
+void InitEnergyLog(EnergyLog* log);
+void BeginPhase(EnergyLog* log, const std::string& name,
+                uint64_t operations = 0);
+void EndPhase(EnergyLog* log);
+
+// Writes one line per phase and zone:
+//   PHASE SECONDS ZONE JOULES WATTS NANOJOULES_PER_OPERATION
+// with "-" where there are no operations.
+void WriteEnergyLog(const EnergyLog& log, std::ostream& out);
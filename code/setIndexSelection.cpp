@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "geometryProfile.h"
+#include "hugePages.h"
+#include "measurementKernels.h"
+#include "setIndexSelection.h"
+#include "toolUtils.h"
+
+// Timed windows per bank and condition, and accesses per window. About a
+// millisecond per bank and condition at LLC hit latency.
+const uint64_t SELECTION_WINDOWS = 50;
+const uint64_t SELECTION_WINDOW_ACCESSES = 2000;
+
+// Increase assumed without a reference load, in cycles.
+const double UNLOADED_INCREASE = 1.0;
+
+double Median(std::vector<double> values) {
+    assert(!values.empty());
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// Average access time of each window through the set at "head".
+std::vector<double> MeasureWindows(Node* head, uint64_t& garbage) {
+    Node* node = ChaseNodes(head, SELECTION_WINDOW_ACCESSES);
+    std::vector<double> windows;
+    for (uint64_t i = 0; i < SELECTION_WINDOWS; ++i) {
+        windows.push_back(
+            static_cast<double>(MeasureChase(&node,
+                                             SELECTION_WINDOW_ACCESSES)) /
+            SELECTION_WINDOW_ACCESSES);
+    }
+    garbage += node->padding[0];
+    return windows;
+}
+
+void RunReferenceLoad(Node* node, int coreID, std::atomic<bool>* started,
+                      const std::atomic<bool>* stop, uint64_t* garbage) {
+    PinToCore(coreID);
+    started->store(true);
+    while (!stop->load(std::memory_order_relaxed)) {
+        node = ChaseNodes(node, SELECTION_WINDOW_ACCESSES);
+    }
+    *garbage += node->padding[0];
+}
+
+// Scores one group of eviction sets. Runs on the probe core.
+void ScoreGroup(const std::vector<Node*>& heads, int probeCoreID,
+                int loadCoreID, SetIndexScore* score, uint64_t* garbage) {
+    PinToCore(probeCoreID);
+
+    std::vector<double> baselines;
+    std::vector<double> noises;
+    std::vector<double> increases;
+    std::vector<double> snrs;
+    for (Node* head : heads) {
+        const std::vector<double> quiet = MeasureWindows(head, *garbage);
+        double mean = 0;
+        for (double window : quiet) {
+            mean += window / quiet.size();
+        }
+        double variance = 0;
+        for (double window : quiet) {
+            variance += (window - mean) * (window - mean) / quiet.size();
+        }
+        // Window averages are whole-cycle quotients at best, so a noise of
+        // zero only means "below resolution".
+        const double noise =
+            std::max(std::sqrt(variance), 1.0 / SELECTION_WINDOW_ACCESSES);
+
+        double increase = UNLOADED_INCREASE;
+        if (loadCoreID >= 0) {
+            std::atomic<bool> started{false};
+            std::atomic<bool> stop{false};
+            std::thread load(RunReferenceLoad, head, loadCoreID, &started,
+                             &stop, garbage);
+            while (!started.load()) {
+                std::this_thread::yield();
+            }
+            const double loaded = Median(MeasureWindows(head, *garbage));
+            stop = true;
+            load.join();
+            increase = loaded - Median(quiet);
+        }
+
+        baselines.push_back(Median(quiet));
+        noises.push_back(noise);
+        increases.push_back(increase);
+        snrs.push_back(increase / noise);
+    }
+
+    score->baseline = Median(baselines);
+    score->noise = Median(noises);
+    score->loadedIncrease = Median(increases);
+    score->snr = Median(snrs);
+}
+
+std::vector<uint64_t> SampleSetIndices(uint64_t count, uint64_t seed,
+                                       const std::vector<uint64_t>& include) {
+    const uint64_t setsPerBank = Geometry().setsPerBank;
+    assert(count <= setsPerBank);
+
+    std::vector<uint64_t> setIndices;
+    for (uint64_t setIndex : include) {
+        assert(setIndex < setsPerBank);
+        if (setIndices.size() < count &&
+            std::find(setIndices.begin(), setIndices.end(), setIndex) ==
+            setIndices.end()) {
+            setIndices.push_back(setIndex);
+        }
+    }
+
+    SplitMix64 random(seed);
+    while (setIndices.size() < count) {
+        const uint64_t setIndex = random.Below(setsPerBank);
+        if (std::find(setIndices.begin(), setIndices.end(), setIndex) ==
+            setIndices.end()) {
+            setIndices.push_back(setIndex);
+        }
+    }
+    return setIndices;
+}
+
+std::vector<SetIndexScore> ScoreSetIndices(
+    const std::vector<uint64_t>& setIndices, int probeCoreID, int loadCoreID,
+    uint64_t& garbage) {
+    std::vector<SetIndexScore> scores;
+    for (uint64_t setIndex : setIndices) {
+        // An array per set index: with small pages, set indices with the same
+        // page offset bits share their candidates.
+        Node* array = AllocateCandidateArray(Geometry().arraySize);
+        const std::vector<Node*> heads = GetEvictionSetInArray(array, setIndex);
+        if (heads.empty()) {
+            std::cout << "No eviction sets for set index " << setIndex
+                      << ", not scored" << std::endl;
+            FreeCandidateArray(array);
+            continue;
+        }
+
+        SetIndexScore score;
+        score.setIndex = setIndex;
+        std::thread prober(ScoreGroup, heads, probeCoreID, loadCoreID, &score,
+                           &garbage);
+        prober.join();
+        scores.push_back(score);
+
+        FreeCandidateArray(array);
+    }
+    return scores;
+}
+
+std::vector<uint64_t> SelectSetIndices(uint64_t count, uint64_t samples,
+                                       const std::vector<uint64_t>& include,
+                                       int probeCoreID, int loadCoreID,
+                                       uint64_t& garbage) {
+    assert(count <= samples);
+
+    std::vector<SetIndexScore> scores = ScoreSetIndices(
+        SampleSetIndices(samples, ConstructionSeed(), include), probeCoreID,
+        loadCoreID, garbage);
+    std::stable_sort(scores.begin(), scores.end(),
+                     [](const SetIndexScore& a, const SetIndexScore& b) {
+                         return a.snr > b.snr;
+                     });
+
+    std::cout << "Set index selection on core " << probeCoreID
+              << (loadCoreID >= 0 ?
+                  ", reference load on core " + std::to_string(loadCoreID) :
+                  std::string(", no reference load (quietest wins)"))
+              << std::endl;
+    std::cout << "set index  baseline  noise  increase    SNR" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (const SetIndexScore& score : scores) {
+        std::cout << std::setw(9) << score.setIndex << std::setw(10)
+                  << score.baseline << std::setw(7) << score.noise
+                  << std::setw(10) << score.loadedIncrease << std::setw(7)
+                  << score.snr << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+
+    std::vector<uint64_t> selected;
+    for (uint64_t i = 0; i < count && i < scores.size(); ++i) {
+        selected.push_back(scores[i].setIndex);
+    }
+    std::cout << "Selected set indices:";
+    for (uint64_t setIndex : selected) {
+        std::cout << " " << setIndex;
+    }
+    std::cout << " (highest SNR of " << samples << " sampled)" << std::endl;
+
+    return selected;
+}
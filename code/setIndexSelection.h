@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Chooses the set indices of probe and victim sets by measurement instead of
+// fixing them. Some set indices give noisier probes than others (prefetchers,
+// other buffers of the process or of other tenants in the same sets).
+//
+// Every sampled set index gets a group of eviction sets, all built in one
+// candidate array. For each bank, a probe core times windows of chases through
+// the bank's set:
+// - quiet: the baseline latency and its noise (standard deviation of the
+//   window averages),
+// - loaded: while a reference load on another core chases the same set, which
+//   raises the latency by the bank's port contention.
+// The bank's SNR is the latency increase over the noise; a set index scores
+// the median over its banks.
+
+struct SetIndexScore {
+    uint64_t setIndex;
+    // Medians over the banks, in cycles per access.
+    double baseline;
+    double noise;
+    double loadedIncrease;
+    double snr;
+};
+
+// "count" distinct set indices, those in "include" first, then random ones
+// (SplitMix64 with "seed").
+std::vector<uint64_t> SampleSetIndices(uint64_t count, uint64_t seed,
+                                       const std::vector<uint64_t>& include);
+
+// Scores each of "setIndices" with probes on "probeCoreID" and the reference
+// load on "loadCoreID". Without a load core (-1), the increase counts as one
+// cycle, so that the quietest set index wins. Set indices which get no
+// eviction sets (see GetEvictionSetInArray()) are skipped.
+std::vector<SetIndexScore> ScoreSetIndices(
+    const std::vector<uint64_t>& setIndices, int probeCoreID, int loadCoreID,
+    uint64_t& garbage);
+
+// Samples "samples" set indices (including "include"), scores them and returns
+// the best "count" of them, best first. Prints every score and the choice.
+// Returns fewer if fewer were scored.
+std::vector<uint64_t> SelectSetIndices(uint64_t count, uint64_t samples,
+                                       const std::vector<uint64_t>& include,
+                                       int probeCoreID, int loadCoreID,
+                                       uint64_t& garbage);
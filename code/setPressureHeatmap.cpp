@@ -0,0 +1,356 @@
+// LLC set pressure heatmap: how often the lines of probe sets at many set
+// indices of every bank get evicted while a workload runs, to find hot data
+// which aliases to a few sets.
+//
+// Only one group of eviction sets is constructed, at BASE_SET_INDEX. Probe
+// sets for the other set indices are translations of it: every member keeps
+// its address above the set index bits and takes the new set index, which
+// keeps it on the same huge page. Whether a translated set still lies in one
+// slice depends on the slice hash, so each is checked against a translated
+// witness, a line which the base set evicts: the translated set has to evict
+// the translated witness too. Sets which fail are left out. With small pages
+// (under a hypervisor), only the set index bits inside the page offset can be
+// translated.
+//
+// Banks are numbered per construction and can be permuted by a translation,
+// so each set index's translated group is matched to the base group by latency
+// signature (see victimFootprint.h), measured from the cores the process may
+// run on. Set indices whose groups are incomplete or do not match are left
+// out. With a single core, banks keep the base group's numbers.
+//
+// The probe core then sweeps all probe sets, each one timed traversal which
+// also primes it for the next sweep. A traversal slower than the set's quiet
+// minimum by half the LLC miss threshold counts as an eviction. The probe core
+// is busy for at most the duty cycle of every DUTY_PERIOD_US, so that it can
+// run next to production workloads: the deadline is checked after every probe
+// set, and the sweep resumes where it stopped in the next period.
+//
+// Writes one line per time bin, bank and set index, with the number of times
+// the set was probed in the bin:
+//   TIME_S BANK SET_INDEX PROBES EVICTIONS
+// to results/set_pressure_heatmap.txt, and prints the hottest sets.
+//
+// $ make runSetPressureHeatmap ARGS="--duration-s 30"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "geometryProfile.h"
+#include "hugePages.h"
+#include "toolUtils.h"
+#include "victimFootprint.h"
+
+// Set index of the constructed group. Arbitrary.
+const uint64_t BASE_SET_INDEX = 27;
+
+const uint64_t DEFAULT_DURATION_S = 10;
+const int DEFAULT_PROBE_CORE = 0;
+// Every 32nd set index: 64 set indices with 2048 sets per bank.
+const uint64_t DEFAULT_SET_STEP = 32;
+const double DEFAULT_DUTY_CYCLE = 0.25;
+const uint64_t DEFAULT_BIN_MS = 100;
+
+const uint64_t DUTY_PERIOD_US = 10000;
+
+// Quiet traversals per probe set, whose minimum is the set's baseline.
+const uint64_t CALIBRATION_PASSES = 20;
+
+// Timed accesses per signature entry when matching banks. Far fewer than for
+// victim footprints, since there are many groups to match.
+const uint64_t LABEL_ACCESSES = 50000;
+
+// Hottest sets printed at the end.
+const uint64_t HOT_SPOTS = 10;
+
+const char* const RESULTS_FILENAME = "../results/set_pressure_heatmap.txt";
+
+struct ProbeSet {
+    uint64_t bank;
+    uint64_t setIndex;
+    Node* head;
+    uint64_t threshold;
+};
+
+// Address bits a translation may change: the set index bits, or with small
+// pages only those inside the page offset.
+uint64_t TranslationMask() {
+    const uint64_t mask = Geometry().SetIndexMask();
+    return GetProbeConfig().smallPages ? mask & (SMALL_PAGE_SIZE - 1) : mask;
+}
+
+Node* Translate(const Node* line, uint64_t setIndex) {
+    const uint64_t mask = TranslationMask();
+    const uintptr_t address = reinterpret_cast<uintptr_t>(line);
+    return reinterpret_cast<Node*>(
+        (address & ~mask) | ((setIndex << NUM_CACHE_LINE_BITS) & mask));
+}
+
+bool EvictsTwice(Node* head, const Node* line, uint64_t& garbage) {
+    return Probe(head, line, garbage, /*printOutput=*/false) &&
+        Probe(head, line, garbage, /*printOutput=*/false);
+}
+
+// A line of the array outside the sets which each set at "heads" evicts.
+std::vector<Node*> FindWitnesses(Node* array, const std::vector<Node*>& heads,
+                                 uint64_t& garbage) {
+    std::vector<Node*> members;
+    for (Node* head : heads) {
+        Node* node = head;
+        do {
+            members.push_back(node);
+            node = node->next;
+        } while (node != head);
+    }
+    std::sort(members.begin(), members.end());
+
+    std::vector<Node*> witnesses(heads.size(), nullptr);
+    uint64_t found = 0;
+    for (Node* candidate : FindCandidates(array, BASE_SET_INDEX)) {
+        if (found == heads.size()) {
+            break;
+        }
+        if (std::binary_search(members.begin(), members.end(), candidate)) {
+            continue;
+        }
+        for (uint64_t bank = 0; bank < heads.size(); ++bank) {
+            if (witnesses[bank] == nullptr &&
+                EvictsTwice(heads[bank], candidate, garbage)) {
+                witnesses[bank] = candidate;
+                ++found;
+                break;
+            }
+        }
+    }
+    return witnesses;
+}
+
+// Translations of the sets at "heads" to "setIndex", or nullptr for those
+// which do not evict their translated witness.
+std::vector<Node*> TranslateGroup(const std::vector<Node*>& heads,
+                                  const std::vector<Node*>& witnesses,
+                                  uint64_t setIndex, uint64_t& garbage) {
+    std::vector<Node*> translated;
+    for (uint64_t bank = 0; bank < heads.size(); ++bank) {
+        if (witnesses[bank] == nullptr) {
+            translated.push_back(nullptr);
+            continue;
+        }
+
+        std::vector<Node*> members;
+        Node* node = heads[bank];
+        do {
+            members.push_back(Translate(node, setIndex));
+            node = node->next;
+        } while (node != heads[bank]);
+
+        Node* head = LinkCandidates(members);
+        translated.push_back(
+            EvictsTwice(head, Translate(witnesses[bank], setIndex), garbage) ?
+            head : nullptr);
+    }
+    return translated;
+}
+
+// The minimum time of a traversal of the set, plus the eviction margin.
+uint64_t CalibrateThreshold(Node* head, uint64_t& garbage) {
+    const uint64_t ways = Geometry().waysPerBank;
+    Node* node = head;
+    uint64_t quiet = UINT64_MAX;
+    for (uint64_t i = 0; i < CALIBRATION_PASSES; ++i) {
+        quiet = std::min(quiet, MeasureChase(&node, ways));
+    }
+    garbage += node->padding[0];
+    return quiet + Geometry().llcCycleThreshold / 2;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t durationS = DEFAULT_DURATION_S;
+    int probeCore = DEFAULT_PROBE_CORE;
+    uint64_t setStep = DEFAULT_SET_STEP;
+    double dutyCycle = DEFAULT_DUTY_CYCLE;
+    uint64_t binMs = DEFAULT_BIN_MS;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--duration-s" && i + 1 < argc) {
+            durationS = std::stoull(argv[++i]);
+        } else if (arg == "--core" && i + 1 < argc) {
+            probeCore = std::stoi(argv[++i]);
+        } else if (arg == "--set-step" && i + 1 < argc) {
+            setStep = std::stoull(argv[++i]);
+        } else if (arg == "--duty-cycle" && i + 1 < argc) {
+            dutyCycle = std::stod(argv[++i]);
+        } else if (arg == "--bin-ms" && i + 1 < argc) {
+            binMs = std::stoull(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--duration-s S] [--core N] [--set-step N]"
+                      << " [--duty-cycle F] [--bin-ms MS]" << std::endl;
+            return 1;
+        }
+    }
+    if (setStep == 0 || binMs == 0 || dutyCycle <= 0 || dutyCycle > 1) {
+        std::cerr << "--set-step and --bin-ms must be positive, and "
+                  << "--duty-cycle in (0, 1]" << std::endl;
+        return 1;
+    }
+
+    const std::vector<int> cores = AllowedCores();
+    PinToCore(probeCore);
+
+    uint64_t garbage = 0;
+    Node* array = nullptr;
+    const std::vector<Node*> heads = GetEvictionSet(&array, BASE_SET_INDEX);
+    const std::vector<Node*> witnesses =
+        FindWitnesses(array, heads, garbage);
+
+    const bool matchBanks = cores.size() >= 2;
+    std::vector<std::vector<double>> reference;
+    if (matchBanks) {
+        reference = GroupLatencySignatures(heads, cores, garbage,
+                                           LABEL_ACCESSES);
+    } else {
+        std::cout << "Only one core: banks of translated sets keep the base "
+                  << "group's numbers" << std::endl;
+    }
+
+    // Translations which only differ outside the mask are the same lines.
+    std::vector<uint64_t> translations;
+    std::vector<ProbeSet> probeSets;
+    uint64_t incomplete = 0;
+    uint64_t unmatched = 0;
+    for (uint64_t setIndex = 0; setIndex < Geometry().setsPerBank;
+         setIndex += setStep) {
+        const uint64_t translation =
+            (setIndex << NUM_CACHE_LINE_BITS) & TranslationMask();
+        if (std::find(translations.begin(), translations.end(),
+                      translation) != translations.end()) {
+            continue;
+        }
+        translations.push_back(translation);
+
+        std::vector<Node*> group =
+            TranslateGroup(heads, witnesses, setIndex, garbage);
+        const bool complete =
+            std::find(group.begin(), group.end(), nullptr) == group.end();
+        if (matchBanks && !complete) {
+            ++incomplete;
+            continue;
+        }
+        if (matchBanks &&
+            !MatchBanks(reference, &group, cores, garbage, LABEL_ACCESSES)) {
+            ++unmatched;
+            continue;
+        }
+
+        for (uint64_t bank = 0; bank < group.size(); ++bank) {
+            if (group[bank] != nullptr) {
+                probeSets.push_back({bank, setIndex, group[bank], 0});
+            } else {
+                ++incomplete;
+            }
+        }
+    }
+    std::cout << "Probe sets: " << probeSets.size() << " at "
+              << translations.size() << " set indices ("
+              << (matchBanks ? "set indices" : "sets") << " left out: "
+              << incomplete << " not translatable";
+    if (matchBanks) {
+        std::cout << ", " << unmatched << " with unmatched banks";
+    }
+    std::cout << ")" << std::endl;
+    assert(!probeSets.empty());
+
+    for (ProbeSet& probeSet : probeSets) {
+        probeSet.threshold = CalibrateThreshold(probeSet.head, garbage);
+    }
+
+    // evictions[bin * probeSets.size() + set]
+    const uint64_t bins = (durationS * 1000 + binMs - 1) / binMs;
+    std::vector<uint64_t> probes(bins * probeSets.size(), 0);
+    std::vector<uint64_t> evictions(bins * probeSets.size(), 0);
+
+    std::cout << "Sweeping for " << durationS << " s on core " << probeCore
+              << " at a duty cycle of " << dutyCycle << std::endl;
+    const uint64_t ways = Geometry().waysPerBank;
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::seconds(durationS);
+    const auto period = std::chrono::microseconds(DUTY_PERIOD_US);
+    const auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        period * dutyCycle);
+    // Next probe set of the current sweep.
+    uint64_t next = 0;
+    uint64_t totalSweeps = 0;
+    for (auto periodStart = start; periodStart < end;
+         periodStart += period) {
+        const auto deadline = std::min(periodStart + busy, end);
+        auto now = std::chrono::steady_clock::now();
+        while (now < deadline) {
+            const uint64_t bin =
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    now - start).count() / binMs;
+            const uint64_t slot = bin * probeSets.size() + next;
+            Node* node = probeSets[next].head;
+            evictions[slot] +=
+                MeasureChase(&node, ways) > probeSets[next].threshold;
+            ++probes[slot];
+
+            next = (next + 1) % probeSets.size();
+            totalSweeps += next == 0;
+            now = std::chrono::steady_clock::now();
+        }
+        std::this_thread::sleep_until(periodStart + period);
+    }
+
+    std::ofstream results(RESULTS_FILENAME);
+    assert(results.is_open());
+    std::vector<uint64_t> totalEvictions(probeSets.size(), 0);
+    std::vector<uint64_t> totalProbes(probeSets.size(), 0);
+    for (uint64_t bin = 0; bin < bins; ++bin) {
+        for (uint64_t i = 0; i < probeSets.size(); ++i) {
+            const uint64_t slot = bin * probeSets.size() + i;
+            totalEvictions[i] += evictions[slot];
+            totalProbes[i] += probes[slot];
+            results << bin * binMs / 1000.0 << " " << probeSets[i].bank << " "
+                    << probeSets[i].setIndex << " " << probes[slot] << " "
+                    << evictions[slot] << std::endl;
+        }
+    }
+
+    std::vector<uint64_t> order(probeSets.size());
+    for (uint64_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) {
+        return totalEvictions[a] > totalEvictions[b];
+    });
+
+    std::cout << totalSweeps << " sweeps. Hottest sets:" << std::endl;
+    std::cout << "bank  set index  evicted" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (uint64_t i = 0; i < std::min<uint64_t>(HOT_SPOTS, order.size());
+         ++i) {
+        const ProbeSet& probeSet = probeSets[order[i]];
+        std::cout << std::setw(4) << probeSet.bank << std::setw(11)
+                  << probeSet.setIndex << std::setw(9)
+                  << (totalProbes[order[i]] > 0 ?
+                      static_cast<double>(totalEvictions[order[i]]) /
+                      totalProbes[order[i]] : 0.0)
+                  << std::endl;
+    }
+    std::cout << "Wrote " << RESULTS_FILENAME << std::endl;
+
+    FreeCandidateArray(array);
+    std::cout << "(Garbage: " << garbage << ")" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "geometryProfile.h"
+#include "sharedEvictionSet.h"
+
+// Rewrites the links of one eviction set from Node* into offsets from "base".
+// Returns the offset of the set's head.
+uint64_t ConvertToOffsets(char* base, Node* head) {
+    static_assert(sizeof(SharedNode) == sizeof(Node), "Node layouts differ");
+
+    std::vector<Node*> members;
+    Node* node = head;
+    do {
+        members.push_back(node);
+        node = node->next;
+    } while (node != head);
+
+    // Read all links before overwriting any of them.
+    std::vector<uint64_t> next(members.size()), prev(members.size());
+    for (uint64_t i = 0; i < members.size(); ++i) {
+        next[i] = reinterpret_cast<char*>(members[i]->next) - base;
+        prev[i] = reinterpret_cast<char*>(members[i]->prev) - base;
+    }
+    for (uint64_t i = 0; i < members.size(); ++i) {
+        SharedNode* shared = reinterpret_cast<SharedNode*>(members[i]);
+        shared->next = next[i];
+        shared->prev = prev[i];
+    }
+
+    return reinterpret_cast<char*>(head) - base;
+}
+
+bool CreateSharedEvictionSets(const std::string& path,
+                              const std::vector<uint64_t>& setIndices,
+                              SharedEvictionSets* shared) {
+    const GeometryProfile& geometry = Geometry();
+
+    assert(!setIndices.empty() && setIndices.size() <= MAX_SHARED_GROUPS);
+    static_assert(sizeof(SharedEvictionSetDescriptor) <= HUGE_PAGE_SIZE,
+                  "Descriptor does not fit its huge page");
+
+    const uint64_t size =
+        HUGE_PAGE_SIZE + setIndices.size() * geometry.arraySize;
+
+    const int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0660);
+    if (fd < 0) {
+        std::cerr << "Could not create " << path << ": " << strerror(errno)
+                  << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, size) != 0) {
+        std::cerr << "Could not size " << path << ": " << strerror(errno)
+                  << std::endl;
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "Could not map " << path << ": " << strerror(errno)
+                  << ". Is it on a hugetlbfs mount with enough free pages?"
+                  << std::endl;
+        return false;
+    }
+
+    shared->base = static_cast<char*>(map);
+    shared->size = size;
+    shared->descriptor =
+        reinterpret_cast<SharedEvictionSetDescriptor*>(shared->base);
+
+    SharedEvictionSetDescriptor* descriptor = shared->descriptor;
+    memset(descriptor, 0, sizeof(*descriptor));
+    descriptor->magic = SHARED_EVICTION_SET_MAGIC;
+    descriptor->version = SHARED_EVICTION_SET_VERSION;
+    descriptor->llcBanks = geometry.llcBanks;
+    descriptor->waysPerBank = geometry.waysPerBank;
+    descriptor->mappingSize = size;
+
+    for (uint64_t g = 0; g < setIndices.size(); ++g) {
+        SharedEvictionSetGroup& group = descriptor->groups[g];
+        group.setIndex = setIndices[g];
+        group.arrayOffset = HUGE_PAGE_SIZE + g * geometry.arraySize;
+
+        Node* array = reinterpret_cast<Node*>(shared->base + group.arrayOffset);
+        const std::vector<Node*> heads =
+            GetEvictionSetInArray(array, setIndices[g]);
+        assert(heads.size() == geometry.llcBanks);
+
+        for (uint64_t bank = 0; bank < geometry.llcBanks; ++bank) {
+            group.headOffsets[bank] = ConvertToOffsets(shared->base,
+                                                       heads[bank]);
+        }
+        ++descriptor->numGroups;
+    }
+
+    // Publish only once everything else is written.
+    __atomic_store_n(&descriptor->ready, 1, __ATOMIC_RELEASE);
+
+    std::cout << "Published " << descriptor->numGroups
+              << " groups of eviction sets in " << path << std::endl;
+
+    return true;
+}
+
+bool AttachSharedEvictionSets(const std::string& path,
+                              SharedEvictionSets* shared) {
+    const GeometryProfile& geometry = Geometry();
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Could not open " << path << ": " << strerror(errno)
+                  << std::endl;
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 ||
+        static_cast<uint64_t>(status.st_size) < HUGE_PAGE_SIZE) {
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "Could not map " << path << ": " << strerror(errno)
+                  << std::endl;
+        return false;
+    }
+
+    shared->base = static_cast<char*>(map);
+    shared->size = status.st_size;
+    shared->descriptor =
+        reinterpret_cast<SharedEvictionSetDescriptor*>(shared->base);
+
+    const SharedEvictionSetDescriptor* descriptor = shared->descriptor;
+    const bool valid = descriptor->magic == SHARED_EVICTION_SET_MAGIC &&
+        descriptor->version == SHARED_EVICTION_SET_VERSION &&
+        __atomic_load_n(&descriptor->ready, __ATOMIC_ACQUIRE) == 1 &&
+        descriptor->llcBanks == geometry.llcBanks &&
+        descriptor->waysPerBank == geometry.waysPerBank &&
+        descriptor->mappingSize == shared->size &&
+        descriptor->numGroups <= MAX_SHARED_GROUPS;
+
+    if (!valid) {
+        std::cerr << path << " does not hold complete eviction sets for this "
+                  << "geometry" << std::endl;
+        DetachSharedEvictionSets(shared);
+        return false;
+    }
+
+    // Cheap structural check: every set is a closed list of waysPerBank
+    // nodes inside the mapping.
+    for (uint64_t g = 0; g < descriptor->numGroups; ++g) {
+        for (uint64_t bank = 0; bank < geometry.llcBanks; ++bank) {
+            const uint64_t headOffset = descriptor->groups[g].headOffsets[bank];
+            uint64_t offset = headOffset;
+            uint64_t count = 0;
+            do {
+                if (offset >= shared->size || count > geometry.waysPerBank) {
+                    DetachSharedEvictionSets(shared);
+                    return false;
+                }
+                offset = reinterpret_cast<const SharedNode*>(
+                    shared->base + offset)->next;
+                ++count;
+            } while (offset != headOffset);
+
+            if (count != geometry.waysPerBank) {
+                DetachSharedEvictionSets(shared);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void DetachSharedEvictionSets(SharedEvictionSets* shared) {
+    if (shared->base != nullptr) {
+        munmap(shared->base, shared->size);
+    }
+    shared->base = nullptr;
+    shared->size = 0;
+    shared->descriptor = nullptr;
+}
+
+SharedNode* SharedEvictionSetHead(const SharedEvictionSets& shared,
+                                  uint64_t setIndex, uint64_t bank) {
+    assert(bank < Geometry().llcBanks);
+
+    const SharedEvictionSetDescriptor* descriptor = shared.descriptor;
+    for (uint64_t g = 0; g < descriptor->numGroups; ++g) {
+        if (descriptor->groups[g].setIndex == setIndex) {
+            return reinterpret_cast<SharedNode*>(
+                shared.base + descriptor->groups[g].headOffsets[bank]);
+        }
+    }
+    return nullptr;
+}
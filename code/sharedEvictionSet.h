@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "geometryProfile.h"
+
+// Eviction sets which live in a named hugetlbfs file, so that a builder
+// process constructs them once and any number of other processes (possibly in
+// other cgroups) map and use them directly.
+//
+// Layout of the file:
+//   [0, 2 MiB)                          SharedEvictionSetDescriptor
+//   [2 MiB + g * arraySize, +arraySize) array of group g
+// where "arraySize" is that of the builder's geometry profile.
+//
+// Every process maps the file at a different address, so links between nodes
+// are stored as byte offsets from the start of the mapping instead of Node*.
+
+const char* const DEFAULT_SHARED_EVICTION_SET_PATH =
+    "/mnt/hugetlbfs/llcEvictionSets";
+
+const uint64_t SHARED_EVICTION_SET_MAGIC = 0x4c4c43534554534bULL;
+const uint64_t SHARED_EVICTION_SET_VERSION = 2;
+const uint64_t MAX_SHARED_GROUPS = 8;
+
+// Same size and layout as Node, with offset links.
+struct __attribute__((packed, aligned(64))) SharedNode {
+    uint64_t next;
+    uint64_t prev;
+    uint64_t padding[6];
+};
+
+// The eviction sets for one set index (one set per LLC bank).
+struct SharedEvictionSetGroup {
+    uint64_t setIndex;
+    uint64_t arrayOffset;
+    // Only the first "llcBanks" entries are used.
+    uint64_t headOffsets[MAX_LLC_BANKS];
+};
+
+struct SharedEvictionSetDescriptor {
+    uint64_t magic;
+    uint64_t version;
+    // Geometry the sets were built for. Must match the attaching process.
+    uint64_t llcBanks;
+    uint64_t waysPerBank;
+    uint64_t mappingSize;
+    uint64_t numGroups;
+    // Set to 1 by the builder once every group is complete.
+    uint64_t ready;
+    SharedEvictionSetGroup groups[MAX_SHARED_GROUPS];
+};
+
+struct SharedEvictionSets {
+    char* base = nullptr;
+    uint64_t size = 0;
+    SharedEvictionSetDescriptor* descriptor = nullptr;
+};
+
+// Builds one group of eviction sets per set index inside a new hugetlbfs file
+// at "path" and publishes them through the descriptor. The mapping stays
+// valid after the builder exits, until the file is removed.
+bool CreateSharedEvictionSets(const std::string& path,
+                              const std::vector<uint64_t>& setIndices,
+                              SharedEvictionSets* shared);
+
+// Maps eviction sets published by another process. Returns false if the file
+// does not exist, is not complete yet, or was built for another geometry.
+bool AttachSharedEvictionSets(const std::string& path,
+                              SharedEvictionSets* shared);
+
+void DetachSharedEvictionSets(SharedEvictionSets* shared);
+
+// Returns the head of the given bank's eviction set in the group built for
+// "setIndex", or nullptr if there is no such group.
+SharedNode* SharedEvictionSetHead(const SharedEvictionSets& shared,
+                                  uint64_t setIndex, uint64_t bank);
+
+// Following a link costs one extra add on top of the load, compared to Node.
+inline SharedNode* NextSharedNode(const char* base, const SharedNode* node) {
+    return reinterpret_cast<SharedNode*>(const_cast<char*>(base) + node->next);
+}
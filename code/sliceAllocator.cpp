@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+#include "constants.h"
+#include "evictionSetBuilder.h"
+#include "hugePages.h"
+#include "sliceAllocator.h"
+#include "victimFootprint.h"
+
+// Members of each set at "heads", in list order.
+std::vector<std::vector<Node*>> BankLines(const std::vector<Node*>& heads) {
+    std::vector<std::vector<Node*>> lines(heads.size());
+    for (uint64_t bank = 0; bank < heads.size(); ++bank) {
+        Node* node = heads[bank];
+        do {
+            lines[bank].push_back(node);
+            node = node->next;
+        } while (node != heads[bank]);
+    }
+    return lines;
+}
+
+SliceAllocator::SliceAllocator(const EvictionSetBuilder& builder,
+                               const SliceAllocatorOptions& options,
+                               uint64_t& garbage)
+    : cores(options.cores) {
+    assert(!options.setIndices.empty());
+    assert(!cores.empty());
+    assert(options.setIndices.size() == 1 || cores.size() >= 2);
+
+    const uint64_t linesPerSet = options.linesPerSet > 0 ?
+        options.linesPerSet : builder.geometry.waysPerBank / 2;
+    assert(linesPerSet <= builder.geometry.waysPerBank);
+
+    // Lines by group and bank. Matching measures with the eviction sets, so
+    // their lists stay intact until every group is done.
+    std::vector<std::vector<std::vector<Node*>>> lines;
+    for (uint64_t setIndex : options.setIndices) {
+        EvictionSetGroup group = builder.Build(setIndex);
+        std::vector<Node*> heads = group.Heads();
+
+        if (groups.empty()) {
+            signatures = GroupLatencySignatures(heads, cores, garbage);
+        } else if (!MatchBanks(signatures, &heads, cores, garbage)) {
+            std::cout << "Set index " << setIndex << ": banks do not match "
+                      << "the first set index, leaving it out" << std::endl;
+            continue;
+        }
+
+        lines.push_back(BankLines(heads));
+        groups.push_back(std::move(group));
+    }
+
+    // Free lists take the groups round-robin, so that consecutive allocations
+    // spread over the set indices.
+    const uint64_t banks = signatures.size();
+    freeLists.assign(banks, nullptr);
+    freeCounts.assign(banks, 0);
+    for (uint64_t bank = 0; bank < banks; ++bank) {
+        std::vector<Node*> bankLines;
+        for (uint64_t i = 0; i < linesPerSet; ++i) {
+            for (const std::vector<std::vector<Node*>>& groupLines : lines) {
+                if (i < groupLines[bank].size()) {
+                    bankLines.push_back(groupLines[bank][i]);
+                }
+            }
+        }
+
+        for (auto line = bankLines.rbegin(); line != bankLines.rend();
+             ++line) {
+            lineBanks[*line] = bank;
+            Free(*line);
+        }
+    }
+
+    // Only the huge pages holding pooled lines are needed from here on. The
+    // other members of the sets are left dangling.
+    uint64_t released = 0;
+    for (uint64_t g = 0; g < groups.size(); ++g) {
+        std::vector<const void*> keep;
+        for (const std::vector<Node*>& bankLines : lines[g]) {
+            keep.insert(keep.end(), bankLines.begin(),
+                        bankLines.begin() +
+                        std::min<uint64_t>(linesPerSet, bankLines.size()));
+        }
+        released += ReleaseUnusedRegions(groups[g].Arena().Data(), keep);
+    }
+
+    std::cout << "Slice allocator: " << groups.size() << " set indices, "
+              << "free lines per bank:";
+    for (uint64_t count : freeCounts) {
+        std::cout << " " << count;
+    }
+    std::cout << ", released " << released / MiB << " of "
+              << groups.size() * builder.geometry.arraySize / MiB
+              << " MiB of arenas" << std::endl;
+}
+
+uint64_t SliceAllocator::CoreIndex(int coreID) const {
+    const auto core = std::find(cores.begin(), cores.end(), coreID);
+    assert(core != cores.end());
+    return core - cores.begin();
+}
+
+uint64_t SliceAllocator::LocalBank(int coreID) const {
+    const uint64_t core = CoreIndex(coreID);
+    uint64_t local = 0;
+    for (uint64_t bank = 1; bank < signatures.size(); ++bank) {
+        if (signatures[bank][core] < signatures[local][core]) {
+            local = bank;
+        }
+    }
+    return local;
+}
+
+uint64_t SliceAllocator::RemoteBank(int coreID) const {
+    const uint64_t core = CoreIndex(coreID);
+    uint64_t remote = 0;
+    for (uint64_t bank = 1; bank < signatures.size(); ++bank) {
+        if (signatures[bank][core] > signatures[remote][core]) {
+            remote = bank;
+        }
+    }
+    return remote;
+}
+
+uint64_t SliceAllocator::SharedBank(const std::vector<int>& coreIDs) const {
+    uint64_t shared = 0;
+    double sharedLatency = 0;
+    for (uint64_t bank = 0; bank < signatures.size(); ++bank) {
+        double latency = 0;
+        for (int coreID : coreIDs) {
+            latency += Latency(bank, coreID);
+        }
+        if (bank == 0 || latency < sharedLatency) {
+            shared = bank;
+            sharedLatency = latency;
+        }
+    }
+    return shared;
+}
+
+double SliceAllocator::Latency(uint64_t bank, int coreID) const {
+    assert(bank < signatures.size());
+    return signatures[bank][CoreIndex(coreID)];
+}
+
+void* SliceAllocator::Allocate(uint64_t bank) {
+    assert(bank < Banks());
+    FreeLine* line = freeLists[bank];
+    if (line != nullptr) {
+        freeLists[bank] = line->next;
+        --freeCounts[bank];
+    }
+    return line;
+}
+
+void SliceAllocator::Free(void* line) {
+    const uint64_t bank = BankOf(line);
+    FreeLine* freeLine = static_cast<FreeLine*>(line);
+    freeLine->next = freeLists[bank];
+    freeLists[bank] = freeLine;
+    ++freeCounts[bank];
+}
+
+uint64_t SliceAllocator::BankOf(const void* line) const {
+    const auto entry = lineBanks.find(line);
+    assert(entry != lineBanks.end());
+    return entry->second;
+}
+
+uint64_t SliceAllocator::FreeLines(uint64_t bank) const {
+    assert(bank < Banks());
+    return freeCounts[bank];
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "evictionSetBuilder.h"
+
+// Cache lines placed in a chosen LLC bank, e.g., the bank next to the core of
+// the thread which uses them, where LLC hits are fastest.
+//
+// The pool is built from eviction set groups at a few set indices, each in its
+// own arena on huge pages. The members of an eviction set are the lines of its
+// bank at that set index: as many as the bank has ways, so other lines there
+// would only compete with them. Banks of later groups are matched to the first
+// group's by their latency signatures (see victimFootprint.h), which also give
+// each core's local bank: the one it reaches fastest.
+//
+// Other data of the process shares the sets, so the pool keeps "linesPerSet"
+// of the waysPerBank lines per set index and bank. More set indices give more
+// lines per bank, at one construction each. Lines of one set index also share
+// their L1 and L2 sets, so a structure with more of them than the L2 has ways
+// is served from the LLC.
+//
+// Capacity cost: every set index takes an arena of the profile's arraySize
+// (twice the LLC) while its group is built. Once the pool is set up, the huge
+// pages without a pooled line are released (THP arenas only). That still
+// leaves up to one 2 MiB page per pooled line, and the lines of a set index
+// spread over the whole arena: 12 banks of 10 lines (7.5 KiB) usually keep
+// most of a 60 MiB arena. So each set index costs close to arraySize for as
+// long as the allocator lives. The groups' eviction sets no longer work after
+// the release.
+//
+// Not thread safe. Construction shares the global state of eviction set builds
+// (see evictionSetBuilder.h).
+
+struct SliceAllocatorOptions {
+    std::vector<uint64_t> setIndices = {0};
+    // At most waysPerBank. 0: waysPerBank / 2.
+    uint64_t linesPerSet = 0;
+    // Cores whose access times tell the banks apart (see LocalBank()). At
+    // least two if there is more than one set index.
+    std::vector<int> cores;
+};
+
+class SliceAllocator {
+  public:
+    // Builds a group per set index with "builder". Set indices whose banks do
+    // not match the first group's are left out of the pool.
+    SliceAllocator(const EvictionSetBuilder& builder,
+                   const SliceAllocatorOptions& options, uint64_t& garbage);
+
+    SliceAllocator(const SliceAllocator&) = delete;
+    SliceAllocator& operator=(const SliceAllocator&) = delete;
+
+    uint64_t Banks() const { return freeLists.size(); }
+
+    // The bank "coreID" (one of the options' cores) reaches fastest and
+    // slowest.
+    uint64_t LocalBank(int coreID) const;
+    uint64_t RemoteBank(int coreID) const;
+    // The bank with the lowest sum of access times from "coreIDs", e.g., for
+    // lines two cores pass between them.
+    uint64_t SharedBank(const std::vector<int>& coreIDs) const;
+    // Average access time of "bank" from "coreID", in cycles.
+    double Latency(uint64_t bank, int coreID) const;
+
+    // A free, CACHE_LINE_SIZE-aligned line in "bank", or nullptr if the bank
+    // has none left.
+    void* Allocate(uint64_t bank);
+    // Returns a line from Allocate() to its bank.
+    void Free(void* line);
+
+    // Constructs a "T" of at most a cache line in "bank", or returns nullptr.
+    template <typename T, typename... Args>
+    T* New(uint64_t bank, Args&&... args) {
+        static_assert(sizeof(T) <= CACHE_LINE_SIZE &&
+                      alignof(T) <= CACHE_LINE_SIZE);
+        void* line = Allocate(bank);
+        return line == nullptr ? nullptr :
+            new (line) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    void Delete(T* object) {
+        object->~T();
+        Free(object);
+    }
+
+    // Bank of a line of the pool.
+    uint64_t BankOf(const void* line) const;
+    uint64_t FreeLines(uint64_t bank) const;
+
+  private:
+    struct FreeLine {
+        FreeLine* next;
+    };
+
+    // Access time of the first group's sets, [bank][core].
+    std::vector<std::vector<double>> signatures;
+    std::vector<int> cores;
+
+    std::vector<EvictionSetGroup> groups;
+    std::vector<FreeLine*> freeLists;
+    std::vector<uint64_t> freeCounts;
+    std::unordered_map<const void*, uint64_t> lineBanks;
+
+    uint64_t CoreIndex(int coreID) const;
+};
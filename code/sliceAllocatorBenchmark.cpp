@@ -0,0 +1,149 @@
+// Benchmark of the slice allocator (sliceAllocator.h): the LLC hit latency of
+// a pointer chase whose nodes are placed
+// - in the bank local to the chasing core,
+// - in random banks, as an ordinary allocator would,
+// - in the bank the core reaches slowest.
+// All placements take their nodes from the same set indices, so they only
+// differ in the banks. With more nodes per set index than the L2 has ways, as
+// by default on Broadwell (10 per set index and bank, 8 L2 ways), every access
+// misses the L1 and L2 and hits in the LLC.
+//
+// The cores the process may run on tell the banks apart, and the first of them
+// chases.
+//
+// $ make runSliceAllocatorBenchmark
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "evictionSetBuilder.h"
+#include "geometryProfile.h"
+#include "sliceAllocator.h"
+#include "toolUtils.h"
+
+const uint64_t DEFAULT_SET_INDICES = 8;
+
+// Set indices of the pool, as for victim footprints in portAttack.
+const uint64_t SET_INDEX_STRIDE = 97;
+
+// Timed passes per placement (the median counts), and accesses per node in
+// each.
+const uint64_t REPETITIONS = 11;
+const uint64_t ACCESSES_PER_NODE = 10000;
+
+// Allocates "count" nodes with "nextBank" choosing the bank of each, links
+// them in random order and returns the median cycles per access of chasing
+// them.
+template <typename BankChooser>
+double MeasurePlacement(SliceAllocator& allocator, uint64_t count,
+                        BankChooser nextBank, uint64_t& garbage) {
+    std::vector<Node*> nodes;
+    for (uint64_t i = 0; i < count; ++i) {
+        Node* node = allocator.New<Node>(nextBank());
+        assert(node != nullptr);
+        nodes.push_back(node);
+    }
+    ShuffleNodes(nodes, ConstructionSeed());
+    Node* node = LinkCandidates(nodes);
+
+    const uint64_t accesses = ACCESSES_PER_NODE * count;
+    MeasureChase(&node, accesses);
+    std::vector<double> times;
+    for (uint64_t i = 0; i < REPETITIONS; ++i) {
+        times.push_back(static_cast<double>(MeasureChase(&node, accesses)) /
+                        accesses);
+    }
+    garbage += node->padding[0];
+
+    for (Node* line : nodes) {
+        allocator.Delete(line);
+    }
+
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<uint64_t> setIndices;
+    for (uint64_t i = 0; i < DEFAULT_SET_INDICES; ++i) {
+        setIndices.push_back(i * SET_INDEX_STRIDE % Geometry().setsPerBank);
+    }
+    uint64_t linesPerSet = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--set-indices" && i + 1 < argc) {
+            setIndices = ParseList(argv[++i]);
+        } else if (arg == "--lines-per-set" && i + 1 < argc) {
+            linesPerSet = std::stoull(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--set-indices I,J,...] [--lines-per-set N]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    SliceAllocatorOptions options;
+    options.setIndices = setIndices;
+    options.linesPerSet = linesPerSet;
+    options.cores = AllowedCores();
+    if (setIndices.size() > 1 && options.cores.size() < 2) {
+        std::cerr << "Matching the banks of several set indices needs at "
+                  << "least two cores" << std::endl;
+        return 1;
+    }
+
+    // Chase from the first core.
+    const int core = options.cores[0];
+    PinToCore(core);
+
+    uint64_t garbage = 0;
+    EvictionSetBuilder builder;
+    SliceAllocator allocator(builder, options, garbage);
+
+    const uint64_t local = allocator.LocalBank(core);
+    const uint64_t remote = allocator.RemoteBank(core);
+    const uint64_t count =
+        std::min(allocator.FreeLines(local), allocator.FreeLines(remote));
+    assert(count > 0);
+
+    SplitMix64 random(ConstructionSeed());
+    const double localTime = MeasurePlacement(
+        allocator, count, [&]() { return local; }, garbage);
+    const double randomTime = MeasurePlacement(
+        allocator, count,
+        [&]() {
+            uint64_t bank = random.Below(allocator.Banks());
+            while (allocator.FreeLines(bank) == 0) {
+                bank = random.Below(allocator.Banks());
+            }
+            return bank;
+        },
+        garbage);
+    const double remoteTime = MeasurePlacement(
+        allocator, count, [&]() { return remote; }, garbage);
+
+    std::cout << count << " nodes chased from core " << core
+              << ", local bank " << local << ", remote bank " << remote
+              << std::endl;
+    std::cout << "placement  cycles per access" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "local      " << std::setw(17) << localTime << std::endl;
+    std::cout << "random     " << std::setw(17) << randomTime << std::endl;
+    std::cout << "remote     " << std::setw(17) << remoteTime << std::endl;
+    std::cout << "Local placement saves " << randomTime - localTime
+              << " cycles per access over random placement ("
+              << 100 * (randomTime - localTime) / randomTime << "%)"
+              << std::endl;
+
+    std::cout << "(Garbage: " << garbage << ")" << std::endl;
+
+    return 0;
+}
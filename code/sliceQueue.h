@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "sliceAllocator.h"
+
+// Single-producer, single-consumer ring whose lines can be placed in one LLC
+// bank. Every line of the queue passes between the producer's and consumer's
+// cores through the LLC bank it maps to, so the bank with the lowest combined
+// access time from both cores (SliceAllocator::SharedBank()) makes every
+// handoff cheaper.
+//
+// The queue is made of separate cache lines, not an array: the producer's
+// index, the consumer's index, and one line per slot. Each side keeps its copy
+// of the other's index in the queue object, which is only touched by that
+// side.
+
+template <typename T>
+class SpscQueue {
+  public:
+    // "lines" are two index lines, then the slots. "release" gets them back on
+    // destruction.
+    SpscQueue(std::vector<void*> lines,
+              std::function<void(const std::vector<void*>&)> release)
+        : lines(std::move(lines)), release(std::move(release)) {
+        static_assert(sizeof(T) <= CACHE_LINE_SIZE &&
+                      alignof(T) <= CACHE_LINE_SIZE &&
+                      std::is_trivially_copyable<T>::value);
+        assert(this->lines.size() > 2);
+
+        tail = new (this->lines[0]) std::atomic<uint64_t>(0);
+        head = new (this->lines[1]) std::atomic<uint64_t>(0);
+        slots.assign(this->lines.begin() + 2, this->lines.end());
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    ~SpscQueue() {
+        release(lines);
+    }
+
+    uint64_t Capacity() const { return slots.size(); }
+
+    // Producer side. Returns false if the queue is full.
+    bool TryPush(const T& value) {
+        const uint64_t position = tail->load(std::memory_order_relaxed);
+        if (position - producer.otherIndex == slots.size()) {
+            producer.otherIndex = head->load(std::memory_order_acquire);
+            if (position - producer.otherIndex == slots.size()) {
+                return false;
+            }
+        }
+        new (slots[position % slots.size()]) T(value);
+        tail->store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool TryPop(T* value) {
+        const uint64_t position = head->load(std::memory_order_relaxed);
+        if (position == consumer.otherIndex) {
+            consumer.otherIndex = tail->load(std::memory_order_acquire);
+            if (position == consumer.otherIndex) {
+                return false;
+            }
+        }
+        *value = *static_cast<T*>(slots[position % slots.size()]);
+        head->store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+  private:
+    struct alignas(CACHE_LINE_SIZE) SideState {
+        uint64_t otherIndex = 0;
+    };
+
+    std::vector<void*> lines;
+    std::function<void(const std::vector<void*>&)> release;
+
+    std::atomic<uint64_t>* tail;
+    std::atomic<uint64_t>* head;
+    std::vector<void*> slots;
+
+    SideState producer;
+    SideState consumer;
+};
+
+// A queue of "capacity" slots with every line in "bank" of "allocator", or
+// nullptr if the bank has too few free lines. The allocator must outlive the
+// queue.
+template <typename T>
+std::unique_ptr<SpscQueue<T>> PlaceQueue(SliceAllocator& allocator,
+                                         uint64_t bank, uint64_t capacity) {
+    if (allocator.FreeLines(bank) < capacity + 2) {
+        return nullptr;
+    }
+
+    std::vector<void*> lines;
+    for (uint64_t i = 0; i < capacity + 2; ++i) {
+        lines.push_back(allocator.Allocate(bank));
+    }
+    return std::make_unique<SpscQueue<T>>(
+        lines, [&allocator](const std::vector<void*>& lines) {
+            for (void* line : lines) {
+                allocator.Free(line);
+            }
+        });
+}
+
+// The same queue in one ordinary allocation, whose lines fall in whichever
+// banks they hash to.
+template <typename T>
+std::unique_ptr<SpscQueue<T>> DefaultQueue(uint64_t capacity) {
+    char* memory = static_cast<char*>(
+        std::aligned_alloc(CACHE_LINE_SIZE, (capacity + 2) * CACHE_LINE_SIZE));
+    assert(memory != nullptr);
+
+    std::vector<void*> lines;
+    for (uint64_t i = 0; i < capacity + 2; ++i) {
+        lines.push_back(memory + i * CACHE_LINE_SIZE);
+    }
+    return std::make_unique<SpscQueue<T>>(
+        lines, [](const std::vector<void*>& lines) { std::free(lines[0]); });
+}
@@ -0,0 +1,247 @@
+// Benchmark of slice-aware queue placement (sliceQueue.h) between a producer
+// and a consumer core. Compares queues whose lines are
+// - in the bank with the lowest combined access time from both cores,
+// - in one ordinary allocation,
+// - in the bank with the highest combined access time,
+// by
+// - ping-pong: the producer sends a message and waits for the reply on a
+//   second queue, which gives the round trip latency,
+// - throughput: the producer streams messages as fast as the consumer takes
+//   them.
+//
+// The cores the process may run on tell the banks apart (see
+// sliceAllocator.h). The first is the producer, and the second the consumer,
+// unless --consumer names another.
+//
+// $ make runSliceQueueBenchmark
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <x86intrin.h>
+
+#include "constants.h"
+#include "evictionSetBuilder.h"
+#include "geometryProfile.h"
+#include "sliceAllocator.h"
+#include "sliceQueue.h"
+#include "toolUtils.h"
+
+const uint64_t DEFAULT_SET_INDICES = 8;
+
+// Set indices of the line pool, as in sliceAllocatorBenchmark.
+const uint64_t SET_INDEX_STRIDE = 97;
+
+const uint64_t PING_PONG_SLOTS = 4;
+const uint64_t PING_PONG_WARMUP = 10000;
+const uint64_t PING_PONG_ROUND_TRIPS = 1000000;
+
+const uint64_t THROUGHPUT_SLOTS = 32;
+const uint64_t THROUGHPUT_WARMUP = 100000;
+const uint64_t THROUGHPUT_MESSAGES = 10000000;
+
+// A full line, as a message with a small payload.
+struct Message {
+    uint64_t sequence;
+    uint64_t payload[7];
+};
+
+using Queue = std::unique_ptr<SpscQueue<Message>>;
+
+void Send(SpscQueue<Message>& queue, const Message& message) {
+    while (!queue.TryPush(message)) {
+    }
+}
+
+Message Receive(SpscQueue<Message>& queue) {
+    Message message;
+    while (!queue.TryPop(&message)) {
+    }
+    return message;
+}
+
+// Echoes "count" messages from "requests" back on "responses".
+void RunEcho(SpscQueue<Message>* requests, SpscQueue<Message>* responses,
+             uint64_t count, int coreID) {
+    PinToCore(coreID);
+    for (uint64_t i = 0; i < count; ++i) {
+        Send(*responses, Receive(*requests));
+    }
+}
+
+// Cycles per round trip. Runs on the producer core.
+double PingPong(const Queue& requests, const Queue& responses,
+                int consumerCoreID) {
+    std::thread echo(RunEcho, requests.get(), responses.get(),
+                     PING_PONG_WARMUP + PING_PONG_ROUND_TRIPS,
+                     consumerCoreID);
+
+    Message message = {};
+    for (uint64_t i = 0; i < PING_PONG_WARMUP; ++i) {
+        message.sequence = i;
+        Send(*requests, message);
+        const Message response = Receive(*responses);
+        assert(response.sequence == i);
+    }
+
+    const uint64_t start = __rdtsc();
+    for (uint64_t i = 0; i < PING_PONG_ROUND_TRIPS; ++i) {
+        message.sequence = i;
+        Send(*requests, message);
+        Receive(*responses);
+    }
+    const uint64_t end = __rdtsc();
+
+    echo.join();
+    return static_cast<double>(end - start) / PING_PONG_ROUND_TRIPS;
+}
+
+// Takes "count" messages, and stamps the time after the last one.
+void RunConsumer(SpscQueue<Message>* queue, uint64_t count, int coreID,
+                 std::atomic<uint64_t>* endTsc, uint64_t* garbage) {
+    PinToCore(coreID);
+    for (uint64_t i = 0; i < count; ++i) {
+        *garbage += Receive(*queue).payload[0];
+    }
+    endTsc->store(__rdtsc());
+}
+
+// Cycles per message. Runs on the producer core.
+double Throughput(const Queue& queue, int consumerCoreID, uint64_t& garbage) {
+    std::atomic<uint64_t> endTsc{0};
+    std::thread consumer(RunConsumer, queue.get(),
+                         THROUGHPUT_WARMUP + THROUGHPUT_MESSAGES,
+                         consumerCoreID, &endTsc, &garbage);
+
+    Message message = {};
+    for (uint64_t i = 0; i < THROUGHPUT_WARMUP; ++i) {
+        message.sequence = i;
+        Send(*queue, message);
+    }
+
+    const uint64_t start = __rdtsc();
+    for (uint64_t i = 0; i < THROUGHPUT_MESSAGES; ++i) {
+        message.sequence = i;
+        message.payload[0] = i;
+        Send(*queue, message);
+    }
+
+    consumer.join();
+    return static_cast<double>(endTsc.load() - start) / THROUGHPUT_MESSAGES;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<uint64_t> setIndices;
+    for (uint64_t i = 0; i < DEFAULT_SET_INDICES; ++i) {
+        setIndices.push_back(i * SET_INDEX_STRIDE % Geometry().setsPerBank);
+    }
+    int consumerCore = -1;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--set-indices" && i + 1 < argc) {
+            setIndices = ParseList(argv[++i]);
+        } else if (arg == "--consumer" && i + 1 < argc) {
+            consumerCore = std::stoi(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--set-indices I,J,...] [--consumer CORE]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    SliceAllocatorOptions options;
+    options.setIndices = setIndices;
+    options.cores = AllowedCores();
+    if (options.cores.size() < 2) {
+        std::cerr << "Needs a producer and a consumer core" << std::endl;
+        return 1;
+    }
+    const int producerCore = options.cores[0];
+    if (consumerCore < 0) {
+        consumerCore = options.cores[1];
+    }
+    if (consumerCore == producerCore ||
+        std::find(options.cores.begin(), options.cores.end(), consumerCore) ==
+        options.cores.end()) {
+        std::cerr << "The consumer core must be another core the process "
+                  << "may run on" << std::endl;
+        return 1;
+    }
+    PinToCore(producerCore);
+
+    uint64_t garbage = 0;
+    EvictionSetBuilder builder;
+    SliceAllocator allocator(builder, options, garbage);
+
+    const uint64_t bestBank =
+        allocator.SharedBank({producerCore, consumerCore});
+    uint64_t worstBank = 0;
+    for (uint64_t bank = 1; bank < allocator.Banks(); ++bank) {
+        if (allocator.Latency(bank, producerCore) +
+            allocator.Latency(bank, consumerCore) >
+            allocator.Latency(worstBank, producerCore) +
+            allocator.Latency(worstBank, consumerCore)) {
+            worstBank = bank;
+        }
+    }
+    std::cout << "Producer on core " << producerCore << ", consumer on core "
+              << consumerCore << ", best bank " << bestBank << " ("
+              << allocator.Latency(bestBank, producerCore) << " + "
+              << allocator.Latency(bestBank, consumerCore)
+              << " cycles), worst bank " << worstBank << " ("
+              << allocator.Latency(worstBank, producerCore) << " + "
+              << allocator.Latency(worstBank, consumerCore) << " cycles)"
+              << std::endl;
+
+    struct Placement {
+        std::string name;
+        // -1: ordinary allocation.
+        int64_t bank;
+    };
+    const std::vector<Placement> placements = {
+        {"best bank", static_cast<int64_t>(bestBank)},
+        {"default", -1},
+        {"worst bank", static_cast<int64_t>(worstBank)},
+    };
+
+    auto makeQueue = [&](const Placement& placement, uint64_t capacity) {
+        Queue queue = placement.bank < 0 ?
+            DefaultQueue<Message>(capacity) :
+            PlaceQueue<Message>(allocator, placement.bank, capacity);
+        assert(queue != nullptr);
+        return queue;
+    };
+
+    std::cout << "placement   round trip (cycles)  cycles per message"
+              << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (const Placement& placement : placements) {
+        double roundTrip = 0;
+        {
+            const Queue requests = makeQueue(placement, PING_PONG_SLOTS);
+            const Queue responses = makeQueue(placement, PING_PONG_SLOTS);
+            roundTrip = PingPong(requests, responses, consumerCore);
+        }
+        double perMessage = 0;
+        {
+            const Queue queue = makeQueue(placement, THROUGHPUT_SLOTS);
+            perMessage = Throughput(queue, consumerCore, garbage);
+        }
+
+        std::cout << std::left << std::setw(12) << placement.name
+                  << std::right << std::setw(19) << roundTrip
+                  << std::setw(20) << perMessage << std::endl;
+    }
+
+    std::cout << "(Garbage: " << garbage << ")" << std::endl;
+
+    return 0;
+}
@@ -1,13 +1,121 @@
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #include "constants.h"
 #include "constructingEvictionSet.h"
+#include "evictionSetBuilder.h"
+#include "measurementKernels.h"
 
-int main() {
-    Node* array = nullptr;
-    std::vector<Node*> evictionSet = GetEvictionSet(&array, /*setIndex=*/0);
+// Deserializes "text" into the arena of "group".
+bool Deserialize(const std::string& text, const EvictionSetGroup& group,
+                 EvictionSetGroup* restored) {
+    std::istringstream in(text);
+    return EvictionSetGroup::Deserialize(
+        in, CandidateArena::Borrow(group.Arena().Data(), group.Arena().Size()),
+        restored);
+}
+
+// Serializes "group", relinks it in place from the text and revalidates the
+// result. Also checks that a different profile name and a line listed twice
+// are rejected.
+bool CheckSerializationRoundTrip(const EvictionSetGroup& group,
+                                 uint64_t& garbage) {
+    std::stringstream text;
+    group.Serialize(text);
+
+    EvictionSetGroup restored;
+    if (!Deserialize(text.str(), group, &restored)) {
+        return false;
+    }
+    for (uint64_t bank = 0; bank < group.Banks(); ++bank) {
+        if (restored.Members(bank) != group.Members(bank)) {
+            std::cout << "Eviction set " << bank << " changed in the round trip"
+                      << std::endl;
+            return false;
+        }
+    }
+    if (!restored.Validate(garbage)) {
+        return false;
+    }
+
+    // Six header words (the profile name is the third), then the offsets.
+    std::vector<std::string> words;
+    std::string word;
+    while (text >> word) {
+        words.push_back(word);
+    }
+    auto join = [](const std::vector<std::string>& words) {
+        std::string joined;
+        for (const std::string& word : words) {
+            joined += word + " ";
+        }
+        return joined;
+    };
+    std::vector<std::string> renamed = words;
+    renamed[2] = "other-profile";
+    std::vector<std::string> duplicated = words;
+    duplicated.back() = duplicated[6];
+
+    std::cout << "Expecting two rejected eviction set groups:" << std::endl;
+    EvictionSetGroup rejected;
+    return !Deserialize(join(renamed), group, &rejected) &&
+           !Deserialize(join(duplicated), group, &rejected);
+}
+
+void PrintUsage(const char* program) {
+    std::cerr << "Usage: " << program
+              << " [--cross-core HELPER_CORE] [--seed SEED]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    EvictionSetBuilder builder;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        if (arg == "--cross-core") {
+            ProbeConfig config;
+            config.strategy = ProbeStrategy::CROSS_CORE;
+            config.helperCoreID = std::stoi(argv[++i]);
+            builder.probeConfig = config;
+
+            // The helper thread may run on any core of the taskset, so keep
+            // construction on the core it started on.
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(sched_getcpu(), &cpuset);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+        } else if (arg == "--seed") {
+            builder.seed = std::stoull(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    SanityCheckMeasurementKernels();
+
+    // The group frees its arena when it goes out of scope.
+    const EvictionSetGroup group = builder.Build(/*setIndex=*/0);
+
+    uint64_t garbage = 0;
+    const bool valid = group.Validate(garbage);
+    std::cout << "Built " << group.Banks() << " eviction sets for set index "
+              << group.SetIndex() << ", revalidation "
+              << (valid ? "passed" : "failed") << std::endl;
 
-    delete [] array;
+    const bool roundTrip = valid && CheckSerializationRoundTrip(group, garbage);
+    std::cout << "Serialization round trip "
+              << (roundTrip ? "passed" : "failed") << " (garbage: " << garbage
+              << ")" << std::endl;
 
-    return 0;
+    return roundTrip ? 0 : 1;
 }
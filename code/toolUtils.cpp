@@ -0,0 +1,62 @@
+#include <cassert>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "toolUtils.h"
+
+std::vector<std::string> SplitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+std::vector<uint64_t> ParseList(const std::string& list) {
+    std::vector<uint64_t> values;
+    for (const std::string& item : SplitList(list)) {
+        values.push_back(std::stoull(item));
+    }
+    return values;
+}
+
+// The affinity of the thread which runs the static initializers, i.e., the
+// process's before any thread pinned itself. Read once: a pinned thread's own
+// affinity holds only its core.
+const std::vector<int>& StartupAffinity() {
+    static const std::vector<int> cores = [] {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        int result = sched_getaffinity(0, sizeof(cpu_set_t), &cpuset);
+        assert(result == 0);
+
+        std::vector<int> cores;
+        for (int core = 0; core < CPU_SETSIZE; ++core) {
+            if (CPU_ISSET(core, &cpuset)) {
+                cores.push_back(core);
+            }
+        }
+        return cores;
+    }();
+    return cores;
+}
+
+// Takes the snapshot before main() runs.
+const std::vector<int>& startupAffinity = StartupAffinity();
+
+std::vector<int> AllowedCores() {
+    return StartupAffinity();
+}
+
+void PinToCore(int coreID) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(coreID, &cpuset);
+    pthread_t currentThread = pthread_self();
+    pthread_setaffinity_np(currentThread, sizeof(cpu_set_t), &cpuset);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Small helpers shared by the command-line tools.
+
+// Splits a comma-separated list, e.g., "inclusive,small-pages".
+std::vector<std::string> SplitList(const std::string& list);
+
+// Parses a comma-separated list of numbers, e.g., "0,27,1000".
+std::vector<uint64_t> ParseList(const std::string& list);
+
+// The cores the process may run on, in ascending order. Taken when the program
+// starts, so pinning a thread does not change it.
+std::vector<int> AllowedCores();
+
+// Restricts the calling thread to "coreID".
+void PinToCore(int coreID);
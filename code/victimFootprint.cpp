@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "toolUtils.h"
+#include "victimFootprint.h"
+
+// Warmup accesses per signature entry, as a fraction of the timed ones.
+const uint64_t SIGNATURE_WARMUP_DIVISOR = 10;
+
+void MeasureFromCore(Node* head, int coreID, uint64_t accesses, double* time,
+                     uint64_t* garbage) {
+    PinToCore(coreID);
+
+    Node* node = head;
+    MeasureChase(&node, accesses / SIGNATURE_WARMUP_DIVISOR);
+    *time = static_cast<double>(MeasureChase(&node, accesses)) / accesses;
+    *garbage += node->padding[0];
+}
+
+std::vector<double> BankLatencySignature(Node* head,
+                                         const std::vector<int>& cores,
+                                         uint64_t& garbage,
+                                         uint64_t accesses) {
+    std::vector<double> signature(cores.size());
+    for (uint64_t i = 0; i < cores.size(); ++i) {
+        // One core at a time, so that the measurements do not contend.
+        std::thread thread(MeasureFromCore, head, cores[i], accesses,
+                           &signature[i], &garbage);
+        thread.join();
+    }
+    return signature;
+}
+
+std::vector<std::vector<double>> GroupLatencySignatures(
+    const std::vector<Node*>& heads, const std::vector<int>& cores,
+    uint64_t& garbage, uint64_t accesses) {
+    std::vector<std::vector<double>> signatures;
+    for (Node* head : heads) {
+        signatures.push_back(
+            BankLatencySignature(head, cores, garbage, accesses));
+    }
+    return signatures;
+}
+
+// Distance of two signatures after removing their means, so that a shift of
+// all latencies (e.g., a frequency change between measurements) does not
+// count.
+double SignatureDistance(const std::vector<double>& a,
+                         const std::vector<double>& b) {
+    assert(a.size() == b.size());
+    double meanA = 0;
+    double meanB = 0;
+    for (uint64_t i = 0; i < a.size(); ++i) {
+        meanA += a[i] / a.size();
+        meanB += b[i] / b.size();
+    }
+
+    double distance = 0;
+    for (uint64_t i = 0; i < a.size(); ++i) {
+        distance += std::fabs((a[i] - meanA) - (b[i] - meanB));
+    }
+    return distance;
+}
+
+bool MatchBanks(const std::vector<std::vector<double>>& reference,
+                std::vector<Node*>* heads, const std::vector<int>& cores,
+                uint64_t& garbage, uint64_t accesses) {
+    assert(cores.size() >= 2);
+    assert(heads->size() == reference.size());
+
+    const std::vector<std::vector<double>> signatures =
+        GroupLatencySignatures(*heads, cores, garbage, accesses);
+
+    // Greedy assignment, closest pairs first.
+    std::vector<std::tuple<double, uint64_t, uint64_t>> pairs;
+    for (uint64_t bank = 0; bank < reference.size(); ++bank) {
+        for (uint64_t set = 0; set < signatures.size(); ++set) {
+            pairs.emplace_back(
+                SignatureDistance(reference[bank], signatures[set]), bank,
+                set);
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+
+    const uint64_t unmatched = heads->size();
+    std::vector<uint64_t> setOfBank(reference.size(), unmatched);
+    std::vector<bool> setMatched(signatures.size(), false);
+    for (const auto& [distance, bank, set] : pairs) {
+        if (setOfBank[bank] == unmatched && !setMatched[set]) {
+            setOfBank[bank] = set;
+            setMatched[set] = true;
+        }
+    }
+
+    // Every set should be closest to the bank it was assigned to. Otherwise
+    // the greedy assignment had to settle for a second choice.
+    bool unambiguous = true;
+    for (uint64_t bank = 0; bank < reference.size(); ++bank) {
+        const uint64_t set = setOfBank[bank];
+        for (uint64_t other = 0; other < reference.size(); ++other) {
+            if (SignatureDistance(reference[other], signatures[set]) <
+                SignatureDistance(reference[bank], signatures[set])) {
+                unambiguous = false;
+            }
+        }
+    }
+
+    std::vector<Node*> matched(heads->size());
+    for (uint64_t bank = 0; bank < reference.size(); ++bank) {
+        matched[bank] = (*heads)[setOfBank[bank]];
+    }
+    *heads = matched;
+
+    return unambiguous;
+}
+
+std::vector<std::vector<Node*>> FootprintSets(
+    const std::vector<std::vector<Node*>*>& groups, uint64_t bank) {
+    std::vector<std::vector<Node*>> sets;
+    for (const std::vector<Node*>* group : groups) {
+        std::vector<Node*> members;
+        Node* node = (*group)[bank];
+        do {
+            members.push_back(node);
+            node = node->next;
+        } while (node != (*group)[bank]);
+        sets.push_back(members);
+    }
+    return sets;
+}
+
+Node* InterleaveSets(const std::vector<std::vector<Node*>>& sets) {
+    uint64_t longest = 0;
+    for (const std::vector<Node*>& set : sets) {
+        longest = std::max<uint64_t>(longest, set.size());
+    }
+
+    std::vector<Node*> nodes;
+    for (uint64_t i = 0; i < longest; ++i) {
+        for (const std::vector<Node*>& set : sets) {
+            if (i < set.size()) {
+                nodes.push_back(set[i]);
+            }
+        }
+    }
+    return LinkCandidates(nodes);
+}
+
+void RelinkSets(const std::vector<std::vector<Node*>>& sets) {
+    for (const std::vector<Node*>& set : sets) {
+        LinkCandidates(set);
+    }
+}
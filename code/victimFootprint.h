@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "constants.h"
+
+// Victim footprints spread over several set indices of each bank.
+//
+// One eviction set per bank keeps the victim's traffic in a single set, so
+// replacement effects within that set become part of the signal. A footprint
+// instead takes one eviction set per bank from each of several groups (one
+// group per set index), and interleaves their members into one list, which
+// still hits in the LLC.
+//
+// Banks are numbered per construction, so the groups' banks are matched
+// first. A bank is recognized by its latency signature: the access time of
+// its set from every core of the socket. Each slice sits next to one core's
+// ring stop, so the signatures differ by slice, as in GetAttackerClosestBank()
+// of portAttack.
+
+// Timed accesses per signature entry. The difference between the closest and
+// the other slices is a few cycles, so it needs many accesses.
+const uint64_t DEFAULT_SIGNATURE_ACCESSES = 1000000;
+
+// Average access time of the set at "head" from each of "cores", in cycles,
+// over "accesses" accesses from each.
+std::vector<double> BankLatencySignature(
+    Node* head, const std::vector<int>& cores, uint64_t& garbage,
+    uint64_t accesses = DEFAULT_SIGNATURE_ACCESSES);
+
+// Distance of two signatures, ignoring a shift of all their latencies.
+double SignatureDistance(const std::vector<double>& a,
+                         const std::vector<double>& b);
+
+// Signatures of all sets of a group.
+std::vector<std::vector<double>> GroupLatencySignatures(
+    const std::vector<Node*>& heads, const std::vector<int>& cores,
+    uint64_t& garbage, uint64_t accesses = DEFAULT_SIGNATURE_ACCESSES);
+
+// Reorders "heads" so that each set is in the bank position of the
+// "reference" signature it is closest to. Needs at least two cores in the
+// signatures, which are measured with as many accesses as "reference" was.
+// Returns false if two sets of the group look alike.
+bool MatchBanks(const std::vector<std::vector<double>>& reference,
+                std::vector<Node*>* heads, const std::vector<int>& cores,
+                uint64_t& garbage,
+                uint64_t accesses = DEFAULT_SIGNATURE_ACCESSES);
+
+// Members of every set of "groups" for one bank, one list per group, in list
+// order.
+std::vector<std::vector<Node*>> FootprintSets(
+    const std::vector<std::vector<Node*>*>& groups, uint64_t bank);
+
+// Links "sets" into one closed list which takes their members round-robin:
+// the first member of every set, then the second, and so on. Returns its head.
+// The sets' own lists are overwritten until RelinkSets().
+Node* InterleaveSets(const std::vector<std::vector<Node*>>& sets);
+
+// Links each of "sets" back into its own closed list.
+void RelinkSets(const std::vector<std::vector<Node*>>& sets);
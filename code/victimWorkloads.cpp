@@ -0,0 +1,351 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <x86intrin.h>
+
+#include "constants.h"
+#include "constructingEvictionSet.h"
+#include "measurementKernels.h"
+#include "victimWorkloads.h"
+
+// Keys per hash bucket, and keys inserted per bucket (75% full).
+const uint64_t HASH_BUCKET_KEYS = 8;
+const uint64_t HASH_FILL_KEYS = 6;
+
+const uint64_t BTREE_KEYS = 3;
+const uint64_t BTREE_CHILDREN = BTREE_KEYS + 1;
+
+const uint64_t KV_INDEX_KEYS = 4;
+
+struct HashBucket {
+    uint64_t keys[HASH_BUCKET_KEYS];
+};
+
+struct BTreeNode {
+    uint64_t count;
+    uint64_t keys[BTREE_KEYS];
+    BTreeNode* children[BTREE_CHILDREN];
+};
+
+struct KvIndexLine {
+    uint64_t keys[KV_INDEX_KEYS];
+    Node* values[KV_INDEX_KEYS];
+};
+
+static_assert(sizeof(HashBucket) == CACHE_LINE_SIZE &&
+              sizeof(BTreeNode) == CACHE_LINE_SIZE &&
+              sizeof(KvIndexLine) == CACHE_LINE_SIZE,
+              "Every structure fills one line");
+
+const std::pair<const char*, VictimWorkload> WORKLOAD_NAMES[] = {
+    {"chase", VictimWorkload::CHASE},
+    {"hash", VictimWorkload::HASH_PROBE},
+    {"btree", VictimWorkload::BTREE_LOOKUP},
+    {"memcpy", VictimWorkload::MEMCPY},
+    {"kv", VictimWorkload::KV_GET},
+};
+
+bool ParseVictimWorkload(const std::string& name, VictimWorkload* workload) {
+    for (const auto& [workloadName, value] : WORKLOAD_NAMES) {
+        if (name == workloadName) {
+            *workload = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string VictimWorkloadName(VictimWorkload workload) {
+    for (const auto& [workloadName, value] : WORKLOAD_NAMES) {
+        if (workload == value) {
+            return workloadName;
+        }
+    }
+    return "unknown";
+}
+
+std::vector<Node*> PoolLines(const std::vector<std::vector<Node*>>& sets) {
+    uint64_t longest = 0;
+    for (const std::vector<Node*>& set : sets) {
+        longest = std::max<uint64_t>(longest, set.size());
+    }
+
+    std::vector<Node*> lines;
+    for (uint64_t i = 0; i < longest; ++i) {
+        for (const std::vector<Node*>& set : sets) {
+            if (i < set.size()) {
+                lines.push_back(set[i]);
+            }
+        }
+    }
+    return lines;
+}
+
+// Fibonacci hashing.
+uint64_t HashKey(uint64_t key) {
+    return (key * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+void BuildHashTable(const std::vector<Node*>& lines, VictimWorkloadData* data) {
+    std::vector<HashBucket*> buckets;
+    for (Node* line : lines) {
+        buckets.push_back(new (line) HashBucket());
+    }
+
+    data->tables = lines;
+    data->keys = HASH_FILL_KEYS * lines.size();
+    for (uint64_t key = 1; key <= data->keys; ++key) {
+        uint64_t bucket = HashKey(key) % buckets.size();
+        while (buckets[bucket]->keys[HASH_BUCKET_KEYS - 1] != 0) {
+            bucket = (bucket + 1) % buckets.size();
+        }
+        uint64_t slot = 0;
+        while (buckets[bucket]->keys[slot] != 0) {
+            ++slot;
+        }
+        buckets[bucket]->keys[slot] = key;
+    }
+}
+
+bool HashProbe(const std::vector<Node*>& tables, uint64_t key) {
+    uint64_t bucket = HashKey(key) % tables.size();
+    while (true) {
+        const HashBucket* line = reinterpret_cast<HashBucket*>(tables[bucket]);
+        for (uint64_t slot = 0; slot < HASH_BUCKET_KEYS; ++slot) {
+            if (line->keys[slot] == key) {
+                return true;
+            }
+            if (line->keys[slot] == 0) {
+                return false;
+            }
+        }
+        bucket = (bucket + 1) % tables.size();
+    }
+}
+
+// Sizes of the children of a node over "keys" keys: the keys but the node's
+// own, in equal parts.
+std::vector<uint64_t> BTreeParts(uint64_t keys) {
+    const uint64_t rest = keys - BTREE_KEYS;
+    std::vector<uint64_t> parts(BTREE_CHILDREN, rest / BTREE_CHILDREN);
+    for (uint64_t i = 0; i < rest % BTREE_CHILDREN; ++i) {
+        ++parts[i];
+    }
+    return parts;
+}
+
+uint64_t BTreeNodes(uint64_t keys) {
+    if (keys == 0) {
+        return 0;
+    }
+    if (keys <= BTREE_KEYS) {
+        return 1;
+    }
+    uint64_t nodes = 1;
+    for (uint64_t part : BTreeParts(keys)) {
+        nodes += BTreeNodes(part);
+    }
+    return nodes;
+}
+
+// Builds the subtree over the "count" keys from "first" (even numbers, in
+// order) in the next lines.
+BTreeNode* BuildBTree(uint64_t first, uint64_t count,
+                      const std::vector<Node*>& lines, uint64_t* next) {
+    if (count == 0) {
+        return nullptr;
+    }
+    assert(*next < lines.size());
+    BTreeNode* node = new (lines[(*next)++]) BTreeNode();
+
+    if (count <= BTREE_KEYS) {
+        node->count = count;
+        for (uint64_t i = 0; i < count; ++i) {
+            node->keys[i] = first + 2 * i;
+        }
+        return node;
+    }
+
+    node->count = BTREE_KEYS;
+    uint64_t key = first;
+    const std::vector<uint64_t> parts = BTreeParts(count);
+    for (uint64_t i = 0; i < BTREE_CHILDREN; ++i) {
+        node->children[i] = BuildBTree(key, parts[i], lines, next);
+        key += 2 * parts[i];
+        if (i < BTREE_KEYS) {
+            node->keys[i] = key;
+            key += 2;
+        }
+    }
+    return node;
+}
+
+bool BTreeLookup(const BTreeNode* node, uint64_t key) {
+    while (node != nullptr) {
+        uint64_t i = 0;
+        while (i < node->count && key > node->keys[i]) {
+            ++i;
+        }
+        if (i < node->count && key == node->keys[i]) {
+            return true;
+        }
+        node = node->children[i];
+    }
+    return false;
+}
+
+void BuildKvStore(const std::vector<Node*>& lines, VictimWorkloadData* data) {
+    assert(lines.size() >= 2);
+
+    // Index capacity for all lines, with values on three quarters of them.
+    const uint64_t indexLines = std::max<uint64_t>(lines.size() / 4, 1);
+    data->tables.assign(lines.begin(), lines.begin() + indexLines);
+    data->values.assign(lines.begin() + indexLines, lines.end());
+    data->keys = data->values.size();
+
+    std::vector<KvIndexLine*> index;
+    for (Node* line : data->tables) {
+        index.push_back(new (line) KvIndexLine());
+    }
+    for (uint64_t key = 1; key <= data->keys; ++key) {
+        Node* value = data->values[key - 1];
+        for (uint64_t i = 0; i < CACHE_LINE_SIZE / sizeof(uint64_t); ++i) {
+            reinterpret_cast<uint64_t*>(value)[i] = key + i;
+        }
+
+        uint64_t line = HashKey(key) % index.size();
+        while (index[line]->keys[KV_INDEX_KEYS - 1] != 0) {
+            line = (line + 1) % index.size();
+        }
+        uint64_t slot = 0;
+        while (index[line]->keys[slot] != 0) {
+            ++slot;
+        }
+        index[line]->keys[slot] = key;
+        index[line]->values[slot] = value;
+    }
+}
+
+// Copies the value of "key", which must be in the store, to "out".
+void KvGet(const std::vector<Node*>& tables, uint64_t key, Node* out) {
+    uint64_t line = HashKey(key) % tables.size();
+    while (true) {
+        const KvIndexLine* index =
+            reinterpret_cast<KvIndexLine*>(tables[line]);
+        for (uint64_t slot = 0; slot < KV_INDEX_KEYS; ++slot) {
+            if (index->keys[slot] == key) {
+                std::memcpy(out, index->values[slot], CACHE_LINE_SIZE);
+                return;
+            }
+        }
+        line = (line + 1) % tables.size();
+    }
+}
+
+void BuildVictimWorkload(VictimWorkload workload,
+                         const std::vector<Node*>& lines, uint64_t threads,
+                         VictimWorkloadData* data) {
+    assert(!lines.empty());
+    *data = VictimWorkloadData();
+    data->workload = workload;
+    data->threads = std::max<uint64_t>(threads, 1);
+
+    switch (workload) {
+    case VictimWorkload::CHASE:
+        data->head = LinkCandidates(lines);
+        break;
+
+    case VictimWorkload::HASH_PROBE:
+        BuildHashTable(lines, data);
+        break;
+
+    case VictimWorkload::BTREE_LOOKUP: {
+        // As many keys as fit in the lines.
+        uint64_t keys = BTREE_KEYS * lines.size();
+        while (BTreeNodes(keys) > lines.size()) {
+            --keys;
+        }
+        uint64_t next = 0;
+        data->head = reinterpret_cast<Node*>(
+            BuildBTree(/*first=*/2, keys, lines, &next));
+        data->keys = keys;
+        break;
+    }
+
+    case VictimWorkload::MEMCPY:
+        // Half sources, half destinations, at least one per thread.
+        data->tables.assign(lines.begin(), lines.begin() + lines.size() / 2);
+        data->values.assign(lines.begin() + lines.size() / 2, lines.end());
+        assert(!data->tables.empty());
+        assert(data->values.size() >= data->threads);
+        for (Node* line : data->tables) {
+            line->padding[0] = reinterpret_cast<uintptr_t>(line);
+        }
+        break;
+
+    case VictimWorkload::KV_GET:
+        BuildKvStore(lines, data);
+        break;
+    }
+}
+
+uint64_t RunVictimWorkload(const VictimWorkloadData& data, uint64_t thread,
+                           uint64_t operations, uint64_t* garbage) {
+    assert(thread < data.threads);
+    SplitMix64 random(ConstructionSeed() + thread);
+    uint64_t found = 0;
+
+    const uint64_t start = __rdtsc();
+    switch (data.workload) {
+    case VictimWorkload::CHASE: {
+        Node* node = data.head;
+        const uint64_t time = TimedChase(&node, operations);
+        *garbage += node->padding[0];
+        return time;
+    }
+
+    case VictimWorkload::HASH_PROBE:
+        for (uint64_t i = 0; i < operations; ++i) {
+            found += HashProbe(data.tables, random.Below(2 * data.keys) + 1);
+        }
+        break;
+
+    case VictimWorkload::BTREE_LOOKUP: {
+        const BTreeNode* root = reinterpret_cast<BTreeNode*>(data.head);
+        for (uint64_t i = 0; i < operations; ++i) {
+            found += BTreeLookup(root, random.Below(2 * data.keys) + 1);
+        }
+        break;
+    }
+
+    case VictimWorkload::MEMCPY: {
+        // This thread's destinations are every threads-th one.
+        const uint64_t destinations =
+            (data.values.size() - thread + data.threads - 1) / data.threads;
+        for (uint64_t i = 0; i < operations; ++i) {
+            Node* destination =
+                data.values[thread + data.threads * (i % destinations)];
+            std::memcpy(destination, data.tables[i % data.tables.size()],
+                        CACHE_LINE_SIZE);
+            found += destination->padding[0];
+        }
+        break;
+    }
+
+    case VictimWorkload::KV_GET: {
+        Node value;
+        for (uint64_t i = 0; i < operations; ++i) {
+            KvGet(data.tables, random.Below(data.keys) + 1, &value);
+            found += value.padding[0];
+        }
+        break;
+    }
+    }
+    const uint64_t end = __rdtsc();
+
+    *garbage += found;
+    return end - start;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+
+// Service-style victim kernels, as an alternative to the plain pointer chase
+// of portAttack's victims.
+//
+// Their hot data is laid out over a bank-colored pool: lines of the victim
+// eviction sets of chosen banks (see PoolLines()), so that a kernel can be
+// confined to one bank or spread over all of them. Lines of one set index
+// share their L1 and L2 sets, so the kernels' accesses to more lines than the
+// L2 has ways are served by the LLC banks, as the chase's are. Laying out a
+// kernel overwrites the lines' list links; RelinkSets() (victimFootprint.h)
+// restores them.
+
+enum class VictimWorkload {
+    // Chases the lines in pool order, like IterateThroughSetVictim().
+    CHASE,
+    // Looks up random keys in an open-addressing hash table, one bucket (of 8
+    // keys) per line, filled to 75%. Half of the lookups miss.
+    HASH_PROBE,
+    // Looks up random keys in a static B-tree of 3 keys and 4 children per
+    // line. Half of the lookups miss.
+    BTREE_LOOKUP,
+    // Copies source lines to destination lines, one line per operation. Each
+    // thread writes its own destination lines.
+    MEMCPY,
+    // GETs of random keys from a key-value store: an index of 4 keys and
+    // value pointers per line, and a line per value, which is copied out.
+    KV_GET,
+};
+
+// Names as on the command line: chase, hash, btree, memcpy, kv.
+bool ParseVictimWorkload(const std::string& name, VictimWorkload* workload);
+std::string VictimWorkloadName(VictimWorkload workload);
+
+// The pool's lines: the members of "sets" (e.g., one eviction set per chosen
+// bank and victim group) taken round-robin, so that consecutive lines
+// alternate between the sets.
+std::vector<Node*> PoolLines(const std::vector<std::vector<Node*>>& sets);
+
+struct VictimWorkloadData {
+    VictimWorkload workload;
+    // Threads which run the workload at the same time.
+    uint64_t threads;
+
+    // CHASE: any node of the list. BTREE_LOOKUP: the root.
+    Node* head = nullptr;
+
+    // HASH_PROBE buckets, or KV_GET index lines. MEMCPY sources.
+    std::vector<Node*> tables;
+    // KV_GET values. MEMCPY destinations.
+    std::vector<Node*> values;
+
+    // Keys are 1 to "keys" (HASH_PROBE, KV_GET), or the even numbers 2 to
+    // 2 * "keys" (BTREE_LOOKUP).
+    uint64_t keys = 0;
+};
+
+// Lays out "workload" over "lines", for "threads" threads.
+void BuildVictimWorkload(VictimWorkload workload,
+                         const std::vector<Node*>& lines, uint64_t threads,
+                         VictimWorkloadData* data);
+
+// Runs "operations" operations (lookups, line copies, GETs, or chase
+// accesses) as thread "thread" of the data's threads. Returns the TSC cycles
+// they took.
+uint64_t RunVictimWorkload(const VictimWorkloadData& data, uint64_t thread,
+                           uint64_t operations, uint64_t* garbage);